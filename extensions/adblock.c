@@ -963,12 +963,12 @@ adblock_window_object_cleared_cb (WebKitWebView*  web_view,
 }
 
 static void
-adblock_add_tab_cb (MidoriBrowser*   browser,
-                    MidoriView*      view,
-                    MidoriExtension* extension)
+adblock_web_view_created_cb (MidoriView*      view,
+                             GtkWidget*       web_view,
+                             MidoriExtension* extension)
 {
-    GtkWidget* web_view = midori_view_get_web_view (view);
     #if HAVE_WEBKIT_RESOURCE_REQUEST
+    MidoriBrowser* browser = midori_browser_get_for_widget (GTK_WIDGET (view));
     GtkWidget* image = g_object_get_data (G_OBJECT (browser), "status-image");
     #endif
 
@@ -986,6 +986,21 @@ adblock_add_tab_cb (MidoriBrowser*   browser,
     #endif
 }
 
+static void
+adblock_add_tab_cb (MidoriBrowser*   browser,
+                    MidoriView*      view,
+                    MidoriExtension* extension)
+{
+    GtkWidget* web_view;
+
+    /* Views restored in the background or hibernated
+       get a web view only once they are loaded */
+    g_signal_connect (view, "web-view-created",
+        G_CALLBACK (adblock_web_view_created_cb), extension);
+    if ((web_view = midori_view_peek_web_view (view)))
+        adblock_web_view_created_cb (view, web_view, extension);
+}
+
 static void
 adblock_deactivate_cb (MidoriExtension* extension,
                        MidoriBrowser*   browser);
@@ -1313,16 +1328,18 @@ adblock_parse_file (gchar* path)
 
 static void
 adblock_deactivate_tabs (MidoriView*      view,
-                         MidoriBrowser*   browser,
                          MidoriExtension* extension)
 {
-    GtkWidget* web_view = midori_view_get_web_view (view);
+    GtkWidget* web_view = midori_view_peek_web_view (view);
     #if HAVE_WEBKIT_RESOURCE_REQUEST
+    MidoriBrowser* browser = midori_browser_get_for_widget (GTK_WIDGET (view));
     GtkWidget* image = g_object_get_data (G_OBJECT (browser), "status-image");
     #endif
 
     g_signal_handlers_disconnect_by_func (
-       browser, adblock_add_tab_cb, extension);
+       view, adblock_web_view_created_cb, extension);
+    if (!web_view)
+        return;
     g_signal_handlers_disconnect_by_func (
        web_view, adblock_window_object_cleared_cb, 0);
     #if WEBKIT_CHECK_VERSION (1, 1, 15)
@@ -1357,7 +1374,8 @@ adblock_deactivate_cb (MidoriExtension* extension,
         app, adblock_app_add_browser_cb, extension);
     g_signal_handlers_disconnect_by_func (
         browser, adblock_add_tab_cb, extension);
-    midori_browser_foreach (browser, (GtkCallback)adblock_deactivate_tabs, browser);
+    midori_browser_foreach (browser,
+        (GtkCallback)adblock_deactivate_tabs, extension);
 
     katze_assign (blockcss, NULL);
     katze_assign (blockcssprivate, NULL);
@@ -1509,14 +1509,28 @@ addons_context_ready_cb (WebKitWebView*   web_view,
     g_free (uri);
 }
 
+static void
+addons_web_view_created_cb (MidoriView*      view,
+                            GtkWidget*       web_view,
+                            MidoriExtension* extension)
+{
+    g_signal_connect (web_view, "window-object-cleared",
+        G_CALLBACK (addons_context_ready_cb), extension);
+}
+
 static void
 addons_add_tab_cb (MidoriBrowser* browser,
                    MidoriView*  view,
                    MidoriExtension* extension)
 {
-    GtkWidget* web_view = midori_view_get_web_view (view);
-    g_signal_connect (web_view, "window-object-cleared",
-        G_CALLBACK (addons_context_ready_cb), extension);
+    GtkWidget* web_view;
+
+    /* Views restored in the background or hibernated
+       get a web view only once they are loaded */
+    g_signal_connect (view, "web-view-created",
+        G_CALLBACK (addons_web_view_created_cb), extension);
+    if ((web_view = midori_view_peek_web_view (view)))
+        addons_web_view_created_cb (view, web_view, extension);
     g_signal_connect (view, "notify::load-status",
         G_CALLBACK (addons_notify_load_status_cb), extension);
 }
@@ -1533,9 +1547,12 @@ static void
 addons_deactivate_tabs (MidoriView*      view,
                         MidoriExtension* extension)
 {
-    GtkWidget* web_view = midori_view_get_web_view (view);
+    GtkWidget* web_view = midori_view_peek_web_view (view);
     g_signal_handlers_disconnect_by_func (
-        web_view, addons_context_ready_cb, extension);
+        view, addons_web_view_created_cb, extension);
+    if (web_view != NULL)
+        g_signal_handlers_disconnect_by_func (
+            web_view, addons_context_ready_cb, extension);
 }
 
 static void
@@ -28,6 +28,8 @@ typedef struct _CookieManagerPagePrivate			CookieManagerPagePrivate;
 
 
 #define CM_EMPTY_LABEL_TEXT "\n\n\n\n\n\n"
+/* milliseconds to wait after the last keystroke before filtering */
+#define CM_FILTER_DELAY 300
 
 
 struct _CookieManagerPagePrivate
@@ -40,6 +42,7 @@ struct _CookieManagerPagePrivate
 
 	GtkWidget *filter_entry;
 	gboolean ignore_changed_filter;
+	guint filter_timer_id;
 
 	GtkWidget *desc_label;
 	GtkWidget *delete_button;
@@ -201,6 +204,9 @@ static void cookie_manager_page_finalize(GObject *object)
 
 	gtk_widget_destroy(priv->popup_menu);
 
+	if (priv->filter_timer_id > 0)
+		g_source_remove(priv->filter_timer_id);
+
 	g_signal_handlers_disconnect_by_func(priv->parent,
 		cookie_manager_page_pre_cookies_change_cb, object);
 	g_signal_handlers_disconnect_by_func(priv->parent,
@@ -740,9 +746,10 @@ static gboolean cm_tree_query_tooltip(GtkWidget *widget, gint x, gint y, gboolea
 #endif
 
 
+/* needle must already be in lower case */
 static gboolean cm_filter_match(const gchar *haystack, const gchar *needle)
 {
-	gchar *haystack_lowered, *needle_lowered;
+	gchar *haystack_lowered;
 	gboolean result;
 
 	/* empty strings always match */
@@ -750,75 +757,93 @@ static gboolean cm_filter_match(const gchar *haystack, const gchar *needle)
 		return TRUE;
 
 	haystack_lowered = g_utf8_strdown(haystack, -1);
-	needle_lowered = g_utf8_strdown(needle, -1);
 
-	/* if one of both could not be converted into lower case, skip those */
-	if (haystack_lowered == NULL || needle_lowered == NULL)
+	/* if it could not be converted into lower case, skip it */
+	if (haystack_lowered == NULL)
 		return FALSE;
 
-	result = (strstr(haystack_lowered, needle_lowered) != NULL);
+	result = (strstr(haystack_lowered, needle) != NULL);
 
 	g_free(haystack_lowered);
-	g_free(needle_lowered);
 
 	return result;
 }
 
 
+static void cm_filter_set_visible(CookieManagerPage *cmp, GtkTreeIter *iter, gboolean visible)
+{
+	gboolean old_visible;
+	CookieManagerPagePrivate *priv = COOKIE_MANAGER_PAGE_GET_PRIVATE(cmp);
+
+	/* every change is propagated through the filter model, so skip unchanged rows */
+	gtk_tree_model_get(GTK_TREE_MODEL(priv->store), iter, COOKIE_MANAGER_COL_VISIBLE, &old_visible, -1);
+	if (old_visible != visible)
+		gtk_tree_store_set(priv->store, iter, COOKIE_MANAGER_COL_VISIBLE, visible, -1);
+}
+
+
 static void cm_filter_tree(CookieManagerPage *cmp, const gchar *filter_text)
 {
 	GtkTreeIter iter, child;
 	GtkTreeModel *model;
 	gboolean show_child, show_parent;
 	gboolean child_visible;
-	gint i, n;
 	gchar *name;
 	gchar *domain;
+	gchar *needle;
 	CookieManagerPagePrivate *priv = COOKIE_MANAGER_PAGE_GET_PRIVATE(cmp);
 
 	model = GTK_TREE_MODEL(priv->store);
 	if (! gtk_tree_model_get_iter_first(model, &iter))
 		return;
 
+	needle = g_utf8_strdown(filter_text, -1);
+	if (needle == NULL)
+		return;
+
 	do
 	{
-		if (gtk_tree_model_iter_has_child(model, &iter))
+		if (gtk_tree_model_iter_children(model, &child, &iter))
 		{
 			child_visible = FALSE;
 
 			gtk_tree_model_get(model, &iter, COOKIE_MANAGER_COL_NAME, &domain, -1);
-			show_parent = cm_filter_match(domain, filter_text);
+			show_parent = cm_filter_match(domain, needle);
 			g_free(domain);
-			n = gtk_tree_model_iter_n_children(model, &iter);
-			for (i = 0; i < n; i++)
+			do
 			{
-				gtk_tree_model_iter_nth_child(model, &child, &iter, i);
-
-				gtk_tree_model_get(model, &child, COOKIE_MANAGER_COL_NAME, &name, -1);
-				show_child = show_parent || cm_filter_match(name, filter_text);
-				g_free(name);
+				if (show_parent)
+					show_child = TRUE;
+				else
+				{
+					gtk_tree_model_get(model, &child, COOKIE_MANAGER_COL_NAME, &name, -1);
+					show_child = cm_filter_match(name, needle);
+					g_free(name);
+				}
 
 				if (show_child)
 					child_visible = TRUE;
 
-				gtk_tree_store_set(priv->store, &child, COOKIE_MANAGER_COL_VISIBLE, show_child, -1);
+				cm_filter_set_visible(cmp, &child, show_child);
 			}
-			gtk_tree_store_set(priv->store, &iter, COOKIE_MANAGER_COL_VISIBLE, child_visible, -1);
+			while (gtk_tree_model_iter_next(model, &child));
+			cm_filter_set_visible(cmp, &iter, child_visible);
 		}
 	}
 	while (gtk_tree_model_iter_next(model, &iter));
+
+	g_free(needle);
 }
 
 
-static void cm_filter_entry_changed_cb(GtkEditable *editable, CookieManagerPage *cmp)
+static gboolean cm_filter_timeout_cb(CookieManagerPage *cmp)
 {
 	const gchar *text;
 	CookieManagerPagePrivate *priv = COOKIE_MANAGER_PAGE_GET_PRIVATE(cmp);
 
-	if (priv->ignore_changed_filter)
-		return;
+	priv->filter_timer_id = 0;
 
-	text = gtk_entry_get_text(GTK_ENTRY(editable));
+	text = gtk_entry_get_text(GTK_ENTRY(priv->filter_entry));
 	cm_filter_tree(cmp, text);
 
 	cookie_manager_update_filter(priv->parent, text);
@@ -827,6 +852,34 @@ static void cm_filter_entry_changed_cb(GtkEditable *editable, CookieManagerPage
 		gtk_tree_view_expand_all(GTK_TREE_VIEW(priv->treeview));
 	else
 		gtk_tree_view_collapse_all(GTK_TREE_VIEW(priv->treeview));
+
+	return FALSE;
+}
+
+
+static void cm_filter_entry_changed_cb(GtkEditable *editable, CookieManagerPage *cmp)
+{
+	CookieManagerPagePrivate *priv = COOKIE_MANAGER_PAGE_GET_PRIVATE(cmp);
+
+	if (priv->ignore_changed_filter)
+		return;
+
+	/* filtering many cookies takes a while, so wait until the user stops typing */
+	if (priv->filter_timer_id > 0)
+		g_source_remove(priv->filter_timer_id);
+	priv->filter_timer_id = g_timeout_add(CM_FILTER_DELAY,
+		(GSourceFunc) cm_filter_timeout_cb, cmp);
+}
+
+
+static void cm_filter_entry_activate_cb(GtkEntry *entry, CookieManagerPage *cmp)
+{
+	CookieManagerPagePrivate *priv = COOKIE_MANAGER_PAGE_GET_PRIVATE(cmp);
+
+	/* don't wait for the timeout when the user explicitly asks for it */
+	if (priv->filter_timer_id > 0)
+		g_source_remove(priv->filter_timer_id);
+	cm_filter_timeout_cb(cmp);
 }
 
 
@@ -1113,6 +1166,7 @@ static void cookie_manager_page_init(CookieManagerPage *self)
 	priv->parent = NULL;
 	priv->store = NULL;
 	priv->ignore_changed_filter = FALSE;
+	priv->filter_timer_id = 0;
 
 	cm_create_toolbar(self);
 
@@ -1156,7 +1210,7 @@ static void cookie_manager_page_init(CookieManagerPage *self)
 	g_signal_connect(priv->filter_entry, "icon-release",
 		G_CALLBACK(cm_filter_entry_clear_icon_released_cb), NULL);
 	g_signal_connect(priv->filter_entry, "changed", G_CALLBACK(cm_filter_entry_changed_cb), self);
-	g_signal_connect(priv->filter_entry, "activate", G_CALLBACK(cm_filter_entry_changed_cb), self);
+	g_signal_connect(priv->filter_entry, "activate", G_CALLBACK(cm_filter_entry_activate_cb), self);
 
 	filter_hbox = gtk_hbox_new(FALSE, 0);
 	gtk_box_pack_start(GTK_BOX(filter_hbox), filter_label, FALSE, FALSE, 3);
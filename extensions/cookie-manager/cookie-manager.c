@@ -39,8 +39,11 @@ struct _CookieManagerPrivate
 	GSList *panel_pages;
 
 	GtkTreeStore *store;
-	GSList *cookies;
+	/* domain names as keys, GtkTreeRowReferences of their parent rows as values */
+	GHashTable *domains;
 	SoupCookieJar *jar;
+	/* jar changes not yet applied to the store, latest first */
+	GSList *changes;
 	guint timer_id;
 	gint ignore_changed_count;
 
@@ -61,6 +64,15 @@ enum
 };
 static guint signals[LAST_SIGNAL];
 
+/* with more pending changes than this, rebuilding the store is cheaper */
+#define CM_MAX_INCREMENTAL_CHANGES 500
+
+typedef struct
+{
+	SoupCookie *old;
+	SoupCookie *new;
+} CookieManagerChange;
+
 
 G_DEFINE_TYPE(CookieManager, cookie_manager, G_TYPE_OBJECT);
 
@@ -142,44 +154,65 @@ static void cookie_manager_app_add_browser_cb(MidoriApp *app, MidoriBrowser *bro
 }
 
 
-static void cookie_manager_free_cookie_list(CookieManager *cm)
+static void cookie_manager_free_changes(CookieManager *cm)
 {
+	GSList *l;
 	CookieManagerPrivate *priv = COOKIE_MANAGER_GET_PRIVATE(cm);
 
-	if (priv->cookies != NULL)
+	for (l = priv->changes; l != NULL; l = g_slist_next(l))
 	{
-		GSList *l;
+		CookieManagerChange *change = l->data;
 
-		for (l = priv->cookies; l != NULL; l = g_slist_next(l))
-			soup_cookie_free(l->data);
-		g_slist_free(priv->cookies);
-		priv->cookies = NULL;
+		if (change->old != NULL)
+			soup_cookie_free(change->old);
+		if (change->new != NULL)
+			soup_cookie_free(change->new);
+		g_slice_free(CookieManagerChange, change);
 	}
+	g_slist_free(priv->changes);
+	priv->changes = NULL;
+}
+
+
+static gboolean cookie_manager_filter_match(const gchar *text, const gchar *filter_text)
+{
+	gchar *text_lowered, *filter_lowered;
+	gboolean result;
+
+	if (filter_text == NULL || *filter_text == '\0')
+		return TRUE;
+
+	text_lowered = g_utf8_strdown(text, -1);
+	filter_lowered = g_utf8_strdown(filter_text, -1);
+	result = (strstr(text_lowered, filter_lowered) != NULL);
+	g_free(text_lowered);
+	g_free(filter_lowered);
+
+	return result;
 }
 
 
 static void cookie_manager_refresh_store(CookieManager *cm)
 {
-	GSList *l;
+	GSList *cookies, *l;
 	GHashTable *parents;
 	GtkTreeIter iter;
 	GtkTreeIter *parent_iter;
 	SoupCookie *cookie;
+	gint i;
 	CookieManagerPrivate *priv = COOKIE_MANAGER_GET_PRIVATE(cm);
 
 	g_signal_emit(cm, signals[PRE_COOKIES_CHANGE], 0);
 
+	g_hash_table_remove_all(priv->domains);
 	gtk_tree_store_clear(priv->store);
 
-	/* free the old list */
-	cookie_manager_free_cookie_list(cm);
-
-	priv->cookies = soup_cookie_jar_all_cookies(priv->jar);
+	cookies = soup_cookie_jar_all_cookies(priv->jar);
 
 	/* Hashtable holds domain names as keys, the corresponding tree iters as values */
 	parents = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
-	for (l = priv->cookies; l != NULL; l = g_slist_next(l))
+	for (l = cookies; l != NULL; l = g_slist_next(l))
 	{
 		cookie = l->data;
 
@@ -188,8 +221,7 @@ static void cookie_manager_refresh_store(CookieManager *cm)
 		{
 			parent_iter = g_new0(GtkTreeIter, 1);
 
-			gtk_tree_store_append(priv->store, parent_iter, NULL);
-			gtk_tree_store_set(priv->store, parent_iter,
+			gtk_tree_store_insert_with_values(priv->store, parent_iter, NULL, -1,
 				COOKIE_MANAGER_COL_NAME, cookie->domain,
 				COOKIE_MANAGER_COL_COOKIE, NULL,
 				COOKIE_MANAGER_COL_VISIBLE, TRUE,
@@ -198,24 +230,198 @@ static void cookie_manager_refresh_store(CookieManager *cm)
 			g_hash_table_insert(parents, g_strdup(cookie->domain), parent_iter);
 		}
 
-		gtk_tree_store_append(priv->store, &iter, parent_iter);
-		gtk_tree_store_set(priv->store, &iter,
+		/* the store keeps its own copy of the cookie */
+		gtk_tree_store_insert_with_values(priv->store, &iter, parent_iter, -1,
 			COOKIE_MANAGER_COL_NAME, cookie->name,
 			COOKIE_MANAGER_COL_COOKIE, cookie,
 			COOKIE_MANAGER_COL_VISIBLE, TRUE,
 			-1);
+		soup_cookie_free(cookie);
 	}
+	g_slist_free(cookies);
 	g_hash_table_destroy(parents);
 
+	/* index the parent rows by position, looking up each path would be quadratic */
+	i = 0;
+	if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(priv->store), &iter))
+	{
+		do
+		{
+			GtkTreePath *path = gtk_tree_path_new_from_indices(i++, -1);
+			gchar *domain;
+
+			gtk_tree_model_get(GTK_TREE_MODEL(priv->store), &iter,
+				COOKIE_MANAGER_COL_NAME, &domain, -1);
+			g_hash_table_insert(priv->domains, domain,
+				gtk_tree_row_reference_new(GTK_TREE_MODEL(priv->store), path));
+			gtk_tree_path_free(path);
+		}
+		while (gtk_tree_model_iter_next(GTK_TREE_MODEL(priv->store), &iter));
+	}
+
 	g_signal_emit(cm, signals[COOKIES_CHANGED], 0);
 }
 
 
+static gboolean cookie_manager_get_parent(CookieManager *cm, const gchar *domain,
+										  GtkTreeIter *parent, gboolean create)
+{
+	GtkTreeRowReference *ref;
+	GtkTreePath *path;
+	CookieManagerPrivate *priv = COOKIE_MANAGER_GET_PRIVATE(cm);
+
+	/* panel pages remove rows themselves, so the reference may be stale */
+	if ((ref = g_hash_table_lookup(priv->domains, domain)) != NULL)
+	{
+		if ((path = gtk_tree_row_reference_get_path(ref)) != NULL)
+		{
+			gtk_tree_model_get_iter(GTK_TREE_MODEL(priv->store), parent, path);
+			gtk_tree_path_free(path);
+			return TRUE;
+		}
+		g_hash_table_remove(priv->domains, domain);
+	}
+
+	if (! create)
+		return FALSE;
+
+	gtk_tree_store_insert_with_values(priv->store, parent, NULL, -1,
+		COOKIE_MANAGER_COL_NAME, domain,
+		COOKIE_MANAGER_COL_COOKIE, NULL,
+		COOKIE_MANAGER_COL_VISIBLE, FALSE,
+		-1);
+	path = gtk_tree_model_get_path(GTK_TREE_MODEL(priv->store), parent);
+	g_hash_table_insert(priv->domains, g_strdup(domain),
+		gtk_tree_row_reference_new(GTK_TREE_MODEL(priv->store), path));
+	gtk_tree_path_free(path);
+
+	return TRUE;
+}
+
+
+/* rows are identified by domain, name and path, unlike soup_cookie_equal() the value is ignored */
+static gboolean cookie_manager_cookie_matches(SoupCookie *a, SoupCookie *b)
+{
+	return strcmp(a->name, b->name) == 0 && g_strcmp0(a->path, b->path) == 0
+		&& g_strcmp0(a->domain, b->domain) == 0;
+}
+
+
+static gboolean cookie_manager_find_cookie(CookieManager *cm, GtkTreeIter *parent,
+										   SoupCookie *cookie, GtkTreeIter *iter)
+{
+	GtkTreeModel *model;
+	SoupCookie *row_cookie;
+	gchar *name;
+	gboolean found = FALSE;
+	CookieManagerPrivate *priv = COOKIE_MANAGER_GET_PRIVATE(cm);
+
+	model = GTK_TREE_MODEL(priv->store);
+	if (! gtk_tree_model_iter_children(model, iter, parent))
+		return FALSE;
+
+	do
+	{
+		gtk_tree_model_get(model, iter, COOKIE_MANAGER_COL_NAME, &name, -1);
+		if (name != NULL && strcmp(name, cookie->name) == 0)
+		{
+			gtk_tree_model_get(model, iter, COOKIE_MANAGER_COL_COOKIE, &row_cookie, -1);
+			if (row_cookie != NULL)
+			{
+				found = cookie_manager_cookie_matches(row_cookie, cookie);
+				soup_cookie_free(row_cookie);
+			}
+		}
+		g_free(name);
+	}
+	while (! found && gtk_tree_model_iter_next(model, iter));
+
+	return found;
+}
+
+
+static void cookie_manager_update_parent(CookieManager *cm, GtkTreeIter *parent)
+{
+	GtkTreeIter child;
+	GtkTreeModel *model;
+	gboolean visible = FALSE;
+	CookieManagerPrivate *priv = COOKIE_MANAGER_GET_PRIVATE(cm);
+
+	model = GTK_TREE_MODEL(priv->store);
+	if (! gtk_tree_model_iter_children(model, &child, parent))
+	{
+		/* the row reference invalidates itself */
+		gtk_tree_store_remove(priv->store, parent);
+		return;
+	}
+
+	do
+		gtk_tree_model_get(model, &child, COOKIE_MANAGER_COL_VISIBLE, &visible, -1);
+	while (! visible && gtk_tree_model_iter_next(model, &child));
+
+	gtk_tree_store_set(priv->store, parent, COOKIE_MANAGER_COL_VISIBLE, visible, -1);
+}
+
+
+static void cookie_manager_apply_change(CookieManager *cm, SoupCookie *old, SoupCookie *new)
+{
+	GtkTreeIter parent, iter;
+	gboolean visible = FALSE;
+	CookieManagerPrivate *priv = COOKIE_MANAGER_GET_PRIVATE(cm);
+
+	if (new != NULL)
+		visible = cookie_manager_filter_match(new->domain, priv->filter_text)
+			|| cookie_manager_filter_match(new->name, priv->filter_text);
+
+	if (old != NULL && cookie_manager_get_parent(cm, old->domain, &parent, FALSE)
+		&& cookie_manager_find_cookie(cm, &parent, old, &iter))
+	{
+		/* a changed value keeps its row, and with it the selection */
+		if (new != NULL && cookie_manager_cookie_matches(old, new))
+		{
+			gtk_tree_store_set(priv->store, &iter,
+				COOKIE_MANAGER_COL_COOKIE, new,
+				COOKIE_MANAGER_COL_VISIBLE, visible,
+				-1);
+			cookie_manager_update_parent(cm, &parent);
+			return;
+		}
+		gtk_tree_store_remove(priv->store, &iter);
+		cookie_manager_update_parent(cm, &parent);
+	}
+
+	if (new != NULL)
+	{
+		cookie_manager_get_parent(cm, new->domain, &parent, TRUE);
+		gtk_tree_store_insert_with_values(priv->store, &iter, &parent, -1,
+			COOKIE_MANAGER_COL_NAME, new->name,
+			COOKIE_MANAGER_COL_COOKIE, new,
+			COOKIE_MANAGER_COL_VISIBLE, visible,
+			-1);
+		if (visible)
+			gtk_tree_store_set(priv->store, &parent, COOKIE_MANAGER_COL_VISIBLE, TRUE, -1);
+	}
+}
+
+
 static gboolean cookie_manager_delayed_refresh(CookieManager *cm)
 {
+	GSList *l;
 	CookieManagerPrivate *priv = COOKIE_MANAGER_GET_PRIVATE(cm);
 
-	cookie_manager_refresh_store(cm);
+	priv->changes = g_slist_reverse(priv->changes);
+	if (g_slist_length(priv->changes) > CM_MAX_INCREMENTAL_CHANGES)
+		cookie_manager_refresh_store(cm);
+	else
+	{
+		for (l = priv->changes; l != NULL; l = g_slist_next(l))
+		{
+			CookieManagerChange *change = l->data;
+
+			cookie_manager_apply_change(cm, change->old, change->new);
+		}
+	}
+	cookie_manager_free_changes(cm);
 	priv->timer_id = 0;
 
 	return FALSE;
@@ -225,15 +431,22 @@ static gboolean cookie_manager_delayed_refresh(CookieManager *cm)
 static void cookie_manager_jar_changed_cb(SoupCookieJar *jar, SoupCookie *old, SoupCookie *new,
 							  CookieManager *cm)
 {
+	CookieManagerChange *change;
 	CookieManagerPrivate *priv = COOKIE_MANAGER_GET_PRIVATE(cm);
 
-	if (priv->ignore_changed_count > 0)
+	/* cookies deleted from a panel page were already removed from the store */
+	if (priv->ignore_changed_count > 0 && new == NULL)
 	{
 		priv->ignore_changed_count--;
 		return;
 	}
 
-	/* We delay these events a little bit to avoid too many rebuilds of the tree.
+	change = g_slice_new(CookieManagerChange);
+	change->old = old != NULL ? soup_cookie_copy(old) : NULL;
+	change->new = new != NULL ? soup_cookie_copy(new) : NULL;
+	priv->changes = g_slist_prepend(priv->changes, change);
+
+	/* We delay these events a little bit to avoid too many updates of the tree.
 	 * Some websites (like Flyspray bugtrackers sent a whole bunch of cookies at once. */
 	if (priv->timer_id == 0)
 		priv->timer_id = g_timeout_add_seconds(1, (GSourceFunc) cookie_manager_delayed_refresh, cm);
@@ -256,8 +469,9 @@ static void cookie_manager_finalize(GObject *object)
 	if (priv->timer_id > 0)
 		g_source_remove(priv->timer_id);
 
-	cookie_manager_free_cookie_list(cm);
+	cookie_manager_free_changes(cm);
 
+	g_hash_table_destroy(priv->domains);
 	g_object_unref(priv->store);
 	g_free(priv->filter_text);
 
@@ -272,6 +486,9 @@ static void cookie_manager_init(CookieManager *self)
 
 	priv->filter_text = NULL;
 	priv->panel_pages = NULL;
+	priv->changes = NULL;
+	priv->domains = g_hash_table_new_full(g_str_hash, g_str_equal,
+		g_free, (GDestroyNotify) gtk_tree_row_reference_free);
 	/* create the main store */
 	priv->store = gtk_tree_store_new(COOKIE_MANAGER_N_COLUMNS,
 		G_TYPE_STRING, SOUP_TYPE_COOKIE, G_TYPE_BOOLEAN);
@@ -306,7 +523,6 @@ void cookie_manager_delete_cookie(CookieManager *cm, SoupCookie *cookie)
 		priv->ignore_changed_count++;
 
 		soup_cookie_jar_delete_cookie(priv->jar, cookie);
-		/* the SoupCookie object is freed when the whole list gets updated */
 	}
 }
 
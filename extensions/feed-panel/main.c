@@ -263,6 +263,15 @@ feed_transfer_cb (KatzeNetRequest* request,
             feed_remove_flags (netpriv->feed, FEED_READ);
         }
     }
+    else if (request->status == KATZE_NET_FAILED)
+    {
+        gchar* msg;
+
+        msg = g_strdup_printf (_("Error loading feed '%s'"),
+                        katze_item_get_uri (KATZE_ITEM (netpriv->feed)));
+        feed_handle_net_error (netpriv, msg);
+        g_free (msg);
+    }
 
     netpriv->parsers = NULL;
     netpriv->feed = NULL;
@@ -309,11 +309,10 @@ formhistory_window_object_cleared_cb (WebKitWebView*  web_view,
 }
 
 static void
-formhistory_add_tab_cb (MidoriBrowser*   browser,
-                        MidoriView*      view,
-                        MidoriExtension* extension)
+formhistory_web_view_created_cb (MidoriView*      view,
+                                 GtkWidget*       web_view,
+                                 MidoriExtension* extension)
 {
-    GtkWidget* web_view = midori_view_get_web_view (view);
     g_signal_connect (web_view, "window-object-cleared",
             G_CALLBACK (formhistory_window_object_cleared_cb), NULL);
     #if WEBKIT_CHECK_VERSION (1, 1, 4)
@@ -325,6 +324,21 @@ formhistory_add_tab_cb (MidoriBrowser*   browser,
     #endif
 }
 
+static void
+formhistory_add_tab_cb (MidoriBrowser*   browser,
+                        MidoriView*      view,
+                        MidoriExtension* extension)
+{
+    GtkWidget* web_view;
+
+    /* Views restored in the background or hibernated
+       get a web view only once they are loaded */
+    g_signal_connect (view, "web-view-created",
+        G_CALLBACK (formhistory_web_view_created_cb), extension);
+    if ((web_view = midori_view_peek_web_view (view)))
+        formhistory_web_view_created_cb (view, web_view, extension);
+}
+
 static void
 formhistory_deactivate_cb (MidoriExtension* extension,
                            MidoriBrowser*   browser);
@@ -352,15 +366,18 @@ formhistory_app_add_browser_cb (MidoriApp*       app,
 
 static void
 formhistory_deactivate_tabs (MidoriView*      view,
-                             MidoriBrowser*   browser,
                              MidoriExtension* extension)
 {
-    GtkWidget* web_view = midori_view_get_web_view (view);
+    GtkWidget* web_view = midori_view_peek_web_view (view);
     g_signal_handlers_disconnect_by_func (
-       web_view, formhistory_window_object_cleared_cb, NULL);
+       view, formhistory_web_view_created_cb, extension);
+    if (web_view != NULL)
+        g_signal_handlers_disconnect_by_func (
+           web_view, formhistory_window_object_cleared_cb, NULL);
     #if WEBKIT_CHECK_VERSION (1, 1, 4)
-    g_signal_handlers_disconnect_by_func (
-       web_view, formhistory_navigation_decision_cb, extension);
+    if (web_view != NULL)
+        g_signal_handlers_disconnect_by_func (
+           web_view, formhistory_navigation_decision_cb, extension);
     #else
     g_signal_handlers_disconnect_by_func (
        webkit_get_default_session (), formhistory_session_request_queued_cb, extension);
@@ -373,6 +390,7 @@ formhistory_deactivate_cb (MidoriExtension* extension,
 {
     MidoriApp* app = midori_extension_get_app (extension);
     sqlite3* db;
+    guint maintain_timeout;
 
     g_signal_handlers_disconnect_by_func (
        browser, formhistory_add_tab_cb, extension);
@@ -387,8 +405,24 @@ formhistory_deactivate_cb (MidoriExtension* extension,
     if (global_keys)
         g_hash_table_destroy (global_keys);
 
+    if ((maintain_timeout = GPOINTER_TO_UINT (g_object_get_data (
+        G_OBJECT (extension), "formhistory-maintain"))))
+        g_source_remove (maintain_timeout);
+    g_object_set_data (G_OBJECT (extension), "formhistory-maintain", NULL);
     if ((db = g_object_get_data (G_OBJECT (extension), "formhistory-db")))
         sqlite3_close (db);
+    g_object_set_data (G_OBJECT (extension), "formhistory-db", NULL);
+}
+
+static gboolean
+formhistory_maintain_cb (MidoriExtension* extension)
+{
+    gchar* filename = g_build_filename (
+        midori_extension_get_config_dir (extension), "forms.db", NULL);
+    /* Maintained on a separate connection, not when quitting */
+    sokoke_maintain_database_file (filename);
+    g_free (filename);
+    return TRUE;
 }
 
 static int
@@ -438,11 +472,14 @@ formhistory_activate_cb (MidoriExtension* extension,
     config_dir = midori_extension_get_config_dir (extension);
     katze_mkdir_with_parents (config_dir, 0700);
     filename = g_build_filename (config_dir, "forms.db", NULL);
-    if (sqlite3_open (filename, &db) != SQLITE_OK)
+    if (!(db = sokoke_open_database (filename, &errmsg)))
     {
-        g_warning (_("Failed to open database: %s\n"), sqlite3_errmsg (db));
-        sqlite3_close (db);
+        g_warning ("%s", errmsg);
+        g_free (errmsg);
+        errmsg = NULL;
     }
+    else
+        sqlite3_busy_timeout (db, 1000);
     g_free (filename);
     if ((sqlite3_exec (db, "CREATE TABLE IF NOT EXISTS "
                            "forms (domain text, field text, value text)",
@@ -450,7 +487,12 @@ formhistory_activate_cb (MidoriExtension* extension,
         && (sqlite3_exec (db, "SELECT domain, field, value FROM forms ",
                           formhistory_add_field,
                           NULL, &errmsg2) == SQLITE_OK))
+    {
         g_object_set_data (G_OBJECT (extension), "formhistory-db", db);
+        g_object_set_data (G_OBJECT (extension), "formhistory-maintain",
+            GUINT_TO_POINTER (g_timeout_add_seconds_full (G_PRIORITY_LOW,
+            10 * 60, (GSourceFunc)formhistory_maintain_cb, extension, NULL)));
+    }
     else
     {
         if (errmsg)
@@ -200,12 +200,10 @@ mouse_gestures_button_release_event_cb (GtkWidget*      web_view,
 }
 
 static void
-mouse_gestures_add_tab_cb (MidoriBrowser*   browser,
-                           MidoriView*      view,
-                           MidoriExtension* extension)
+mouse_gestures_web_view_created_cb (MidoriView*    view,
+                                    GtkWidget*     web_view,
+                                    MidoriBrowser* browser)
 {
-    GtkWidget* web_view = midori_view_get_web_view (view);
-
     g_object_connect (web_view,
         "signal::button-press-event",
         mouse_gestures_button_press_event_cb, browser,
@@ -216,16 +214,31 @@ mouse_gestures_add_tab_cb (MidoriBrowser*   browser,
         NULL);
 }
 
+static void
+mouse_gestures_add_tab_cb (MidoriBrowser*   browser,
+                           MidoriView*      view,
+                           MidoriExtension* extension)
+{
+    GtkWidget* web_view;
+
+    /* Views restored in the background or hibernated
+       get a web view only once they are loaded */
+    g_signal_connect (view, "web-view-created",
+        G_CALLBACK (mouse_gestures_web_view_created_cb), browser);
+    if ((web_view = midori_view_peek_web_view (view)))
+        mouse_gestures_web_view_created_cb (view, web_view, browser);
+}
+
 static void
 mouse_gestures_deactivate_cb (MidoriExtension* extension,
                               MidoriBrowser*   browser);
 
 static void
 mouse_gestures_add_tab_foreach_cb (MidoriView*      view,
-                                   MidoriBrowser*   browser,
                                    MidoriExtension* extension)
 {
-    mouse_gestures_add_tab_cb (browser, view, extension);
+    mouse_gestures_add_tab_cb (
+        midori_browser_get_for_widget (GTK_WIDGET (view)), view, extension);
 }
 
 static void
@@ -245,8 +258,12 @@ static void
 mouse_gestures_deactivate_tabs (MidoriView*    view,
                                 MidoriBrowser* browser)
 {
-    GtkWidget* web_view = midori_view_get_web_view (view);
+    GtkWidget* web_view = midori_view_peek_web_view (view);
 
+    g_signal_handlers_disconnect_by_func (
+        view, mouse_gestures_web_view_created_cb, browser);
+    if (!web_view)
+        return;
     g_object_disconnect (web_view,
         "any_signal::button-press-event",
         mouse_gestures_button_press_event_cb, browser,
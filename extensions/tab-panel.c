@@ -148,6 +148,7 @@ tab_panel_treeview_query_tooltip_cb (GtkWidget*  treeview,
     GtkTreePath* path;
     GtkTreeModel* model;
     MidoriView* view;
+    gint64 script_time;
 
     if (!gtk_tree_view_get_tooltip_context (GTK_TREE_VIEW (treeview),
         &x, &y, keyboard_tip, &model, &path, &iter))
@@ -155,7 +156,17 @@ tab_panel_treeview_query_tooltip_cb (GtkWidget*  treeview,
 
     gtk_tree_model_get (model, &iter, 0, &view, -1);
 
-    gtk_tooltip_set_text (tooltip, midori_view_get_display_title (view));
+    /* Only timers that ran long enough to matter are worth a mention */
+    script_time = midori_view_get_script_time (view);
+    if (script_time >= 100)
+    {
+        gchar* text = g_strdup_printf (_("%s\nScript timers: %.1f s"),
+            midori_view_get_display_title (view), script_time / 1000.0);
+        gtk_tooltip_set_text (tooltip, text);
+        g_free (text);
+    }
+    else
+        gtk_tooltip_set_text (tooltip, midori_view_get_display_title (view));
     gtk_tree_view_set_tooltip_row (GTK_TREE_VIEW (treeview), tooltip, path);
 
     gtk_tree_path_free (path);
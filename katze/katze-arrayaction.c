@@ -389,12 +389,14 @@ katze_array_action_generate_menu (KatzeArrayAction* array_action,
             image = gtk_image_new_from_icon_name (icon_name, GTK_ICON_SIZE_MENU);
         else
         {
+            /* The image is updated when an icon is loaded later */
+            image = gtk_image_new ();
             if (KATZE_ITEM_IS_FOLDER (item))
                 icon = gtk_widget_render_icon (menuitem,
                     GTK_STOCK_DIRECTORY, GTK_ICON_SIZE_MENU, NULL);
             else
-                icon = katze_load_cached_icon (katze_item_get_uri (item), proxy);
-            image = gtk_image_new_from_pixbuf (icon);
+                icon = katze_load_cached_icon (katze_item_get_uri (item), image);
+            gtk_image_set_from_pixbuf (GTK_IMAGE (image), icon);
             g_object_unref (icon);
         }
         gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (menuitem), image);
@@ -584,8 +586,9 @@ katze_array_action_item_notify_cb (KatzeItem*   item,
     }
     else if (KATZE_ITEM_IS_BOOKMARK (item) && !strcmp (property, "uri"))
     {
-        icon = katze_load_cached_icon (katze_item_get_uri (item), GTK_WIDGET (toolitem));
-        image = gtk_image_new_from_pixbuf (icon);
+        image = gtk_image_new ();
+        icon = katze_load_cached_icon (katze_item_get_uri (item), image);
+        gtk_image_set_from_pixbuf (GTK_IMAGE (image), icon);
         g_object_unref (icon);
         gtk_widget_show (image);
         gtk_tool_button_set_icon_widget (GTK_TOOL_BUTTON (toolitem), image);
@@ -616,12 +619,14 @@ katze_array_action_proxy_create_menu_proxy_cb (GtkWidget* proxy,
         image = gtk_image_new_from_icon_name (icon_name, GTK_ICON_SIZE_MENU);
     else
     {
+        /* The image is updated when an icon is loaded later */
+        image = gtk_image_new ();
         if (KATZE_ITEM_IS_FOLDER (item))
             icon = gtk_widget_render_icon (menuitem,
                 GTK_STOCK_DIRECTORY, GTK_ICON_SIZE_MENU, NULL);
         else
-            icon = katze_load_cached_icon (katze_item_get_uri (item), proxy);
-        image = gtk_image_new_from_pixbuf (icon);
+            icon = katze_load_cached_icon (katze_item_get_uri (item), image);
+        gtk_image_set_from_pixbuf (GTK_IMAGE (image), icon);
         g_object_unref (icon);
     }
     gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (menuitem), image);
@@ -692,6 +697,7 @@ katze_array_action_create_tool_item_for (KatzeArrayAction* array_action,
     if (KATZE_ITEM_IS_SEPARATOR (item))
         return gtk_separator_tool_item_new ();
 
+    image = gtk_image_new ();
     if (KATZE_ITEM_IS_FOLDER (item))
     {
         toolitem = gtk_toggle_tool_button_new ();
@@ -701,11 +707,11 @@ katze_array_action_create_tool_item_for (KatzeArrayAction* array_action,
     else
     {
         toolitem = gtk_tool_button_new (NULL, "");
-        icon = katze_load_cached_icon (uri, GTK_WIDGET (toolitem));
+        icon = katze_load_cached_icon (uri, image);
     }
     g_signal_connect (toolitem, "create-menu-proxy",
         G_CALLBACK (katze_array_action_proxy_create_menu_proxy_cb), item);
-    image = gtk_image_new_from_pixbuf (icon);
+    gtk_image_set_from_pixbuf (GTK_IMAGE (image), icon);
     g_object_unref (icon);
     gtk_widget_show (image);
     gtk_tool_button_set_icon_widget (GTK_TOOL_BUTTON (toolitem), image);
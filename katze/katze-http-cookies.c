@@ -23,7 +23,11 @@
 #include <libsoup/soup.h>
 #include <gtk/gtk.h>
 #include <glib/gstdio.h>
+#include <sqlite3.h>
 
+/* With a filename ending in .db cookies are stored in a database
+   and only changed cookies are written, otherwise the whole jar is
+   written to a text file in Mozilla format after changes. */
 struct _KatzeHttpCookies
 {
     GObject parent_instance;
@@ -31,8 +35,32 @@ struct _KatzeHttpCookies
     SoupCookieJar* jar;
     guint timeout;
     guint counter;
+
+    sqlite3* db;
+    sqlite3_stmt* insert_stmt;
+    sqlite3_stmt* delete_stmt;
+    GHashTable* changes;
+
+    SoupSession* session;
+    gboolean loading;
+    GThread* load_thread;
+    guint load_idle;
+    gchar* import_filename;
+    gboolean memory_only;
 };
 
+/* A cookie to be written, or deleted if value is %NULL */
+typedef struct
+{
+    gchar* host;
+    gchar* name;
+    gchar* path;
+    gchar* value;
+    gint64 expiry;
+    gboolean secure;
+    gboolean http_only;
+} KatzeCookieChange;
+
 struct _KatzeHttpCookiesClass
 {
     GObjectClass parent_class;
@@ -54,7 +82,8 @@ static SoupCookie*
 parse_cookie (gchar* line,
               time_t now)
 {
-    gchar** result;
+    gchar* result[7];
+    guint n;
     SoupCookie *cookie = NULL;
     gboolean http_only;
     time_t max_age;
@@ -70,15 +99,24 @@ parse_cookie (gchar* line,
     else
         http_only = FALSE;
 
-    result = g_strsplit (line, "\t", -1);
-    if (g_strv_length (result) != 7)
-        goto out;
+    /* Split in place, the line isn't needed afterwards */
+    result[0] = line;
+    for (n = 1; *line; line++)
+        if (*line == '\t')
+        {
+            if (n == G_N_ELEMENTS (result))
+                return NULL;
+            *line = '\0';
+            result[n++] = line + 1;
+        }
+    if (n != G_N_ELEMENTS (result))
+        return NULL;
 
     /* Check this first */
     expires = result[4];
     max_age = strtoul (expires, NULL, 10) - now;
     if (max_age <= 0)
-        goto out;
+        return NULL;
 
     host = result[0];
     /* is_domain = result[1]; */
@@ -95,9 +133,6 @@ parse_cookie (gchar* line,
     if (http_only)
         soup_cookie_set_http_only (cookie, TRUE);
 
-    out:
-        g_strfreev (result);
-
     return cookie;
 }
 
@@ -106,14 +141,15 @@ parse_cookie (gchar* line,
    Copyright (C) 2008 Dan Winship <danw@gnome.org>
    Mostly copied from libSoup 2.24, coding style adjusted */
 static void
-parse_line (SoupCookieJar* jar,
-            gchar*         line,
-            time_t         now)
+parse_line (GFunc    func,
+            gpointer data,
+            gchar*   line,
+            time_t   now)
 {
     SoupCookie* cookie;
 
     if ((cookie = parse_cookie (line, now)))
-        soup_cookie_jar_add_cookie (jar, cookie);
+        func (cookie, data);
 }
 
 /* Cookie jar saving to Mozilla format
@@ -121,33 +157,48 @@ parse_line (SoupCookieJar* jar,
    Copyright (C) 2008 Dan Winship <danw@gnome.org>
    Mostly copied from libSoup 2.24, coding style adjusted */
 static void
-cookie_jar_load (SoupCookieJar* jar,
-                 const gchar*   filename)
+cookie_file_foreach (const gchar* filename,
+                     GFunc        func,
+                     gpointer     data)
 {
-    char* contents = NULL;
+    GMappedFile* file;
+    gchar* contents;
+    gchar* end;
     gchar* line;
     gchar* p;
-    gsize length = 0;
     time_t now;
 
-    if (!g_file_get_contents (filename, &contents, &length, NULL))
+    /* A writable mapping is private, lines are terminated in place */
+    if (!(file = g_mapped_file_new (filename, TRUE, NULL)))
+        return;
+    if (!(contents = g_mapped_file_get_contents (file)))
+    {
+        g_mapped_file_free (file);
         return;
+    }
 
     now = time (NULL);
+    end = contents + g_mapped_file_get_length (file);
     line = contents;
-    for (p = contents; *p; p++)
+    for (p = contents; p < end; p++)
     {
         /* \r\n comes out as an extra empty line and gets ignored */
         if (*p == '\r' || *p == '\n')
         {
             *p = '\0';
-            parse_line (jar, line, now);
+            parse_line (func, data, line, now);
             line = p + 1;
         }
     }
-    parse_line (jar, line, now);
+    /* The last line may lack a newline and thus a terminator */
+    if (line < end)
+    {
+        gchar* last = g_strndup (line, end - line);
+        parse_line (func, data, last, now);
+        g_free (last);
+    }
 
-    g_free (contents);
+    g_mapped_file_free (file);
 }
 
 /* Cookie jar saving to Mozilla format
@@ -225,6 +276,221 @@ failed:
     return FALSE;
 }
 
+static void
+katze_cookie_change_free (KatzeCookieChange* change)
+{
+    g_free (change->host);
+    g_free (change->name);
+    g_free (change->path);
+    g_free (change->value);
+    g_slice_free (KatzeCookieChange, change);
+}
+
+/* Only the last change to a cookie within a batch is written */
+static void
+katze_http_cookies_queue_change (KatzeHttpCookies* http_cookies,
+                                 SoupCookie*       cookie,
+                                 gboolean          delete)
+{
+    KatzeCookieChange* change = g_slice_new (KatzeCookieChange);
+
+    change->host = g_strdup (cookie->domain);
+    change->name = g_strdup (cookie->name);
+    change->path = g_strdup (cookie->path ? cookie->path : "");
+    change->value = delete ? NULL : g_strdup (cookie->value);
+    change->expiry = cookie->expires ? soup_date_to_time_t (cookie->expires) : 0;
+    change->secure = cookie->secure;
+    change->http_only = cookie->http_only;
+    g_hash_table_replace (http_cookies->changes,
+        g_strdup_printf ("%s\t%s\t%s", change->host, change->name, change->path),
+        change);
+}
+
+static void
+katze_http_cookies_write_change (gpointer          key,
+                                 KatzeCookieChange* change,
+                                 KatzeHttpCookies*  http_cookies)
+{
+    sqlite3_stmt* stmt;
+
+    stmt = change->value ? http_cookies->insert_stmt : http_cookies->delete_stmt;
+    sqlite3_bind_text (stmt, 1, change->host, -1, SQLITE_STATIC);
+    sqlite3_bind_text (stmt, 2, change->name, -1, SQLITE_STATIC);
+    sqlite3_bind_text (stmt, 3, change->path, -1, SQLITE_STATIC);
+    if (change->value)
+    {
+        sqlite3_bind_text (stmt, 4, change->value, -1, SQLITE_STATIC);
+        sqlite3_bind_int64 (stmt, 5, change->expiry);
+        sqlite3_bind_int (stmt, 6, change->secure);
+        sqlite3_bind_int (stmt, 7, change->http_only);
+    }
+    if (sqlite3_step (stmt) != SQLITE_DONE)
+        g_printerr (_("Failed to update cookie: %s\n"),
+                    sqlite3_errmsg (http_cookies->db));
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+}
+
+static gboolean
+katze_http_cookies_update_db (KatzeHttpCookies* http_cookies)
+{
+    guint changed;
+
+    http_cookies->timeout = 0;
+
+    if (!(changed = g_hash_table_size (http_cookies->changes)))
+        return FALSE;
+
+    sqlite3_exec (http_cookies->db, "BEGIN;", NULL, NULL, NULL);
+    g_hash_table_foreach (http_cookies->changes,
+        (GHFunc)katze_http_cookies_write_change, http_cookies);
+    sqlite3_exec (http_cookies->db, "COMMIT;", NULL, NULL, NULL);
+    g_hash_table_remove_all (http_cookies->changes);
+
+    if (g_getenv ("MIDORI_COOKIES_DEBUG") != NULL)
+    {
+        g_print ("KatzeHttpCookies: %d cookies changed, %d written\n",
+                 http_cookies->counter, changed);
+        http_cookies->counter = 0;
+    }
+    return FALSE;
+}
+
+static void
+cookie_list_prepend_cb (SoupCookie* cookie,
+                        GSList**    cookies)
+{
+    *cookies = g_slist_prepend (*cookies, cookie);
+}
+
+static GSList*
+katze_http_cookies_read_db (KatzeHttpCookies* http_cookies)
+{
+    sqlite3_stmt* stmt;
+    gint64 now = time (NULL);
+    GSList* cookies = NULL;
+
+    if (sqlite3_prepare_v2 (http_cookies->db,
+        "DELETE FROM cookies WHERE expiry <= ?", -1, &stmt, NULL) == SQLITE_OK)
+    {
+        sqlite3_bind_int64 (stmt, 1, now);
+        sqlite3_step (stmt);
+        sqlite3_finalize (stmt);
+    }
+
+    if (sqlite3_prepare_v2 (http_cookies->db,
+        "SELECT host, name, path, value, expiry, secure, http_only "
+        "FROM cookies", -1, &stmt, NULL) != SQLITE_OK)
+        return NULL;
+
+    while (sqlite3_step (stmt) == SQLITE_ROW)
+    {
+        SoupCookie* cookie = soup_cookie_new (
+            (const gchar*)sqlite3_column_text (stmt, 1),
+            (const gchar*)sqlite3_column_text (stmt, 3),
+            (const gchar*)sqlite3_column_text (stmt, 0),
+            (const gchar*)sqlite3_column_text (stmt, 2),
+            sqlite3_column_int64 (stmt, 4) - now);
+        if (sqlite3_column_int (stmt, 5))
+            soup_cookie_set_secure (cookie, TRUE);
+        if (sqlite3_column_int (stmt, 6))
+            soup_cookie_set_http_only (cookie, TRUE);
+        cookies = g_slist_prepend (cookies, cookie);
+    }
+    sqlite3_finalize (stmt);
+    return cookies;
+}
+
+/* Runs in a thread, the jar and the changes aren't touched here */
+static GSList*
+katze_http_cookies_load_thread (KatzeHttpCookies* http_cookies)
+{
+    GSList* cookies = NULL;
+
+    if (http_cookies->memory_only)
+        return NULL;
+    if (http_cookies->import_filename)
+        cookie_file_foreach (http_cookies->import_filename,
+            (GFunc)cookie_list_prepend_cb, &cookies);
+    else if (http_cookies->db)
+        cookies = katze_http_cookies_read_db (http_cookies);
+    else
+        cookie_file_foreach (http_cookies->filename,
+            (GFunc)cookie_list_prepend_cb, &cookies);
+    return cookies;
+}
+
+static gboolean
+katze_http_cookies_open_db (KatzeHttpCookies* http_cookies)
+{
+    sqlite3* db;
+    sqlite3_stmt* stmt;
+    gboolean exists;
+
+    if (sqlite3_open (http_cookies->filename, &db) != SQLITE_OK)
+    {
+        g_printerr (_("Failed to open database: %s\n"), sqlite3_errmsg (db));
+        sqlite3_close (db);
+        return FALSE;
+    }
+
+    exists = sqlite3_prepare_v2 (db,
+        "SELECT 1 FROM sqlite_master WHERE name = 'cookies'",
+        -1, &stmt, NULL) == SQLITE_OK && sqlite3_step (stmt) == SQLITE_ROW;
+    sqlite3_finalize (stmt);
+
+    /* The primary key doubles as an index by host */
+    if (sqlite3_exec (db,
+        "PRAGMA journal_mode = WAL; PRAGMA synchronous = NORMAL;"
+        "CREATE TABLE IF NOT EXISTS cookies (host TEXT, name TEXT, path TEXT, "
+        "value TEXT, expiry INTEGER, secure INTEGER, http_only INTEGER, "
+        "PRIMARY KEY (host, name, path))", NULL, NULL, NULL) != SQLITE_OK
+     || sqlite3_prepare_v2 (db,
+        "INSERT OR REPLACE INTO cookies (host, name, path, value, expiry, "
+        "secure, http_only) VALUES (?, ?, ?, ?, ?, ?, ?)",
+        -1, &http_cookies->insert_stmt, NULL) != SQLITE_OK
+     || sqlite3_prepare_v2 (db,
+        "DELETE FROM cookies WHERE host = ? AND name = ? AND path = ?",
+        -1, &http_cookies->delete_stmt, NULL) != SQLITE_OK)
+    {
+        g_printerr (_("Failed to open database: %s\n"), sqlite3_errmsg (db));
+        sqlite3_finalize (http_cookies->insert_stmt);
+        http_cookies->insert_stmt = NULL;
+        sqlite3_close (db);
+        return FALSE;
+    }
+
+    http_cookies->db = db;
+    http_cookies->changes = g_hash_table_new_full (g_str_hash, g_str_equal,
+        (GDestroyNotify)g_free, (GDestroyNotify)katze_cookie_change_free);
+
+    /* Cookies of previous versions are imported once */
+    if (!exists)
+    {
+        gchar* text_filename = g_strndup (http_cookies->filename,
+            strlen (http_cookies->filename) - 3);
+        http_cookies->import_filename = g_strconcat (text_filename, ".txt", NULL);
+        g_free (text_filename);
+    }
+    return TRUE;
+}
+
+static void
+katze_http_cookies_close_db (KatzeHttpCookies* http_cookies)
+{
+    if (!http_cookies->db)
+        return;
+
+    katze_http_cookies_update_db (http_cookies);
+    sqlite3_finalize (http_cookies->insert_stmt);
+    sqlite3_finalize (http_cookies->delete_stmt);
+    http_cookies->insert_stmt = http_cookies->delete_stmt = NULL;
+    sqlite3_close (http_cookies->db);
+    http_cookies->db = NULL;
+    g_hash_table_destroy (http_cookies->changes);
+    http_cookies->changes = NULL;
+}
+
 static void
 katze_http_cookies_jar_changed_cb (SoupCookieJar*    jar,
                                    SoupCookie*       old_cookie,
@@ -273,11 +539,92 @@ katze_http_cookies_jar_changed_cb (SoupCookieJar*    jar,
     if (g_getenv ("MIDORI_COOKIES_DEBUG") != NULL)
         http_cookies->counter++;
 
-    if (!http_cookies->timeout && (old_cookie || new_cookie->expires))
+    if (http_cookies->memory_only)
+        return;
+    if (http_cookies->db)
+    {
+        if (old_cookie)
+            katze_http_cookies_queue_change (http_cookies, old_cookie, TRUE);
+        if (new_cookie && new_cookie->expires
+         && soup_date_to_time_t (new_cookie->expires) > time (NULL))
+            katze_http_cookies_queue_change (http_cookies, new_cookie, FALSE);
+        if (!http_cookies->timeout && g_hash_table_size (http_cookies->changes))
+            http_cookies->timeout = g_timeout_add_seconds (5,
+                (GSourceFunc)katze_http_cookies_update_db, http_cookies);
+    }
+    else if (!http_cookies->timeout && (old_cookie || new_cookie->expires))
         http_cookies->timeout = g_timeout_add_seconds (5,
             (GSourceFunc)katze_http_cookies_update_jar, http_cookies);
 }
 
+static void
+katze_http_cookies_request_queued_cb (SoupSession*      session,
+                                      SoupMessage*      msg,
+                                      KatzeHttpCookies* http_cookies);
+
+static void
+katze_http_cookies_finish_load (KatzeHttpCookies* http_cookies)
+{
+    GSList* cookies;
+    GSList* list;
+
+    if (!http_cookies->loading)
+        return;
+    http_cookies->loading = FALSE;
+
+    if (http_cookies->load_thread)
+    {
+        cookies = g_thread_join (http_cookies->load_thread);
+        http_cookies->load_thread = NULL;
+    }
+    else
+        cookies = katze_http_cookies_load_thread (http_cookies);
+
+    if (http_cookies->load_idle)
+    {
+        g_source_remove (http_cookies->load_idle);
+        http_cookies->load_idle = 0;
+    }
+    g_signal_handlers_disconnect_by_func (http_cookies->session,
+        katze_http_cookies_request_queued_cb, http_cookies);
+
+    /* Changes are handled only after the bulk of cookies is in */
+    for (list = cookies; list != NULL; list = g_slist_next (list))
+    {
+        SoupCookie* cookie = list->data;
+        if (http_cookies->import_filename)
+            katze_http_cookies_queue_change (http_cookies, cookie, FALSE);
+        soup_cookie_jar_add_cookie (http_cookies->jar, cookie);
+    }
+    g_slist_free (cookies);
+
+    if (http_cookies->import_filename)
+    {
+        katze_http_cookies_update_db (http_cookies);
+        katze_assign (http_cookies->import_filename, NULL);
+    }
+
+    g_signal_connect (http_cookies->jar, "changed",
+        G_CALLBACK (katze_http_cookies_jar_changed_cb), http_cookies);
+}
+
+/* Loading only has to be complete before the first request */
+static void
+katze_http_cookies_request_queued_cb (SoupSession*      session,
+                                      SoupMessage*      msg,
+                                      KatzeHttpCookies* http_cookies)
+{
+    katze_http_cookies_finish_load (http_cookies);
+}
+
+static gboolean
+katze_http_cookies_load_idle_cb (KatzeHttpCookies* http_cookies)
+{
+    http_cookies->load_idle = 0;
+    katze_http_cookies_finish_load (http_cookies);
+    return FALSE;
+}
+
 static void
 katze_http_cookies_attach (SoupSessionFeature* feature,
                            SoupSession*        session)
@@ -288,10 +635,31 @@ katze_http_cookies_attach (SoupSessionFeature* feature,
     http_cookies->filename = g_object_get_data (G_OBJECT (feature), "filename");
     g_return_if_fail (http_cookies->filename != NULL);
     http_cookies->jar = g_object_ref (jar);
-    cookie_jar_load (http_cookies->jar, http_cookies->filename);
-    g_signal_connect (jar, "changed",
-        G_CALLBACK (katze_http_cookies_jar_changed_cb), feature);
+    http_cookies->session = session;
+    /* A database that can't be opened, maybe because it's locked or
+       corrupted, mustn't be read or overwritten as a text file */
+    if (g_str_has_suffix (http_cookies->filename, ".db")
+     && !katze_http_cookies_open_db (http_cookies))
+    {
+        g_printerr (_("Cookies can't be saved and are kept in memory only.\n"));
+        http_cookies->memory_only = TRUE;
+    }
 
+    /* Cookies are read in a thread while the first window appears */
+    http_cookies->loading = TRUE;
+    if (g_thread_supported ())
+        http_cookies->load_thread = g_thread_create (
+            (GThreadFunc)katze_http_cookies_load_thread, http_cookies, TRUE, NULL);
+    if (!http_cookies->load_thread)
+    {
+        katze_http_cookies_finish_load (http_cookies);
+        return;
+    }
+
+    g_signal_connect (session, "request-queued",
+        G_CALLBACK (katze_http_cookies_request_queued_cb), http_cookies);
+    http_cookies->load_idle = g_idle_add_full (G_PRIORITY_LOW,
+        (GSourceFunc)katze_http_cookies_load_idle_cb, http_cookies, NULL);
 }
 
 static void
@@ -299,8 +667,17 @@ katze_http_cookies_detach (SoupSessionFeature* feature,
                            SoupSession*        session)
 {
     KatzeHttpCookies* http_cookies = (KatzeHttpCookies*)feature;
+    katze_http_cookies_finish_load (http_cookies);
+    if (http_cookies->jar)
+        g_signal_handlers_disconnect_by_func (http_cookies->jar,
+            katze_http_cookies_jar_changed_cb, http_cookies);
     if (http_cookies->timeout)
-        katze_http_cookies_update_jar (http_cookies);
+    {
+        g_source_remove (http_cookies->timeout);
+        if (!http_cookies->db && !http_cookies->memory_only)
+            katze_http_cookies_update_jar (http_cookies);
+    }
+    katze_http_cookies_close_db (http_cookies);
     katze_assign (http_cookies->filename, NULL);
     katze_object_assign (http_cookies->jar, NULL);
 }
@@ -333,4 +710,14 @@ katze_http_cookies_init (KatzeHttpCookies* http_cookies)
     http_cookies->jar = NULL;
     http_cookies->timeout = 0;
     http_cookies->counter = 0;
+    http_cookies->db = NULL;
+    http_cookies->insert_stmt = NULL;
+    http_cookies->delete_stmt = NULL;
+    http_cookies->changes = NULL;
+    http_cookies->session = NULL;
+    http_cookies->loading = FALSE;
+    http_cookies->load_thread = NULL;
+    http_cookies->load_idle = 0;
+    http_cookies->import_filename = NULL;
+    http_cookies->memory_only = FALSE;
 }
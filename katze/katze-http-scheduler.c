@@ -0,0 +1,435 @@
+/*
+ Copyright (C) 2010 Christian Dywan <christian@twotoasts.de>
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ See the file COPYING for the full license text.
+*/
+
+#if HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include "katze-http-scheduler.h"
+
+#include <libsoup/soup.h>
+
+#define KATZE_HTTP_SCHEDULER_OWNER "katze-http-scheduler-owner"
+#define KATZE_HTTP_SCHEDULER_STATE "katze-http-scheduler-state"
+#define KATZE_HTTP_SCHEDULER_HOST "katze-http-scheduler-host"
+
+/* Requests of visible owners, and requests nobody claimed, are never
+   held back. Requests of hidden owners are paused when there are too
+   many of them running, and resumed as soon as the owner is shown. */
+struct _KatzeHttpScheduler
+{
+    GObject parent_instance;
+    SoupSession* session;
+
+    gint max_background;
+    gint max_background_per_host;
+
+    GHashTable* visible;
+    GHashTable* hosts;
+    gint running;
+    GList* waiting;
+};
+
+struct _KatzeHttpSchedulerClass
+{
+    GObjectClass parent_class;
+};
+
+typedef enum
+{
+    KATZE_HTTP_SCHEDULER_FOREGROUND,
+    KATZE_HTTP_SCHEDULER_RUNNING,
+    KATZE_HTTP_SCHEDULER_WAITING
+} KatzeHttpSchedulerState;
+
+static void
+katze_http_scheduler_session_feature_iface_init (SoupSessionFeatureInterface *iface,
+                                                 gpointer                     data);
+
+G_DEFINE_TYPE_WITH_CODE (KatzeHttpScheduler, katze_http_scheduler, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (SOUP_TYPE_SESSION_FEATURE,
+                         katze_http_scheduler_session_feature_iface_init));
+
+enum
+{
+    PROP_0,
+
+    PROP_MAX_BACKGROUND,
+    PROP_MAX_BACKGROUND_PER_HOST
+};
+
+static void
+katze_http_scheduler_finalize (GObject* object);
+
+static void
+katze_http_scheduler_set_property (GObject*      object,
+                                   guint         prop_id,
+                                   const GValue* value,
+                                   GParamSpec*   pspec);
+
+static void
+katze_http_scheduler_get_property (GObject*    object,
+                                   guint       prop_id,
+                                   GValue*     value,
+                                   GParamSpec* pspec);
+
+static KatzeHttpSchedulerState
+katze_http_scheduler_get_state (SoupMessage* msg)
+{
+    return GPOINTER_TO_INT (g_object_get_data (G_OBJECT (msg),
+                                               KATZE_HTTP_SCHEDULER_STATE));
+}
+
+static void
+katze_http_scheduler_set_state (SoupMessage*            msg,
+                                KatzeHttpSchedulerState state)
+{
+    g_object_set_data (G_OBJECT (msg), KATZE_HTTP_SCHEDULER_STATE,
+                       GINT_TO_POINTER (state));
+}
+
+static gboolean
+katze_http_scheduler_is_visible (KatzeHttpScheduler* scheduler,
+                                 SoupMessage*        msg)
+{
+    gpointer owner = g_object_get_data (G_OBJECT (msg), KATZE_HTTP_SCHEDULER_OWNER);
+    return !owner || g_hash_table_lookup (scheduler->visible, owner) != NULL;
+}
+
+static gboolean
+katze_http_scheduler_can_run (KatzeHttpScheduler* scheduler,
+                              SoupMessage*        msg)
+{
+    const gchar* host = soup_message_get_uri (msg)->host;
+
+    if (scheduler->max_background > 0
+     && scheduler->running >= scheduler->max_background)
+        return FALSE;
+    if (scheduler->max_background_per_host > 0 && host
+     && GPOINTER_TO_INT (g_hash_table_lookup (scheduler->hosts, host))
+        >= scheduler->max_background_per_host)
+        return FALSE;
+    return TRUE;
+}
+
+/* A redirect changes the host of the message, so the counted
+   host is remembered in order to release the same one */
+static void
+katze_http_scheduler_count (KatzeHttpScheduler* scheduler,
+                            SoupMessage*        msg,
+                            gint                delta)
+{
+    const gchar* host;
+    gint count;
+
+    scheduler->running += delta;
+    if (delta > 0)
+    {
+        if (!(host = soup_message_get_uri (msg)->host))
+            return;
+        g_object_set_data_full (G_OBJECT (msg), KATZE_HTTP_SCHEDULER_HOST,
+                                g_strdup (host), g_free);
+    }
+    else if (!(host = g_object_get_data (G_OBJECT (msg),
+                                         KATZE_HTTP_SCHEDULER_HOST)))
+        return;
+
+    count = GPOINTER_TO_INT (g_hash_table_lookup (scheduler->hosts, host)) + delta;
+    if (count > 0)
+        g_hash_table_insert (scheduler->hosts, g_strdup (host),
+                             GINT_TO_POINTER (count));
+    else
+        g_hash_table_remove (scheduler->hosts, host);
+
+    if (delta < 0)
+        g_object_set_data (G_OBJECT (msg), KATZE_HTTP_SCHEDULER_HOST, NULL);
+}
+
+static void
+katze_http_scheduler_run_queue (KatzeHttpScheduler* scheduler)
+{
+    GList* waiting = scheduler->waiting;
+
+    while (waiting)
+    {
+        SoupMessage* msg = waiting->data;
+        GList* next = g_list_next (waiting);
+
+        if (katze_http_scheduler_is_visible (scheduler, msg))
+            katze_http_scheduler_set_state (msg, KATZE_HTTP_SCHEDULER_FOREGROUND);
+        else if (katze_http_scheduler_can_run (scheduler, msg))
+        {
+            katze_http_scheduler_set_state (msg, KATZE_HTTP_SCHEDULER_RUNNING);
+            katze_http_scheduler_count (scheduler, msg, 1);
+        }
+        else
+        {
+            waiting = next;
+            continue;
+        }
+
+        scheduler->waiting = g_list_delete_link (scheduler->waiting, waiting);
+        soup_session_unpause_message (scheduler->session, msg);
+        waiting = next;
+    }
+}
+
+static void
+katze_http_scheduler_message_finished_cb (SoupMessage*        msg,
+                                          KatzeHttpScheduler* scheduler)
+{
+    g_signal_handlers_disconnect_by_func (msg,
+        katze_http_scheduler_message_finished_cb, scheduler);
+
+    switch (katze_http_scheduler_get_state (msg))
+    {
+    case KATZE_HTTP_SCHEDULER_RUNNING:
+        katze_http_scheduler_count (scheduler, msg, -1);
+        break;
+    case KATZE_HTTP_SCHEDULER_WAITING:
+        scheduler->waiting = g_list_remove (scheduler->waiting, msg);
+        break;
+    default:
+        break;
+    }
+    katze_http_scheduler_set_state (msg, KATZE_HTTP_SCHEDULER_FOREGROUND);
+    katze_http_scheduler_run_queue (scheduler);
+}
+
+static void
+katze_http_scheduler_session_request_queued_cb (SoupSession*        session,
+                                                SoupMessage*        msg,
+                                                KatzeHttpScheduler* scheduler)
+{
+    if (katze_http_scheduler_is_visible (scheduler, msg))
+        return;
+
+    g_signal_connect (msg, "finished",
+        G_CALLBACK (katze_http_scheduler_message_finished_cb), scheduler);
+
+    if (katze_http_scheduler_can_run (scheduler, msg))
+    {
+        katze_http_scheduler_set_state (msg, KATZE_HTTP_SCHEDULER_RUNNING);
+        katze_http_scheduler_count (scheduler, msg, 1);
+    }
+    else
+    {
+        katze_http_scheduler_set_state (msg, KATZE_HTTP_SCHEDULER_WAITING);
+        scheduler->waiting = g_list_append (scheduler->waiting, msg);
+        soup_session_pause_message (session, msg);
+    }
+}
+
+static void
+katze_http_scheduler_attach (SoupSessionFeature* feature,
+                             SoupSession*        session)
+{
+    KatzeHttpScheduler* scheduler = KATZE_HTTP_SCHEDULER (feature);
+
+    scheduler->session = session;
+    g_signal_connect (session, "request-queued",
+        G_CALLBACK (katze_http_scheduler_session_request_queued_cb), feature);
+}
+
+static void
+katze_http_scheduler_detach (SoupSessionFeature* feature,
+                             SoupSession*        session)
+{
+    KatzeHttpScheduler* scheduler = KATZE_HTTP_SCHEDULER (feature);
+
+    g_signal_handlers_disconnect_by_func (session,
+        katze_http_scheduler_session_request_queued_cb, feature);
+
+    /* Let everything run, nobody is going to resume it later */
+    scheduler->max_background = 0;
+    scheduler->max_background_per_host = 0;
+    katze_http_scheduler_run_queue (scheduler);
+    scheduler->session = NULL;
+}
+
+static void
+katze_http_scheduler_session_feature_iface_init (SoupSessionFeatureInterface *iface,
+                                                 gpointer                     data)
+{
+    iface->attach = katze_http_scheduler_attach;
+    iface->detach = katze_http_scheduler_detach;
+}
+
+static void
+katze_http_scheduler_class_init (KatzeHttpSchedulerClass* class)
+{
+    GObjectClass* gobject_class;
+    GParamFlags flags;
+
+    gobject_class = G_OBJECT_CLASS (class);
+    gobject_class->finalize = katze_http_scheduler_finalize;
+    gobject_class->set_property = katze_http_scheduler_set_property;
+    gobject_class->get_property = katze_http_scheduler_get_property;
+
+    flags = G_PARAM_READWRITE | G_PARAM_CONSTRUCT;
+
+    /**
+     * KatzeHttpScheduler:max-background:
+     *
+     * The maximum number of requests of hidden owners
+     * running at the same time, 0 for no limit.
+     *
+     * Since: 0.3.0
+     */
+    g_object_class_install_property (gobject_class,
+                                     PROP_MAX_BACKGROUND,
+                                     g_param_spec_int (
+                                     "max-background",
+                                     "Maximum background requests",
+                                     "The maximum number of background requests at the same time",
+                                     0, G_MAXINT, 4,
+                                     flags));
+
+    /**
+     * KatzeHttpScheduler:max-background-per-host:
+     *
+     * The maximum number of requests of hidden owners
+     * running at the same time per host, 0 for no limit.
+     *
+     * Since: 0.3.0
+     */
+    g_object_class_install_property (gobject_class,
+                                     PROP_MAX_BACKGROUND_PER_HOST,
+                                     g_param_spec_int (
+                                     "max-background-per-host",
+                                     "Maximum background requests per host",
+                                     "The maximum number of background requests to one host",
+                                     0, G_MAXINT, 2,
+                                     flags));
+}
+
+static void
+katze_http_scheduler_init (KatzeHttpScheduler* scheduler)
+{
+    scheduler->session = NULL;
+    scheduler->visible = g_hash_table_new (g_direct_hash, g_direct_equal);
+    scheduler->hosts = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              g_free, NULL);
+    scheduler->running = 0;
+    scheduler->waiting = NULL;
+}
+
+static void
+katze_http_scheduler_finalize (GObject* object)
+{
+    KatzeHttpScheduler* scheduler = KATZE_HTTP_SCHEDULER (object);
+
+    g_hash_table_destroy (scheduler->visible);
+    g_hash_table_destroy (scheduler->hosts);
+    g_list_free (scheduler->waiting);
+
+    G_OBJECT_CLASS (katze_http_scheduler_parent_class)->finalize (object);
+}
+
+static void
+katze_http_scheduler_set_property (GObject*      object,
+                                   guint         prop_id,
+                                   const GValue* value,
+                                   GParamSpec*   pspec)
+{
+    KatzeHttpScheduler* scheduler = KATZE_HTTP_SCHEDULER (object);
+
+    switch (prop_id)
+    {
+    case PROP_MAX_BACKGROUND:
+        scheduler->max_background = g_value_get_int (value);
+        break;
+    case PROP_MAX_BACKGROUND_PER_HOST:
+        scheduler->max_background_per_host = g_value_get_int (value);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+        return;
+    }
+
+    /* Raised limits may let waiting requests through */
+    if (scheduler->session)
+        katze_http_scheduler_run_queue (scheduler);
+}
+
+static void
+katze_http_scheduler_get_property (GObject*    object,
+                                   guint       prop_id,
+                                   GValue*     value,
+                                   GParamSpec* pspec)
+{
+    KatzeHttpScheduler* scheduler = KATZE_HTTP_SCHEDULER (object);
+
+    switch (prop_id)
+    {
+    case PROP_MAX_BACKGROUND:
+        g_value_set_int (value, scheduler->max_background);
+        break;
+    case PROP_MAX_BACKGROUND_PER_HOST:
+        g_value_set_int (value, scheduler->max_background_per_host);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+        break;
+    }
+}
+
+/**
+ * katze_http_scheduler_set_message_owner:
+ * @msg: a #SoupMessage that wasn't queued yet
+ * @owner: the object, typically a view, that requested @msg
+ *
+ * Marks @msg as belonging to @owner, which decides
+ * about its priority. The owner is only used for
+ * comparison, it is never dereferenced.
+ *
+ * Since: 0.3.0
+ **/
+void
+katze_http_scheduler_set_message_owner (SoupMessage* msg,
+                                        gpointer     owner)
+{
+    g_return_if_fail (SOUP_IS_MESSAGE (msg));
+
+    g_object_set_data (G_OBJECT (msg), KATZE_HTTP_SCHEDULER_OWNER, owner);
+}
+
+/**
+ * katze_http_scheduler_set_owner_visible:
+ * @scheduler: a #KatzeHttpScheduler
+ * @owner: an owner of messages
+ * @visible: whether @owner is visible to the user
+ *
+ * Specifies whether messages of @owner are going to
+ * be sent right away. Messages waiting for their turn
+ * are resumed when @owner becomes visible.
+ *
+ * An owner that is going away must be made invisible.
+ *
+ * Since: 0.3.0
+ **/
+void
+katze_http_scheduler_set_owner_visible (KatzeHttpScheduler* scheduler,
+                                        gpointer            owner,
+                                        gboolean            visible)
+{
+    g_return_if_fail (KATZE_IS_HTTP_SCHEDULER (scheduler));
+    g_return_if_fail (owner != NULL);
+
+    if (visible)
+    {
+        g_hash_table_insert (scheduler->visible, owner, owner);
+        if (scheduler->session)
+            katze_http_scheduler_run_queue (scheduler);
+    }
+    else
+        g_hash_table_remove (scheduler->visible, owner);
+}
@@ -0,0 +1,51 @@
+/*
+ Copyright (C) 2010 Christian Dywan <christian@twotoasts.de>
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ See the file COPYING for the full license text.
+*/
+
+#ifndef __KATZE_HTTP_SCHEDULER_H__
+#define __KATZE_HTTP_SCHEDULER_H__
+
+#include "katze-utils.h"
+
+#include <libsoup/soup.h>
+
+G_BEGIN_DECLS
+
+#define KATZE_TYPE_HTTP_SCHEDULER \
+    (katze_http_scheduler_get_type ())
+#define KATZE_HTTP_SCHEDULER(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST ((obj), KATZE_TYPE_HTTP_SCHEDULER, KatzeHttpScheduler))
+#define KATZE_HTTP_SCHEDULER_CLASS(klass) \
+    (G_TYPE_CHECK_CLASS_CAST ((klass), KATZE_TYPE_HTTP_SCHEDULER, KatzeHttpSchedulerClass))
+#define KATZE_IS_HTTP_SCHEDULER(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE ((obj), KATZE_TYPE_HTTP_SCHEDULER))
+#define KATZE_IS_HTTP_SCHEDULER_CLASS(klass) \
+    (G_TYPE_CHECK_CLASS_TYPE ((klass), KATZE_TYPE_HTTP_SCHEDULER))
+#define KATZE_HTTP_SCHEDULER_GET_CLASS(obj) \
+    (G_TYPE_INSTANCE_GET_CLASS ((obj), KATZE_TYPE_HTTP_SCHEDULER, KatzeHttpSchedulerClass))
+
+typedef struct _KatzeHttpScheduler                KatzeHttpScheduler;
+typedef struct _KatzeHttpSchedulerClass           KatzeHttpSchedulerClass;
+
+GType
+katze_http_scheduler_get_type                  (void) G_GNUC_CONST;
+
+void
+katze_http_scheduler_set_message_owner         (SoupMessage*        msg,
+                                                gpointer            owner);
+
+void
+katze_http_scheduler_set_owner_visible         (KatzeHttpScheduler* scheduler,
+                                                gpointer            owner,
+                                                gboolean            visible);
+
+G_END_DECLS
+
+#endif /* __KATZE_HTTP_SCHEDULER_H__ */
@@ -19,16 +19,25 @@
 
 #include "katze-net.h"
 
+#include <time.h>
 #include <glib/gstdio.h>
 #include <libsoup/soup.h>
 #include <webkit/webkit.h>
 
+/* Small results are kept for a moment, so that many views asking
+   for the same icon or feed one after another share one transfer */
+#define KATZE_NET_RECENT_TTL 10
+#define KATZE_NET_RECENT_MAX_LENGTH (256 * 1024)
+
 struct _KatzeNet
 {
     GObject parent_instance;
 
     gchar* cache_path;
     guint cache_size;
+
+    GHashTable* loading;
+    GHashTable* recent;
 };
 
 struct _KatzeNetClass
@@ -50,11 +59,18 @@ katze_net_class_init (KatzeNetClass* class)
     gobject_class->finalize = katze_net_finalize;
 }
 
+static void
+katze_net_recent_free (gpointer recent);
+
 static void
 katze_net_init (KatzeNet* net)
 {
     net->cache_path = g_build_filename (g_get_user_cache_dir (),
                                         PACKAGE_NAME, NULL);
+    /* Transfers are owned by their message, the table only finds them */
+    net->loading = g_hash_table_new (g_str_hash, g_str_equal);
+    net->recent = g_hash_table_new_full (g_str_hash, g_str_equal,
+        NULL, katze_net_recent_free);
 }
 
 static void
@@ -63,6 +79,8 @@ katze_net_finalize (GObject* object)
     KatzeNet* net = KATZE_NET (object);
 
     katze_assign (net->cache_path, NULL);
+    g_hash_table_destroy (net->loading);
+    g_hash_table_destroy (net->recent);
 
     G_OBJECT_CLASS (katze_net_parent_class)->finalize (object);
 }
@@ -92,14 +110,56 @@ typedef struct
     KatzeNetRequest* request;
 } KatzeNetPriv;
 
+/* One transfer shared by all callers asking for the same URI */
+typedef struct
+{
+    KatzeNet* net;
+    KatzeNetRequest* request;
+    GSList* waiters;
+    gboolean done;
+} KatzeNetLoad;
+
+typedef struct
+{
+    KatzeNetRequest* request;
+    time_t expires;
+} KatzeNetRecent;
+
+static KatzeNetRequest*
+katze_net_request_new (const gchar* uri)
+{
+    KatzeNetRequest* request = g_slice_new (KatzeNetRequest);
+    request->uri = g_strdup (uri);
+    request->status = KATZE_NET_VERIFIED;
+    request->mime_type = NULL;
+    request->data = NULL;
+    request->length = 0;
+    return request;
+}
+
 static void
-katze_net_priv_free (KatzeNetPriv* priv)
+katze_net_request_free (KatzeNetRequest* request)
 {
-    KatzeNetRequest* request = priv->request;
     g_free (request->uri);
     g_free (request->mime_type);
     g_free (request->data);
     g_slice_free (KatzeNetRequest, request);
+}
+
+static void
+katze_net_recent_free (gpointer data)
+{
+    KatzeNetRecent* recent = data;
+
+    katze_net_request_free (recent->request);
+    g_slice_free (KatzeNetRecent, recent);
+}
+
+static void
+katze_net_priv_free (KatzeNetPriv* priv)
+{
+    if (priv->request)
+        katze_net_request_free (priv->request);
     g_slice_free (KatzeNetPriv, priv);
 }
 
@@ -135,56 +195,187 @@ katze_net_get_cached_path (KatzeNet*    net,
 }
 
 static void
-katze_net_got_body_cb (SoupMessage*  msg,
-                       KatzeNetPriv* priv);
+katze_net_load_free (KatzeNetLoad* load)
+{
+    GSList* waiters;
+
+    for (waiters = load->waiters; waiters; waiters = g_slist_next (waiters))
+        katze_net_priv_free (waiters->data);
+    g_slist_free (load->waiters);
+    if (load->request)
+        katze_net_request_free (load->request);
+    g_object_unref (load->net);
+    g_slice_free (KatzeNetLoad, load);
+}
 
 static void
-katze_net_got_headers_cb (SoupMessage*  msg,
-                          KatzeNetPriv* priv)
+katze_net_load_unregister (KatzeNetLoad* load)
 {
-    KatzeNetRequest* request = priv->request;
+    /* New callers start a new transfer, they can't get the headers anymore */
+    if (g_hash_table_lookup (load->net->loading, load->request->uri) == load)
+        g_hash_table_remove (load->net->loading, load->request->uri);
+}
 
-    switch (msg->status_code)
+static KatzeNetStatus
+katze_net_status_from_code (guint status_code)
+{
+    switch (status_code)
     {
     case 200:
-        request->status = KATZE_NET_VERIFIED;
-        break;
+        return KATZE_NET_VERIFIED;
     case 301:
-        request->status = KATZE_NET_MOVED;
-        break;
+    case 302:
+    case 303:
+    case 307:
+        return KATZE_NET_MOVED;
     default:
-        request->status = KATZE_NET_NOT_FOUND;
+        return KATZE_NET_NOT_FOUND;
+    }
+}
+
+static void
+katze_net_got_body_cb (SoupMessage*  msg,
+                       KatzeNetLoad* load);
+
+static void
+katze_net_got_headers_cb (SoupMessage*  msg,
+                          KatzeNetLoad* load)
+{
+    KatzeNetRequest* request = load->request;
+    GSList* waiters;
+
+    katze_net_load_unregister (load);
+
+    request->status = katze_net_status_from_code (msg->status_code);
+
+    waiters = load->waiters;
+    while (waiters)
+    {
+        KatzeNetPriv* priv = waiters->data;
+        GSList* next = g_slist_next (waiters);
+
+        if (priv->status_cb && !priv->status_cb (request, priv->user_data))
+        {
+            load->waiters = g_slist_delete_link (load->waiters, waiters);
+            katze_net_priv_free (priv);
+        }
+        waiters = next;
     }
 
-    if (!priv->status_cb (request, priv->user_data))
+    /* Only cancel if nobody is interested anymore */
+    if (!load->waiters)
     {
-        g_signal_handlers_disconnect_by_func (msg, katze_net_got_headers_cb, priv);
-        g_signal_handlers_disconnect_by_func (msg, katze_net_got_body_cb, priv);
+        g_signal_handlers_disconnect_by_func (msg, katze_net_got_headers_cb, load);
+        g_signal_handlers_disconnect_by_func (msg, katze_net_got_body_cb, load);
         soup_session_cancel_message (webkit_get_default_session (), msg, 1);
     }
 }
 
+static gboolean
+katze_net_recent_expire_cb (gchar* uri)
+{
+    KatzeNet* net = katze_net_new ();
+    KatzeNetRecent* recent = g_hash_table_lookup (net->recent, uri);
+
+    /* The entry may have been replaced by a newer one meanwhile */
+    if (recent && recent->expires <= time (NULL))
+        g_hash_table_remove (net->recent, uri);
+    g_object_unref (net);
+    g_free (uri);
+    return FALSE;
+}
+
+/* Responses that mustn't be reused aren't kept as recent results */
+static gboolean
+katze_net_message_is_cacheable (SoupMessage* msg)
+{
+    const gchar* cache_control;
+    const gchar* pragma;
+
+    cache_control = soup_message_headers_get_one (msg->response_headers,
+                                                  "Cache-Control");
+    if (cache_control && (soup_header_contains (cache_control, "no-store")
+                       || soup_header_contains (cache_control, "no-cache")))
+        return FALSE;
+    pragma = soup_message_headers_get_one (msg->response_headers, "Pragma");
+    if (pragma && soup_header_contains (pragma, "no-cache"))
+        return FALSE;
+    return TRUE;
+}
+
 static void
 katze_net_got_body_cb (SoupMessage*  msg,
-                       KatzeNetPriv* priv)
+                       KatzeNetLoad* load)
 {
-    KatzeNetRequest* request = priv->request;
+    KatzeNetRequest* request = load->request;
+    GSList* waiters;
+
+    /* A redirection is followed, the transfer isn't over yet */
+    if (!(request->status == KATZE_NET_MOVED
+       && soup_message_headers_get_one (msg->response_headers, "Location")))
+        load->done = TRUE;
 
     if (msg->response_body->length > 0)
     {
-        request->data = g_memdup (msg->response_body->data,
-                                  msg->response_body->length);
+        katze_assign (request->data, g_memdup (msg->response_body->data,
+                                               msg->response_body->length));
         request->length = msg->response_body->length;
     }
 
-    priv->transfer_cb (request, priv->user_data);
+    for (waiters = load->waiters; waiters; waiters = g_slist_next (waiters))
+    {
+        KatzeNetPriv* priv = waiters->data;
+        if (priv->transfer_cb)
+            priv->transfer_cb (request, priv->user_data);
+    }
+
+    if (request->status == KATZE_NET_VERIFIED && request->data
+     && request->length <= KATZE_NET_RECENT_MAX_LENGTH
+     && katze_net_message_is_cacheable (msg))
+    {
+        KatzeNetRecent* recent = g_slice_new (KatzeNetRecent);
+        recent->request = request;
+        recent->expires = time (NULL) + KATZE_NET_RECENT_TTL;
+        load->request = NULL;
+        g_hash_table_replace (load->net->recent, request->uri, recent);
+        g_timeout_add_seconds (KATZE_NET_RECENT_TTL + 1,
+            (GSourceFunc)katze_net_recent_expire_cb, g_strdup (request->uri));
+    }
 }
 
 static void
 katze_net_finished_cb (SoupMessage*  msg,
-                       KatzeNetPriv* priv)
+                       KatzeNetLoad* load)
 {
+    GSList* waiters;
+
+    if (load->request)
+        katze_net_load_unregister (load);
+
+    /* The connection failed before the whole body arrived */
+    if (!load->done)
+    {
+        load->request->status = KATZE_NET_FAILED;
+        for (waiters = load->waiters; waiters; waiters = g_slist_next (waiters))
+        {
+            KatzeNetPriv* priv = waiters->data;
+            if (priv->transfer_cb)
+                priv->transfer_cb (load->request, priv->user_data);
+        }
+    }
+    katze_net_load_free (load);
+}
+
+static gboolean
+katze_net_recent_cb (KatzeNetPriv* priv)
+{
+    KatzeNetRequest* request = priv->request;
+
+    if (!(priv->status_cb && !priv->status_cb (request, priv->user_data))
+     && priv->transfer_cb)
+        priv->transfer_cb (request, priv->user_data);
     katze_net_priv_free (priv);
+    return FALSE;
 }
 
 static gboolean
@@ -236,6 +427,287 @@ katze_net_default_cb (KatzeNetPriv* priv)
     return FALSE;
 }
 
+/* A transfer writing data to a file as it arrives instead of accumulating it */
+typedef struct
+{
+    KatzeNetPriv* priv;
+    gchar* filename;
+    gchar* temporary_filename;
+    FILE* fp;
+    gboolean done;
+} KatzeNetStream;
+
+static void
+katze_net_stream_free (KatzeNetStream* stream)
+{
+    /* An unfinished file is never moved into place */
+    if (stream->fp)
+    {
+        fclose (stream->fp);
+        g_unlink (stream->temporary_filename);
+    }
+    g_free (stream->temporary_filename);
+    g_free (stream->filename);
+    katze_net_priv_free (stream->priv);
+    g_slice_free (KatzeNetStream, stream);
+}
+
+/* The transfer is reported once, unless the caller cancelled it */
+static void
+katze_net_stream_done (KatzeNetStream* stream,
+                       KatzeNetStatus  status)
+{
+    KatzeNetPriv* priv = stream->priv;
+
+    if (stream->done)
+        return;
+    stream->done = TRUE;
+    priv->request->status = status;
+    if (priv->transfer_cb)
+        priv->transfer_cb (priv->request, priv->user_data);
+}
+
+static void
+katze_net_stream_got_chunk_cb (SoupMessage*    msg,
+                               SoupBuffer*     chunk,
+                               KatzeNetStream* stream);
+
+static void
+katze_net_stream_got_body_cb (SoupMessage*    msg,
+                              KatzeNetStream* stream);
+
+static void
+katze_net_stream_cancel (SoupMessage*    msg,
+                         KatzeNetStream* stream)
+{
+    g_signal_handlers_disconnect_by_func (msg,
+        katze_net_stream_got_chunk_cb, stream);
+    g_signal_handlers_disconnect_by_func (msg,
+        katze_net_stream_got_body_cb, stream);
+    soup_session_cancel_message (webkit_get_default_session (), msg, 1);
+}
+
+static void
+katze_net_stream_fail (SoupMessage*    msg,
+                       KatzeNetStream* stream)
+{
+    if (stream->fp)
+    {
+        fclose (stream->fp);
+        stream->fp = NULL;
+        g_unlink (stream->temporary_filename);
+    }
+    katze_net_stream_done (stream, KATZE_NET_FAILED);
+    katze_net_stream_cancel (msg, stream);
+}
+
+static void
+katze_net_stream_got_headers_cb (SoupMessage*    msg,
+                                 KatzeNetStream* stream)
+{
+    KatzeNetPriv* priv = stream->priv;
+    KatzeNetRequest* request = priv->request;
+
+    request->status = katze_net_status_from_code (msg->status_code);
+    request->length = 0;
+
+    if (priv->status_cb && !priv->status_cb (request, priv->user_data))
+    {
+        stream->done = TRUE;
+        katze_net_stream_cancel (msg, stream);
+        return;
+    }
+
+    /* Written next to the target so that the rename can't cross devices */
+    if (request->status == KATZE_NET_VERIFIED && stream->filename && !stream->fp)
+    {
+        gint fd;
+
+        stream->temporary_filename = g_strconcat (stream->filename,
+                                                  ".XXXXXX", NULL);
+        if ((fd = g_mkstemp (stream->temporary_filename)) == -1)
+            katze_net_stream_fail (msg, stream);
+        else if (!(stream->fp = fdopen (fd, "wb")))
+        {
+            close (fd);
+            g_unlink (stream->temporary_filename);
+            katze_net_stream_fail (msg, stream);
+        }
+    }
+}
+
+static void
+katze_net_stream_got_chunk_cb (SoupMessage*    msg,
+                               SoupBuffer*     chunk,
+                               KatzeNetStream* stream)
+{
+    KatzeNetPriv* priv = stream->priv;
+    KatzeNetRequest* request = priv->request;
+
+    /* The body of a redirection isn't the data that was asked for */
+    if (request->status != KATZE_NET_VERIFIED)
+        return;
+
+    request->length += chunk->length;
+    if (stream->fp && fwrite (chunk->data, 1, chunk->length,
+                              stream->fp) != chunk->length)
+        katze_net_stream_fail (msg, stream);
+}
+
+static void
+katze_net_stream_got_body_cb (SoupMessage*    msg,
+                              KatzeNetStream* stream)
+{
+    KatzeNetPriv* priv = stream->priv;
+    KatzeNetRequest* request = priv->request;
+
+    /* A redirection is followed, the transfer isn't over yet */
+    if (request->status == KATZE_NET_MOVED
+     && soup_message_headers_get_one (msg->response_headers, "Location"))
+        return;
+
+    if (request->status == KATZE_NET_VERIFIED && stream->fp)
+    {
+        gint result = fclose (stream->fp);
+        stream->fp = NULL;
+        #ifdef G_OS_WIN32
+        /* Renaming doesn't replace existing files on Windows */
+        if (result == 0)
+            g_unlink (stream->filename);
+        #endif
+        if (result != 0
+         || g_rename (stream->temporary_filename, stream->filename) == -1)
+        {
+            g_unlink (stream->temporary_filename);
+            request->status = KATZE_NET_FAILED;
+        }
+    }
+    katze_net_stream_done (stream, request->status == KATZE_NET_VERIFIED
+                                   ? KATZE_NET_DONE : request->status);
+}
+
+static void
+katze_net_stream_finished_cb (SoupMessage*    msg,
+                              KatzeNetStream* stream)
+{
+    /* The connection failed before the whole body arrived */
+    katze_net_stream_done (stream, KATZE_NET_FAILED);
+    katze_net_stream_free (stream);
+}
+
+static gboolean
+katze_net_stream_local_cb (KatzeNetStream* stream)
+{
+    KatzeNetPriv* priv = stream->priv;
+    KatzeNetRequest* request = priv->request;
+    gchar* filename = g_filename_from_uri (request->uri, NULL, NULL);
+
+    if (!filename || g_access (filename, F_OK) != 0)
+    {
+        request->status = KATZE_NET_NOT_FOUND;
+        if (!(priv->status_cb && !priv->status_cb (request, priv->user_data)))
+            katze_net_stream_done (stream, KATZE_NET_NOT_FOUND);
+    }
+    else if (!(priv->status_cb && !priv->status_cb (request, priv->user_data)))
+    {
+        gchar* contents = NULL;
+        gsize length;
+
+        /* Local files are copied in one piece */
+        if (!g_file_get_contents (filename, &contents, &length, NULL)
+         || !g_file_set_contents (stream->filename, contents, length, NULL))
+            katze_net_stream_done (stream, KATZE_NET_FAILED);
+        else
+        {
+            request->length = length;
+            katze_net_stream_done (stream, KATZE_NET_DONE);
+        }
+        g_free (contents);
+    }
+    g_free (filename);
+    katze_net_stream_free (stream);
+    return FALSE;
+}
+
+/**
+ * katze_net_load_uri_to_file:
+ * @net: a #KatzeNet, or %NULL
+ * @uri: an URI string
+ * @filename: the file to save to
+ * @status_cb: function to call for status information
+ * @transfer_cb: function to call upon transfer
+ * @user_data: data to pass to the callback
+ *
+ * Requests a transfer of @uri like katze_net_load_uri(),
+ * except that the data is written to @filename while
+ * it arrives instead of being kept in memory. The transfer
+ * is never shared with others or answered from recent results.
+ *
+ * @filename is only replaced once the transfer completed,
+ * which @transfer_cb reports with %KATZE_NET_DONE. A copy
+ * of @filename is kept, and redirections are followed
+ * without calling @transfer_cb for them.
+ *
+ * @transfer_cb is called exactly once, with %KATZE_NET_FAILED
+ * if the transfer failed, unless @status_cb cancelled it.
+ *
+ * Since: 0.3.0
+ **/
+void
+katze_net_load_uri_to_file (KatzeNet*          net,
+                            const gchar*       uri,
+                            const gchar*       filename,
+                            KatzeNetStatusCb   status_cb,
+                            KatzeNetTransferCb transfer_cb,
+                            gpointer           user_data)
+{
+    KatzeNetStream* stream;
+    SoupMessage* msg;
+
+    g_return_if_fail (uri != NULL);
+    g_return_if_fail (filename != NULL);
+
+    stream = g_slice_new (KatzeNetStream);
+    stream->priv = g_slice_new (KatzeNetPriv);
+    stream->priv->status_cb = status_cb;
+    stream->priv->transfer_cb = transfer_cb;
+    stream->priv->user_data = user_data;
+    stream->priv->request = katze_net_request_new (uri);
+    stream->filename = g_strdup (filename);
+    stream->temporary_filename = NULL;
+    stream->fp = NULL;
+    stream->done = FALSE;
+
+    if (g_str_has_prefix (uri, "http://") || g_str_has_prefix (uri, "https://"))
+    {
+        /* Streams never join other transfers, which keep the whole body */
+        msg = soup_message_new ("GET", uri);
+        soup_message_body_set_accumulate (msg->response_body, FALSE);
+        g_signal_connect (msg, "got-headers",
+            G_CALLBACK (katze_net_stream_got_headers_cb), stream);
+        g_signal_connect (msg, "got-chunk",
+            G_CALLBACK (katze_net_stream_got_chunk_cb), stream);
+        g_signal_connect (msg, "got-body",
+            G_CALLBACK (katze_net_stream_got_body_cb), stream);
+        g_signal_connect (msg, "finished",
+            G_CALLBACK (katze_net_stream_finished_cb), stream);
+        soup_session_queue_message (webkit_get_default_session (), msg, NULL, NULL);
+        return;
+    }
+
+    if (g_str_has_prefix (uri, "file://"))
+    {
+        g_idle_add ((GSourceFunc)katze_net_stream_local_cb, stream);
+        return;
+    }
+
+    /* Mirrors katze_net_default_cb, the stream owns the request */
+    stream->priv->request->status = KATZE_NET_NOT_FOUND;
+    if (!(status_cb && !status_cb (stream->priv->request, user_data)))
+        katze_net_stream_done (stream, KATZE_NET_NOT_FOUND);
+    katze_net_stream_free (stream);
+}
+
 /**
  * katze_net_load_uri:
  * @net: a #KatzeNet, or %NULL
@@ -252,9 +724,14 @@ katze_net_default_cb (KatzeNetPriv* priv)
  *
  * @transfer_cb will be called when the data @uri is
  * pointing to was transferred. Note that even a failed
- * transfer may transfer data.
+ * transfer may transfer data. If the connection fails,
+ * @transfer_cb is called with %KATZE_NET_FAILED.
  *
  * @status_cb will always to be called at least once.
+ *
+ * Concurrent requests of the same URI share one transfer,
+ * and small results are reused for a few seconds unless
+ * the server forbids caching them.
  **/
 void
 katze_net_load_uri (KatzeNet*          net,
@@ -263,8 +740,9 @@ katze_net_load_uri (KatzeNet*          net,
                     KatzeNetTransferCb transfer_cb,
                     gpointer           user_data)
 {
-    KatzeNetRequest* request;
     KatzeNetPriv* priv;
+    KatzeNetLoad* load;
+    KatzeNetRecent* recent;
     SoupMessage* msg;
 
     g_return_if_fail (uri != NULL);
@@ -272,35 +750,58 @@ katze_net_load_uri (KatzeNet*          net,
     if (!status_cb && !transfer_cb)
         return;
 
-    request = g_slice_new (KatzeNetRequest);
-    request->uri = g_strdup (uri);
-    request->mime_type = NULL;
-    request->data = NULL;
-
     priv = g_slice_new (KatzeNetPriv);
     priv->status_cb = status_cb;
     priv->transfer_cb = transfer_cb;
     priv->user_data = user_data;
-    priv->request = request;
+    priv->request = NULL;
 
     if (g_str_has_prefix (uri, "http://") || g_str_has_prefix (uri, "https://"))
     {
+        net = katze_net_new ();
+
+        recent = g_hash_table_lookup (net->recent, uri);
+        if (recent && recent->expires > time (NULL))
+        {
+            priv->request = katze_net_request_new (uri);
+            priv->request->data = g_memdup (recent->request->data,
+                                            recent->request->length);
+            priv->request->length = recent->request->length;
+            g_idle_add ((GSourceFunc)katze_net_recent_cb, priv);
+            g_object_unref (net);
+            return;
+        }
+
+        if ((load = g_hash_table_lookup (net->loading, uri)))
+        {
+            load->waiters = g_slist_append (load->waiters, priv);
+            g_object_unref (net);
+            return;
+        }
+
+        load = g_slice_new (KatzeNetLoad);
+        load->net = net;
+        load->request = katze_net_request_new (uri);
+        load->waiters = g_slist_prepend (NULL, priv);
+        load->done = FALSE;
+        g_hash_table_insert (net->loading, load->request->uri, load);
+
+        /* Later waiters may need either signal */
         msg = soup_message_new ("GET", uri);
-        if (status_cb)
-            g_signal_connect (msg, "got-headers",
-                G_CALLBACK (katze_net_got_headers_cb), priv);
-        if (transfer_cb)
-            g_signal_connect (msg, "got-body",
-                G_CALLBACK (katze_net_got_body_cb), priv);
+        g_signal_connect (msg, "got-headers",
+            G_CALLBACK (katze_net_got_headers_cb), load);
+        g_signal_connect (msg, "got-body",
+            G_CALLBACK (katze_net_got_body_cb), load);
         g_signal_connect (msg, "finished",
-            G_CALLBACK (katze_net_finished_cb), priv);
+            G_CALLBACK (katze_net_finished_cb), load);
         soup_session_queue_message (webkit_get_default_session (), msg, NULL, NULL);
         return;
     }
 
+    priv->request = katze_net_request_new (uri);
+
     if (g_str_has_prefix (uri, "file://"))
         g_idle_add ((GSourceFunc)katze_net_local_cb, priv);
     else
         g_idle_add ((GSourceFunc)katze_net_default_cb, priv);
 }
-
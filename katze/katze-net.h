@@ -68,6 +68,14 @@ katze_net_load_uri                       (KatzeNet*          net,
                                           KatzeNetTransferCb transfer_cb,
                                           gpointer           user_data);
 
+void
+katze_net_load_uri_to_file               (KatzeNet*          net,
+                                          const gchar*       uri,
+                                          const gchar*       filename,
+                                          KatzeNetStatusCb   status_cb,
+                                          KatzeNetTransferCb transfer_cb,
+                                          gpointer           user_data);
+
 gchar*
 katze_net_get_cached_path                (KatzeNet*          net,
                                           const gchar*       uri,
@@ -17,6 +17,7 @@
 #include <gio/gio.h>
 
 #include <string.h>
+#include <sqlite3.h>
 
 #if HAVE_CONFIG_H
     #include "config.h"
@@ -1497,6 +1498,440 @@ katze_widget_has_touchscreen_mode (GtkWidget* widget)
     }
 }
 
+/* Icons by scheme and host, shared by all views and widgets. An
+   entry without an icon remembers that nothing is stored for the
+   host, or with an icon URI, that loading that icon failed. */
+typedef struct
+{
+    gchar* icon_uri;
+    GdkPixbuf* icon;
+} KatzeCachedIcon;
+
+static GHashTable* katze_icon_cache = NULL;
+
+/* All icons are stored as 16 pixel PNG data in one database, rather
+   than one file per icon, along with the icon used by each host.
+   The main thread and the icon worker each have a connection. */
+typedef struct
+{
+    sqlite3* db;
+    gboolean failed;
+    sqlite3_stmt* select_host;
+    sqlite3_stmt* select_icon;
+    sqlite3_stmt* insert_icon;
+    sqlite3_stmt* insert_host;
+} KatzeIconStore;
+
+static KatzeIconStore katze_icon_worker_store;
+
+static GThreadPool* katze_icon_pool = NULL;
+
+static void
+katze_cached_icon_free (KatzeCachedIcon* cached)
+{
+    g_free (cached->icon_uri);
+    if (cached->icon)
+        g_object_unref (cached->icon);
+    g_slice_free (KatzeCachedIcon, cached);
+}
+
+static gchar*
+katze_icon_cache_key (const gchar* uri)
+{
+    guint i;
+
+    if (!(g_str_has_prefix (uri, "http://") || g_str_has_prefix (uri, "https://")))
+        return NULL;
+
+    i = 8;
+    while (uri[i] != '\0' && uri[i] != '/')
+        i++;
+    return g_strndup (uri, i);
+}
+
+static GdkPixbuf*
+katze_icon_scale (GdkPixbuf* icon,
+                  gint       width,
+                  gint       height)
+{
+    if (gdk_pixbuf_get_width (icon) == width
+     && gdk_pixbuf_get_height (icon) == height)
+        return g_object_ref (icon);
+    return gdk_pixbuf_scale_simple (icon, width, height, GDK_INTERP_BILINEAR);
+}
+
+static sqlite3*
+katze_icon_store_open (KatzeIconStore* store)
+{
+    gchar* path;
+    gchar* filename;
+
+    if (store->db || store->failed)
+        return store->db;
+
+    path = g_build_filename (g_get_user_cache_dir (), PACKAGE_NAME, NULL);
+    katze_mkdir_with_parents (path, 0700);
+    filename = g_build_filename (path, "icons.db", NULL);
+    g_free (path);
+    /* Icons can always be downloaded again, so don't wait for the disk */
+    if (sqlite3_open (filename, &store->db) != SQLITE_OK
+     || sqlite3_exec (store->db,
+        "PRAGMA synchronous = OFF;"
+        "PRAGMA journal_mode = WAL;"
+        "CREATE TABLE IF NOT EXISTS "
+        "icons (uri text PRIMARY KEY, data blob NOT NULL);"
+        "CREATE TABLE IF NOT EXISTS "
+        "hosts (host text PRIMARY KEY, icon text NOT NULL);",
+        NULL, NULL, NULL) != SQLITE_OK)
+    {
+        g_warning ("Failed to open icon database %s: %s",
+                   filename, sqlite3_errmsg (store->db));
+        sqlite3_close (store->db);
+        store->db = NULL;
+        store->failed = TRUE;
+    }
+    else
+        sqlite3_busy_timeout (store->db, 1000);
+    g_free (filename);
+    return store->db;
+}
+
+static sqlite3_stmt*
+katze_icon_store_prepare (KatzeIconStore* store,
+                          sqlite3_stmt**  stmt,
+                          const gchar*    sqlcmd)
+{
+    if (!*stmt && katze_icon_store_open (store))
+        sqlite3_prepare_v2 (store->db, sqlcmd, -1, stmt, NULL);
+    return *stmt;
+}
+
+static GdkPixbuf*
+katze_icon_store_select (sqlite3_stmt* stmt,
+                         const gchar*  key,
+                         gchar**       icon_uri)
+{
+    GdkPixbuf* icon = NULL;
+
+    if (!stmt)
+        return NULL;
+
+    sqlite3_bind_text (stmt, 1, key, -1, SQLITE_STATIC);
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+    {
+        const guchar* data = sqlite3_column_blob (stmt, 1);
+        gint length = sqlite3_column_bytes (stmt, 1);
+        if (data && length > 0
+         && (icon = katze_pixbuf_new_from_buffer (data, length, "image/png", NULL))
+         && icon_uri)
+            *icon_uri = g_strdup ((const gchar*)sqlite3_column_text (stmt, 0));
+    }
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    return icon;
+}
+
+static GdkPixbuf*
+katze_icon_store_select_host (KatzeIconStore* store,
+                              const gchar*    key,
+                              gchar**         icon_uri)
+{
+    return katze_icon_store_select (katze_icon_store_prepare (store,
+        &store->select_host,
+        "SELECT uri, data FROM hosts JOIN icons ON icons.uri = hosts.icon "
+        "WHERE host = ?1"), key, icon_uri);
+}
+
+static GdkPixbuf*
+katze_icon_store_select_icon (KatzeIconStore* store,
+                              const gchar*    icon_uri)
+{
+    return katze_icon_store_select (katze_icon_store_prepare (store,
+        &store->select_icon,
+        "SELECT uri, data FROM icons WHERE uri = ?1"), icon_uri, NULL);
+}
+
+static void
+katze_icon_store_insert (KatzeIconStore* store,
+                         const gchar*    key,
+                         const gchar*    icon_uri,
+                         GdkPixbuf*      icon)
+{
+    sqlite3_stmt* insert_icon;
+    sqlite3_stmt* insert_host;
+    gchar* buffer;
+    gsize length;
+
+    if (!(insert_icon = katze_icon_store_prepare (store, &store->insert_icon,
+        "INSERT OR REPLACE INTO icons (uri, data) VALUES (?1, ?2)")))
+        return;
+    if (!(insert_host = katze_icon_store_prepare (store, &store->insert_host,
+        "INSERT OR REPLACE INTO hosts (host, icon) VALUES (?1, ?2)")))
+        return;
+
+    /* Without an icon, only the host is mapped to a stored icon */
+    if (icon)
+    {
+        gint result;
+
+        if (!gdk_pixbuf_save_to_buffer (icon, &buffer, &length, "png", NULL, NULL))
+            return;
+        sqlite3_bind_text (insert_icon, 1, icon_uri, -1, SQLITE_STATIC);
+        sqlite3_bind_blob (insert_icon, 2, buffer, length, g_free);
+        result = sqlite3_step (insert_icon);
+        sqlite3_reset (insert_icon);
+        sqlite3_clear_bindings (insert_icon);
+        if (result != SQLITE_DONE)
+            return;
+    }
+
+    sqlite3_bind_text (insert_host, 1, key, -1, SQLITE_STATIC);
+    sqlite3_bind_text (insert_host, 2, icon_uri, -1, SQLITE_STATIC);
+    sqlite3_step (insert_host);
+    sqlite3_reset (insert_host);
+    sqlite3_clear_bindings (insert_host);
+}
+
+/* Icons used to be stored as files named by the checksum of the icon
+   URI, which can't be listed by URI. Each file is moved into the
+   database when its icon is first looked up. */
+static GdkPixbuf*
+katze_icon_migrate_file (const gchar* icon_uri)
+{
+    gchar* checksum;
+    gchar* ext;
+    gchar* filename;
+    gchar* path;
+    GdkPixbuf* icon;
+
+    checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, icon_uri, -1);
+    ext = g_strrstr (icon_uri, ".");
+    filename = g_strdup_printf ("%s%s", checksum, ext ? ext : "");
+    g_free (checksum);
+    path = g_build_filename (g_get_user_cache_dir (), PACKAGE_NAME,
+                             "icons", filename, NULL);
+    g_free (filename);
+    if ((icon = gdk_pixbuf_new_from_file (path, NULL)))
+        g_unlink (path);
+    g_free (path);
+    return icon;
+}
+
+static KatzeCachedIcon*
+katze_icon_cache_insert (gchar*       key,
+                         const gchar* icon_uri,
+                         GdkPixbuf*   icon)
+{
+    KatzeCachedIcon* cached;
+
+    /* A missing icon doesn't replace an icon the host has */
+    if (!icon && katze_icon_cache
+     && (cached = g_hash_table_lookup (katze_icon_cache, key))
+     && cached->icon)
+    {
+        g_free (key);
+        return cached;
+    }
+
+    cached = g_slice_new (KatzeCachedIcon);
+    cached->icon_uri = g_strdup (icon_uri);
+    /* Scaled once so that every user can draw it as is */
+    cached->icon = icon ? katze_icon_scale (icon, 16, 16) : NULL;
+
+    if (!katze_icon_cache)
+        katze_icon_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+            g_free, (GDestroyNotify)katze_cached_icon_free);
+    g_hash_table_replace (katze_icon_cache, key, cached);
+    return cached;
+}
+
+typedef struct
+{
+    gchar* key;
+    gchar* icon_uri;
+    gchar* data;
+    gsize length;
+    gint width;
+    gint height;
+    KatzeIconCb callback;
+    gpointer user_data;
+    GdkPixbuf* icon;
+    GdkPixbuf* scaled;
+    gboolean by_host;
+    gboolean store;
+    gboolean clear;
+    guint generation;
+} KatzeIconJob;
+
+/* Hosts looked up for katze_load_cached_icon(), with the widgets
+   to update once the lookup is done */
+static GHashTable* katze_icon_pending = NULL;
+/* Lookups started before the icons were cleared are discarded */
+static guint katze_icon_generation = 0;
+
+static void
+katze_icon_job_free (KatzeIconJob* job)
+{
+    g_free (job->key);
+    g_free (job->icon_uri);
+    g_free (job->data);
+    if (job->icon)
+        g_object_unref (job->icon);
+    if (job->scaled)
+        g_object_unref (job->scaled);
+    g_slice_free (KatzeIconJob, job);
+}
+
+static void
+katze_icon_update_widget (GtkWidget* widget,
+                          GdkPixbuf* icon)
+{
+    if (GTK_IS_IMAGE (widget))
+    {
+        gint width, height;
+        GdkPixbuf* scaled;
+
+        gtk_icon_size_lookup_for_settings (gtk_widget_get_settings (widget),
+            GTK_ICON_SIZE_MENU, &width, &height);
+        scaled = katze_icon_scale (icon, width, height);
+        gtk_image_set_from_pixbuf (GTK_IMAGE (widget), scaled);
+        g_object_unref (scaled);
+    }
+    else
+        gtk_widget_queue_draw (widget);
+}
+
+static gboolean
+katze_icon_job_done_cb (gpointer data)
+{
+    KatzeIconJob* job = data;
+
+    if (job->by_host && katze_icon_pending)
+    {
+        GSList* widgets = g_hash_table_lookup (katze_icon_pending, job->key);
+        GSList* item;
+
+        g_hash_table_remove (katze_icon_pending, job->key);
+        /* Icons that were cleared meanwhile aren't shown anymore */
+        if (job->generation != katze_icon_generation && job->icon)
+        {
+            g_object_unref (job->icon);
+            job->icon = NULL;
+        }
+        else if (job->generation == katze_icon_generation)
+            /* Without an icon, nothing is stored for the host */
+            katze_icon_cache_insert (g_strdup (job->key),
+                                     job->icon ? job->icon_uri : NULL, job->icon);
+        for (item = widgets; item; item = g_slist_next (item))
+        {
+            if (job->icon)
+                katze_icon_update_widget (item->data, job->icon);
+            g_object_unref (item->data);
+        }
+        g_slist_free (widgets);
+    }
+    else if (job->key && job->generation == katze_icon_generation)
+    {
+        if (job->icon)
+            katze_icon_cache_insert (g_strdup (job->key), job->icon_uri, job->icon);
+        /* Downloaded data that isn't an image won't be tried again */
+        else if (job->data)
+            katze_icon_cache_insert (g_strdup (job->key), job->icon_uri, NULL);
+    }
+
+    if (job->callback)
+    {
+        job->callback (job->scaled, job->user_data);
+        job->scaled = NULL;
+    }
+    katze_icon_job_free (job);
+    return FALSE;
+}
+
+/* Runs in a worker thread, which only touches its own connection */
+static void
+katze_icon_job_run (KatzeIconJob* job,
+                    gpointer      user_data)
+{
+    KatzeIconStore* store = &katze_icon_worker_store;
+    GdkPixbuf* icon = NULL;
+
+    if (job->clear)
+    {
+        if (katze_icon_store_open (store))
+            sqlite3_exec (store->db,
+                "DELETE FROM icons; DELETE FROM hosts; VACUUM;", NULL, NULL, NULL);
+        katze_icon_job_free (job);
+        return;
+    }
+    else if (job->store)
+    {
+        katze_icon_store_insert (store, job->key, job->icon_uri, job->icon);
+        katze_icon_job_free (job);
+        return;
+    }
+    else if (job->by_host)
+    {
+        if ((icon = katze_icon_store_select_host (store, job->key, &job->icon_uri)))
+            job->icon = g_object_ref (icon);
+        else
+        {
+            g_free (job->icon_uri);
+            job->icon_uri = g_strdup_printf ("%s/favicon.ico", job->key);
+            if ((icon = katze_icon_migrate_file (job->icon_uri)))
+            {
+                job->icon = katze_icon_scale (icon, 16, 16);
+                katze_icon_store_insert (store, job->key, job->icon_uri, job->icon);
+            }
+        }
+    }
+    else if (job->data)
+    {
+        /* Servers often send a wrong type for icons, so it is guessed */
+        if ((icon = katze_pixbuf_new_from_buffer ((guchar*)job->data,
+                                                  job->length, NULL, NULL))
+         && job->key)
+        {
+            job->icon = katze_icon_scale (icon, 16, 16);
+            katze_icon_store_insert (store, job->key, job->icon_uri, job->icon);
+        }
+    }
+    else if ((icon = katze_icon_store_select_icon (store, job->icon_uri)))
+    {
+        job->icon = g_object_ref (icon);
+        katze_icon_store_insert (store, job->key, job->icon_uri, NULL);
+    }
+    else if ((icon = katze_icon_migrate_file (job->icon_uri)))
+    {
+        job->icon = katze_icon_scale (icon, 16, 16);
+        katze_icon_store_insert (store, job->key, job->icon_uri, job->icon);
+    }
+
+    if (icon)
+    {
+        if (job->callback)
+            job->scaled = katze_icon_scale (icon, job->width, job->height);
+        g_object_unref (icon);
+    }
+    g_idle_add (katze_icon_job_done_cb, job);
+}
+
+static void
+katze_icon_job_push (KatzeIconJob* job)
+{
+    job->generation = katze_icon_generation;
+
+    /* One thread suffices for icons, and the connection isn't shared.
+       Jobs run in the order they are queued. */
+    if (!katze_icon_pool)
+        katze_icon_pool = g_thread_pool_new ((GFunc)katze_icon_job_run,
+                                             NULL, 1, FALSE, NULL);
+    if (katze_icon_pool)
+        g_thread_pool_push (katze_icon_pool, job, NULL);
+    else
+        katze_icon_job_run (job, NULL);
+}
+
 /**
  * katze_load_cached_icon:
  * @uri: an URI string
@@ -1505,6 +1940,12 @@ katze_widget_has_touchscreen_mode (GtkWidget* widget)
  * Loads a cached icon for the specified @uri. If there is no
  * icon and @widget is specified, a default will be returned.
  *
+ * Icons are kept in memory per host. An icon that isn't in memory
+ * yet is read from the icon database in a worker thread, and %NULL
+ * or the default is returned meanwhile. Once the icon is loaded,
+ * @widget is updated: a #GtkImage shows the icon, any other widget
+ * is redrawn so that it can look up the icon again.
+ *
  * Returns: a #GdkPixbuf, or %NULL
  *
  * Since: 0.2.2
@@ -1514,48 +1955,210 @@ katze_load_cached_icon (const gchar* uri,
                         GtkWidget*   widget)
 {
     GdkPixbuf* icon = NULL;
+    gchar* key;
 
     g_return_val_if_fail (uri != NULL, NULL);
 
-    if (g_str_has_prefix (uri, "http://") || g_str_has_prefix (uri,"https://"))
+    if ((key = katze_icon_cache_key (uri)))
     {
-        guint i;
-        gchar* icon_uri;
-        gchar* checksum;
-        gchar* ext;
-        gchar* filename;
-        gchar* path;
-
-        i = 8;
-        while (uri[i] != '\0' && uri[i] != '/')
-            i++;
-        if (uri[i] == '/')
+        KatzeCachedIcon* cached = katze_icon_cache
+            ? g_hash_table_lookup (katze_icon_cache, key) : NULL;
+        GSList* widgets;
+
+        if (cached)
+            icon = cached->icon ? g_object_ref (cached->icon) : NULL;
+        else if (katze_icon_pending && g_hash_table_lookup_extended (
+            katze_icon_pending, key, NULL, (gpointer*)&widgets))
         {
-            gchar* ticon_uri = g_strdup (uri);
-            ticon_uri[i] = '\0';
-            icon_uri = g_strdup_printf ("%s/favicon.ico", ticon_uri);
-            g_free (ticon_uri);
+            if (widget && !g_slist_find (widgets, widget))
+                g_hash_table_insert (katze_icon_pending, g_strdup (key),
+                    g_slist_prepend (widgets, g_object_ref (widget)));
         }
         else
-            icon_uri = g_strdup_printf ("%s/favicon.ico", uri);
-
-        checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, icon_uri, -1);
-        ext = g_strrstr (icon_uri, ".");
-        filename = g_strdup_printf ("%s%s", checksum, ext ? ext : "");
-        g_free (icon_uri);
-        g_free (checksum);
-        path = g_build_filename (g_get_user_cache_dir (), PACKAGE_NAME,
-                                 "icons", filename, NULL);
-        g_free (filename);
-        if ((icon = gdk_pixbuf_new_from_file_at_size (path, 16, 16, NULL)))
         {
-            g_free (path);
-            return icon;
+            KatzeIconJob* job = g_slice_new0 (KatzeIconJob);
+
+            if (!katze_icon_pending)
+                katze_icon_pending = g_hash_table_new_full (g_str_hash,
+                    g_str_equal, g_free, NULL);
+            g_hash_table_insert (katze_icon_pending, g_strdup (key),
+                widget ? g_slist_prepend (NULL, g_object_ref (widget)) : NULL);
+            job->key = g_strdup (key);
+            job->by_host = TRUE;
+            katze_icon_job_push (job);
         }
-        g_free (path);
+        g_free (key);
     }
 
     return icon || !widget ? icon : gtk_widget_render_icon (widget,
         GTK_STOCK_FILE, GTK_ICON_SIZE_MENU, NULL);
 }
 
+/**
+ * katze_get_cached_icon:
+ * @uri: an URI string
+ * @icon_uri: the URI of the icon
+ * @missing: return location for whether the icon is known to be missing
+ *
+ * Looks up the icon loaded from @icon_uri for the host of @uri
+ * in memory, without reading from the icon database.
+ *
+ * If %NULL is returned and @missing is set to %TRUE, loading
+ * @icon_uri failed before and there is no point in trying again.
+ *
+ * Returns: a #GdkPixbuf, or %NULL
+ *
+ * Since: 0.3.0
+ */
+GdkPixbuf*
+katze_get_cached_icon (const gchar* uri,
+                       const gchar* icon_uri,
+                       gboolean*    missing)
+{
+    KatzeCachedIcon* cached;
+    gchar* key;
+
+    g_return_val_if_fail (uri != NULL, NULL);
+    g_return_val_if_fail (icon_uri != NULL, NULL);
+
+    if (missing)
+        *missing = FALSE;
+    if (!katze_icon_cache || !(key = katze_icon_cache_key (uri)))
+        return NULL;
+    cached = g_hash_table_lookup (katze_icon_cache, key);
+    g_free (key);
+    if (!cached || g_strcmp0 (cached->icon_uri, icon_uri))
+        return NULL;
+    if (cached->icon)
+        return g_object_ref (cached->icon);
+    if (missing)
+        *missing = TRUE;
+    return NULL;
+}
+
+/**
+ * katze_cache_icon:
+ * @uri: an URI string
+ * @icon_uri: the URI of the icon
+ * @icon: a #GdkPixbuf, or %NULL
+ *
+ * Remembers @icon as the icon for the host of @uri, in place
+ * of any icon that was previously loaded for the host, and
+ * stores it in the icon database in a worker thread.
+ *
+ * If @icon is %NULL, @icon_uri is remembered as missing until
+ * the browser quits, see katze_get_cached_icon().
+ *
+ * Since: 0.3.0
+ */
+void
+katze_cache_icon (const gchar* uri,
+                  const gchar* icon_uri,
+                  GdkPixbuf*   icon)
+{
+    KatzeCachedIcon* cached;
+    gchar* key;
+
+    g_return_if_fail (uri != NULL);
+    g_return_if_fail (icon_uri != NULL);
+    g_return_if_fail (!icon || GDK_IS_PIXBUF (icon));
+
+    if ((key = katze_icon_cache_key (uri)))
+    {
+        KatzeIconJob* job;
+
+        cached = katze_icon_cache_insert (g_strdup (key), icon_uri, icon);
+        /* Missing icons are only remembered in memory */
+        if (!icon)
+        {
+            g_free (key);
+            return;
+        }
+        job = g_slice_new0 (KatzeIconJob);
+        job->key = key;
+        job->icon_uri = g_strdup (icon_uri);
+        job->icon = g_object_ref (cached->icon);
+        job->store = TRUE;
+        katze_icon_job_push (job);
+    }
+}
+
+/**
+ * katze_load_icon_async:
+ * @uri: an URI string
+ * @icon_uri: the URI of the icon
+ * @data: downloaded icon data, or %NULL
+ * @length: the length of @data
+ * @width: the width of the resulting icon
+ * @height: the height of the resulting icon
+ * @callback: a function to call with the icon
+ * @user_data: data to pass to @callback
+ *
+ * Decodes @data, or loads the icon from @icon_uri from the icon
+ * database if @data is %NULL, and scales it in a worker thread.
+ * The icon is remembered for the host of @uri if it is http.
+ *
+ * The @callback is called in the main thread with a new reference
+ * to the icon, or %NULL if there is no icon.
+ *
+ * Since: 0.3.0
+ */
+void
+katze_load_icon_async (const gchar* uri,
+                       const gchar* icon_uri,
+                       const gchar* data,
+                       gsize        length,
+                       gint         width,
+                       gint         height,
+                       KatzeIconCb  callback,
+                       gpointer     user_data)
+{
+    KatzeIconJob* job;
+    gchar* key;
+
+    g_return_if_fail (uri != NULL);
+    g_return_if_fail (icon_uri != NULL);
+    g_return_if_fail (callback != NULL);
+
+    /* Icons of pages other than http are decoded but not stored */
+    key = katze_icon_cache_key (uri);
+    if ((!key && !data) || (data && !length))
+    {
+        g_free (key);
+        callback (NULL, user_data);
+        return;
+    }
+
+    job = g_slice_new0 (KatzeIconJob);
+    job->key = key;
+    job->icon_uri = g_strdup (icon_uri);
+    job->data = data ? g_memdup (data, length) : NULL;
+    job->length = length;
+    job->width = width;
+    job->height = height;
+    job->callback = callback;
+    job->user_data = user_data;
+    katze_icon_job_push (job);
+}
+
+/**
+ * katze_clear_cached_icons:
+ *
+ * Forgets all icons in memory right away, and in the icon
+ * database in a worker thread.
+ *
+ * Since: 0.3.0
+ */
+void
+katze_clear_cached_icons (void)
+{
+    KatzeIconJob* job;
+
+    if (katze_icon_cache)
+        g_hash_table_remove_all (katze_icon_cache);
+    katze_icon_generation++;
+
+    job = g_slice_new0 (KatzeIconJob);
+    job->clear = TRUE;
+    katze_icon_job_push (job);
+}
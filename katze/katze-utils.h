@@ -139,6 +139,32 @@ GdkPixbuf*
 katze_load_cached_icon               (const gchar*    uri,
                                       GtkWidget*      widget);
 
+GdkPixbuf*
+katze_get_cached_icon                (const gchar*    uri,
+                                      const gchar*    icon_uri,
+                                      gboolean*       missing);
+
+void
+katze_cache_icon                     (const gchar*    uri,
+                                      const gchar*    icon_uri,
+                                      GdkPixbuf*      icon);
+
+typedef void (*KatzeIconCb)          (GdkPixbuf*      icon,
+                                      gpointer        user_data);
+
+void
+katze_load_icon_async                (const gchar*    uri,
+                                      const gchar*    icon_uri,
+                                      const gchar*    data,
+                                      gsize           length,
+                                      gint            width,
+                                      gint            height,
+                                      KatzeIconCb     callback,
+                                      gpointer        user_data);
+
+void
+katze_clear_cached_icons             (void);
+
 G_END_DECLS
 
 #endif /* __KATZE_UTILS_H__ */
@@ -17,9 +17,13 @@
 #include "midori.h"
 #include "midori-array.h"
 #include "midori-bookmarks.h"
+#include "midori-completionindex.h"
+#include "midori-historywriter.h"
 #include "midori-extensions.h"
 #include "midori-history.h"
+#include "midori-speeddial.h"
 #include "midori-transfers.h"
+#include "midori-uriblocker.h"
 
 #include "sokoke.h"
 
@@ -396,54 +400,40 @@ search_engines_save_to_file (KatzeArray*  search_engines,
 }
 
 static void
-midori_history_clear_cb (KatzeArray* array,
-                         sqlite3*    db)
+midori_history_clear_cb (KatzeArray*          array,
+                         MidoriHistoryWriter* writer)
 {
-    char* errmsg = NULL;
-    if (sqlite3_exec (db, "DELETE FROM history; DELETE FROM search",
-                      NULL, NULL, &errmsg) != SQLITE_OK)
-    {
-        g_printerr (_("Failed to clear history: %s\n"), errmsg);
-        sqlite3_free (errmsg);
-    }
+    MidoriCompletionIndex* completion = g_object_get_data (G_OBJECT (array),
+                                                           "completion");
+
+    /* Queued behind pending visits so that none of them survive,
+       the history is gone from the disk once private data is cleared */
+    midori_history_writer_exec (writer,
+        "DELETE FROM urls; DELETE FROM visits; DELETE FROM search");
+    midori_history_writer_flush (writer);
+    midori_completion_index_clear (completion);
 }
 
 static gboolean
-midori_history_initialize (KatzeArray*  array,
-                           const gchar* filename,
-                           const gchar* bookmarks_filename,
-                           char**       errmsg)
+midori_history_migrate (sqlite3* db,
+                        char**   errmsg)
 {
-    sqlite3* db;
+    gboolean has_history;
     gboolean has_day;
     sqlite3_stmt* stmt;
     gint result;
-    gchar* sql;
 
-    has_day = FALSE;
+    has_history = has_day = FALSE;
 
-    if (sqlite3_open (filename, &db) != SQLITE_OK)
-    {
-        if (errmsg)
-            *errmsg = g_strdup_printf (_("Failed to open database: %s\n"),
-                                       sqlite3_errmsg (db));
-        sqlite3_close (db);
-        return FALSE;
-    }
+    sqlite3_prepare_v2 (db, "SELECT name FROM sqlite_master "
+                        "WHERE type = 'table' AND name = 'history'",
+                        -1, &stmt, NULL);
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+        has_history = TRUE;
+    sqlite3_finalize (stmt);
 
-    sqlite3_exec (db, "PRAGMA journal_mode = TRUNCATE;", NULL, NULL, errmsg);
-    if (*errmsg)
-    {
-        g_warning ("Failed to set journal mode: %s", *errmsg);
-        sqlite3_free (*errmsg);
-    }
-    if (sqlite3_exec (db,
-                      "CREATE TABLE IF NOT EXISTS "
-                      "history (uri text, title text, date integer, day integer);"
-                      "CREATE TABLE IF NOT EXISTS "
-                      "search (keywords text, uri text, day integer);",
-                      NULL, NULL, errmsg) != SQLITE_OK)
-        return FALSE;
+    if (!has_history)
+        return TRUE;
 
     sqlite3_prepare_v2 (db, "SELECT day FROM history LIMIT 1", -1, &stmt, NULL);
     result = sqlite3_step (stmt);
@@ -451,8 +441,7 @@ midori_history_initialize (KatzeArray*  array,
         has_day = TRUE;
     sqlite3_finalize (stmt);
 
-    if (!has_day)
-        sqlite3_exec (db,
+    if (!has_day && sqlite3_exec (db,
                       "BEGIN TRANSACTION;"
                       "CREATE TEMPORARY TABLE backup (uri text, title text, date integer);"
                       "INSERT INTO backup SELECT uri,title,date FROM history;"
@@ -464,38 +453,216 @@ midori_history_initialize (KatzeArray*  array,
                       "FROM backup;"
                       "DROP TABLE backup;"
                       "COMMIT;",
-                      NULL, NULL, errmsg);
+                      NULL, NULL, errmsg) != SQLITE_OK)
+    {
+        sqlite3_exec (db, "ROLLBACK", NULL, NULL, NULL);
+        return FALSE;
+    }
+
+    /* The last title of a page wins, the visit count is
+       accumulated by the trigger on the visits table */
+    if (sqlite3_exec (db,
+                      "BEGIN TRANSACTION;"
+                      "INSERT OR IGNORE INTO urls (uri, title) "
+                      "SELECT uri, title FROM history "
+                      "WHERE uri IS NOT NULL ORDER BY date DESC;"
+                      "INSERT INTO visits (url, date, day) "
+                      "SELECT urls.id, history.date, history.day FROM history "
+                      "JOIN urls ON urls.uri = history.uri ORDER BY history.date;"
+                      "DROP TABLE history;"
+                      "COMMIT;",
+                      NULL, NULL, errmsg) != SQLITE_OK)
+    {
+        sqlite3_exec (db, "ROLLBACK", NULL, NULL, NULL);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+midori_history_initialize_fts (sqlite3* db)
+{
+    sqlite3_stmt* stmt;
+    gboolean has_fts = FALSE;
+    char* errmsg = NULL;
+
+    sqlite3_prepare_v2 (db, "SELECT name FROM sqlite_master "
+                        "WHERE type = 'table' AND name = 'urls_fts'",
+                        -1, &stmt, NULL);
+    if (sqlite3_step (stmt) == SQLITE_ROW)
+        has_fts = TRUE;
+    sqlite3_finalize (stmt);
+
+    if (has_fts)
+        return;
+
+    /* The full text index uses the row ids of urls and search as docids,
+       uris are split into tokens at punctuation by the tokenizer.
+       If SQLite lacks FTS3 completion falls back to plain LIKE queries. */
+    if (sqlite3_exec (db,
+                      "BEGIN TRANSACTION;"
+                      "CREATE VIRTUAL TABLE urls_fts USING fts3 (uri, title);"
+                      "CREATE VIRTUAL TABLE search_fts USING fts3 (keywords, uri);"
+                      "CREATE TRIGGER urls_fts_insert AFTER INSERT ON urls BEGIN "
+                      "  INSERT INTO urls_fts (docid, uri, title) "
+                      "  VALUES (new.id, new.uri, new.title); "
+                      "END;"
+                      "CREATE TRIGGER urls_fts_update AFTER UPDATE OF title ON urls BEGIN "
+                      "  UPDATE urls_fts SET title = new.title WHERE docid = new.id; "
+                      "END;"
+                      "CREATE TRIGGER urls_fts_delete AFTER DELETE ON urls BEGIN "
+                      "  DELETE FROM urls_fts WHERE docid = old.id; "
+                      "END;"
+                      "CREATE TRIGGER search_fts_insert AFTER INSERT ON search BEGIN "
+                      "  INSERT INTO search_fts (docid, keywords, uri) "
+                      "  VALUES (new.rowid, new.keywords, new.uri); "
+                      "END;"
+                      "CREATE TRIGGER search_fts_delete AFTER DELETE ON search BEGIN "
+                      "  DELETE FROM search_fts WHERE docid = old.rowid; "
+                      "END;"
+                      "INSERT INTO urls_fts (docid, uri, title) "
+                      "SELECT id, uri, title FROM urls;"
+                      "INSERT INTO search_fts (docid, keywords, uri) "
+                      "SELECT rowid, keywords, uri FROM search;"
+                      "COMMIT;",
+                      NULL, NULL, &errmsg) != SQLITE_OK)
+    {
+        g_warning ("Failed to create history search index: %s", errmsg);
+        sqlite3_free (errmsg);
+        sqlite3_exec (db, "ROLLBACK", NULL, NULL, NULL);
+    }
+}
+
+static gboolean
+midori_history_initialize (KatzeArray*  array,
+                           const gchar* filename,
+                           const gchar* bookmarks_filename,
+                           char**       errmsg)
+{
+    sqlite3* db;
+    MidoriHistoryWriter* writer;
+    gchar* sql;
+
+    if (!(db = sokoke_open_database (filename, errmsg)))
+        return FALSE;
+    /* Without WAL reads may briefly wait for the writer thread */
+    sqlite3_busy_timeout (db, 1000);
+
+    /* Every page is stored once in urls, each visit is a row in visits */
+    if (sqlite3_exec (db,
+                      "CREATE TABLE IF NOT EXISTS "
+                      "urls (id integer PRIMARY KEY, uri text UNIQUE NOT NULL, "
+                      "title text, visit_count integer NOT NULL DEFAULT 0, "
+                      "last_visit integer NOT NULL DEFAULT 0);"
+                      "CREATE TABLE IF NOT EXISTS "
+                      "visits (url integer NOT NULL, date integer, day integer);"
+                      "CREATE TABLE IF NOT EXISTS "
+                      "search (keywords text, uri text, day integer);"
+                      "CREATE INDEX IF NOT EXISTS "
+                      "urls_visit_count ON urls (visit_count);"
+                      "CREATE INDEX IF NOT EXISTS visits_url ON visits (url);"
+                      "CREATE INDEX IF NOT EXISTS visits_day ON visits (day, date);"
+                      "CREATE INDEX IF NOT EXISTS visits_date ON visits (date);"
+                      "CREATE INDEX IF NOT EXISTS search_day ON search (day);"
+                      "CREATE TRIGGER IF NOT EXISTS visits_insert "
+                      "AFTER INSERT ON visits BEGIN "
+                      "  UPDATE urls SET visit_count = visit_count + 1, "
+                      "  last_visit = max (last_visit, new.date) "
+                      "  WHERE id = new.url; "
+                      "END;"
+                      "CREATE TRIGGER IF NOT EXISTS visits_delete "
+                      "AFTER DELETE ON visits BEGIN "
+                      "  UPDATE urls SET visit_count = visit_count - 1, "
+                      "  last_visit = (SELECT ifnull (max (date), 0) "
+                      "                FROM visits WHERE url = old.url) "
+                      "  WHERE id = old.url; "
+                      "  DELETE FROM urls WHERE id = old.url AND visit_count < 1; "
+                      "END;",
+                      NULL, NULL, errmsg) != SQLITE_OK
+     || !midori_history_migrate (db, errmsg))
+    {
+        sqlite3_close (db);
+        return FALSE;
+    }
+    midori_history_initialize_fts (db);
+
+    if (!(writer = midori_history_writer_new (filename, errmsg)))
+    {
+        sqlite3_close (db);
+        return FALSE;
+    }
 
     sql = g_strdup_printf ("ATTACH DATABASE '%s' AS bookmarks", bookmarks_filename);
     sqlite3_exec (db, sql, NULL, NULL, errmsg);
     g_free (sql);
     g_object_set_data (G_OBJECT (array), "db", db);
+    g_object_set_data (G_OBJECT (array), "writer", writer);
+    g_object_set_data (G_OBJECT (array), "completion",
+        midori_completion_index_new (filename, bookmarks_filename));
     g_signal_connect (array, "clear",
-                      G_CALLBACK (midori_history_clear_cb), db);
+                      G_CALLBACK (midori_history_clear_cb), writer);
 
     return TRUE;
 }
 
 static void
-midori_history_terminate (KatzeArray* array,
-                          gint        max_history_age)
+midori_history_terminate (KatzeArray* array)
 {
     sqlite3* db = g_object_get_data (G_OBJECT (array), "db");
-    char* errmsg = NULL;
-    gchar* sqlcmd = g_strdup_printf (
-        "DELETE FROM history WHERE "
-        "(julianday(date('now')) - julianday(date(date,'unixepoch')))"
-        " >= %d", max_history_age);
-    if (sqlite3_exec (db, sqlcmd, NULL, NULL, &errmsg) != SQLITE_OK)
-    {
-        /* i18n: Couldn't remove items that are older than n days */
-        g_printerr (_("Failed to remove old history items: %s\n"), errmsg);
-        sqlite3_free (errmsg);
-    }
-    g_free (sqlcmd);
+    MidoriHistoryWriter* writer = g_object_get_data (G_OBJECT (array), "writer");
+    MidoriCompletionIndex* completion = g_object_get_data (G_OBJECT (array),
+                                                           "completion");
+
+    /* Old items are expired while running, only write out the queue */
+    if (writer)
+        midori_history_writer_free (writer);
+    g_object_set_data (G_OBJECT (array), "writer", NULL);
+    if (completion)
+        midori_completion_index_free (completion);
+    g_object_set_data (G_OBJECT (array), "completion", NULL);
     sqlite3_close (db);
 }
 
+static gboolean
+midori_maintain_databases_cb (MidoriApp* app)
+{
+    KatzeArray* history = katze_object_get_object (app, "history");
+    KatzeArray* bookmarks = katze_object_get_object (app, "bookmarks");
+    MidoriWebSettings* settings = katze_object_get_object (app, "settings");
+    MidoriHistoryWriter* writer;
+    const gchar* filename;
+
+    /* History is expired in batches and maintained by the writer
+       thread, in order with pending writes. An age of 0 means no
+       history is kept, new visits aren't recorded and all old
+       ones are expired. */
+    if (history && (writer = g_object_get_data (G_OBJECT (history), "writer")))
+    {
+        midori_history_writer_expire (writer,
+            katze_object_get_int (settings, "maximum-history-age"));
+        midori_history_writer_maintain (writer);
+    }
+    /* Bookmarks are maintained on a separate connection in a thread */
+    if (bookmarks && g_object_get_data (G_OBJECT (bookmarks), "db")
+     && (filename = g_object_get_data (G_OBJECT (bookmarks), "filename")))
+        sokoke_maintain_database_file (filename);
+    if (history)
+        g_object_unref (history);
+    if (bookmarks)
+        g_object_unref (bookmarks);
+    g_object_unref (settings);
+    return TRUE;
+}
+
+static gboolean
+midori_maintain_databases_first_cb (MidoriApp* app)
+{
+    midori_maintain_databases_cb (app);
+    g_timeout_add_seconds_full (G_PRIORITY_LOW, 10 * 60,
+        (GSourceFunc)midori_maintain_databases_cb, app, NULL);
+    return FALSE;
+}
+
 static void
 midori_bookmarks_add_item_cb (KatzeArray* array,
                               KatzeItem*  item,
@@ -536,6 +703,26 @@ midori_bookmarks_remove_item_cb (KatzeArray* array,
     sqlite3_free (sqlcmd);
 }
 
+static void
+midori_bookmarks_add_item_completion_cb (KatzeArray*            array,
+                                         KatzeItem*             item,
+                                         MidoriCompletionIndex* completion)
+{
+    if (KATZE_ITEM_IS_BOOKMARK (item))
+        midori_completion_index_set_bookmark (completion,
+            katze_item_get_uri (item), katze_item_get_name (item), TRUE);
+}
+
+static void
+midori_bookmarks_remove_item_completion_cb (KatzeArray*            array,
+                                            KatzeItem*             item,
+                                            MidoriCompletionIndex* completion)
+{
+    if (KATZE_ITEM_IS_BOOKMARK (item))
+        midori_completion_index_set_bookmark (completion,
+            katze_item_get_uri (item), NULL, FALSE);
+}
+
 static sqlite3*
 midori_bookmarks_initialize (KatzeArray*  array,
                              const gchar* filename,
@@ -543,14 +730,10 @@ midori_bookmarks_initialize (KatzeArray*  array,
 {
     sqlite3* db;
 
-    if (sqlite3_open (filename, &db) != SQLITE_OK)
-    {
-        if (errmsg)
-            *errmsg = g_strdup_printf (_("Failed to open database: %s\n"),
-                                       sqlite3_errmsg (db));
-        sqlite3_close (db);
+    if (!(db = sokoke_open_database (filename, errmsg)))
         return NULL;
-    }
+    /* Writes may briefly wait for maintenance in another thread */
+    sqlite3_busy_timeout (db, 1000);
 
     if (sqlite3_exec (db,
                       "CREATE TABLE IF NOT EXISTS "
@@ -558,6 +741,8 @@ midori_bookmarks_initialize (KatzeArray*  array,
                       "desc text, app integer, toolbar integer);",
                       NULL, NULL, errmsg) != SQLITE_OK)
         return NULL;
+    g_object_set_data_full (G_OBJECT (array), "filename",
+                            g_strdup (filename), g_free);
     g_signal_connect (array, "add-item",
                       G_CALLBACK (midori_bookmarks_add_item_cb), db);
     g_signal_connect (array, "remove-item",
@@ -591,6 +776,91 @@ midori_session_add_delay (KatzeArray* session)
         katze_item_set_meta_integer (item, "delay", 1);
 }
 
+/* Restores deferred tabs a few at a time, each waiting for a
+   previous one to finish loading */
+typedef struct
+{
+    GList* pending;
+    GList* loading;
+    gint max;
+} MidoriRestoreQueue;
+
+static void
+midori_restore_queue_run (MidoriRestoreQueue* queue);
+
+static void
+midori_restore_queue_done (GtkWidget*          view,
+                           MidoriRestoreQueue* queue);
+
+static void
+midori_restore_queue_load_status_cb (GtkWidget*          view,
+                                     GParamSpec*         pspec,
+                                     MidoriRestoreQueue* queue)
+{
+    if (midori_view_get_load_status (MIDORI_VIEW (view)) == MIDORI_LOAD_FINISHED)
+        midori_restore_queue_done (view, queue);
+}
+
+static void
+midori_restore_queue_done (GtkWidget*          view,
+                           MidoriRestoreQueue* queue)
+{
+    g_signal_handlers_disconnect_by_func (view,
+        midori_restore_queue_load_status_cb, queue);
+    g_signal_handlers_disconnect_by_func (view,
+        midori_restore_queue_done, queue);
+    queue->pending = g_list_remove (queue->pending, view);
+    queue->loading = g_list_remove (queue->loading, view);
+    midori_restore_queue_run (queue);
+}
+
+static void
+midori_restore_queue_run (MidoriRestoreQueue* queue)
+{
+    while (queue->pending && (gint)g_list_length (queue->loading) < queue->max)
+    {
+        GtkWidget* view = queue->pending->data;
+
+        queue->pending = g_list_delete_link (queue->pending, queue->pending);
+        /* The tab may have been selected and loaded meanwhile */
+        if (midori_view_load_deferred (MIDORI_VIEW (view)))
+        {
+            queue->loading = g_list_prepend (queue->loading, view);
+            g_signal_connect (view, "notify::load-status",
+                G_CALLBACK (midori_restore_queue_load_status_cb), queue);
+        }
+        else
+            g_signal_handlers_disconnect_by_func (view,
+                midori_restore_queue_done, queue);
+    }
+
+    if (!queue->pending && !queue->loading)
+        g_slice_free (MidoriRestoreQueue, queue);
+}
+
+static void
+midori_restore_queue_add_cb (GtkWidget*          view,
+                             MidoriRestoreQueue* queue)
+{
+    queue->pending = g_list_append (queue->pending, view);
+    g_signal_connect (view, "destroy",
+        G_CALLBACK (midori_restore_queue_done), queue);
+}
+
+static void
+midori_browser_restore_tabs (MidoriBrowser* browser,
+                             gint           max)
+{
+    MidoriRestoreQueue* queue = g_slice_new (MidoriRestoreQueue);
+    queue->pending = NULL;
+    queue->loading = NULL;
+    queue->max = max;
+
+    midori_browser_foreach (browser,
+        (GtkCallback)midori_restore_queue_add_cb, queue);
+    midori_restore_queue_run (queue);
+}
+
 static void
 settings_notify_cb (MidoriWebSettings* settings,
                     GParamSpec*        pspec,
@@ -873,6 +1143,20 @@ midori_soup_session_settings_accept_language_cb (SoupSession*       session,
     g_free (accpt);
 }
 
+#ifdef HAVE_LIBSOUP_2_34_0
+static void
+soup_session_settings_notify_background_requests_cb (MidoriWebSettings*  settings,
+                                                     GParamSpec*         pspec,
+                                                     KatzeHttpScheduler* scheduler)
+{
+    g_object_set (scheduler,
+        "max-background", katze_object_get_int (settings, "background-requests"),
+        "max-background-per-host",
+        katze_object_get_int (settings, "background-requests-per-host"),
+        NULL);
+}
+#endif
+
 static void
 midori_soup_session_debug (SoupSession* session)
 {
@@ -943,12 +1227,25 @@ midori_soup_session_prepare (SoupSession*       session,
     midori_soup_session_debug (session);
 
     feature = g_object_new (KATZE_TYPE_HTTP_COOKIES, NULL);
-    config_file = build_config_filename ("cookies.txt");
+    config_file = build_config_filename ("cookies.db");
     g_object_set_data_full (G_OBJECT (feature), "filename",
                             config_file, (GDestroyNotify)g_free);
     soup_session_add_feature (session, SOUP_SESSION_FEATURE (cookie_jar));
     soup_session_add_feature (session, feature);
     g_object_unref (feature);
+
+    /* Older versions can't pause messages that weren't sent yet */
+    #ifdef HAVE_LIBSOUP_2_34_0
+    feature = g_object_new (KATZE_TYPE_HTTP_SCHEDULER, NULL);
+    soup_session_settings_notify_background_requests_cb (settings, NULL,
+        KATZE_HTTP_SCHEDULER (feature));
+    g_signal_connect (settings, "notify::background-requests",
+        G_CALLBACK (soup_session_settings_notify_background_requests_cb), feature);
+    g_signal_connect (settings, "notify::background-requests-per-host",
+        G_CALLBACK (soup_session_settings_notify_background_requests_cb), feature);
+    soup_session_add_feature (session, feature);
+    g_object_unref (feature);
+    #endif
 }
 
 static void
@@ -1233,6 +1530,8 @@ midori_load_session (gpointer data)
     KatzeArray* session;
     KatzeItem* item;
     gint64 current;
+    gint64 i;
+    gint restore_tabs;
     MidoriStartup load_on_startup;
     gchar** command = g_object_get_data (G_OBJECT (app), "execute-command");
     #ifdef G_ENABLE_DEBUG
@@ -1284,22 +1583,30 @@ midori_load_session (gpointer data)
     if (load_on_startup == MIDORI_STARTUP_DELAYED_PAGES)
         midori_session_add_delay (_session);
 
+    current = katze_item_get_meta_integer (KATZE_ITEM (_session), "current");
+    if (!katze_array_get_nth_item (_session, current))
+        current = 0;
+
+    /* Only the current tab is loaded, others wait until they are selected */
     session = midori_browser_get_proxy_array (browser);
+    i = 0;
     KATZE_ARRAY_FOREACH_ITEM (item, _session)
     {
         g_object_set_data (G_OBJECT (item), "midori-view-append", (void*)1);
+        if (i++ != current)
+            g_object_set_data (G_OBJECT (item), "midori-view-defer", (void*)1);
         midori_browser_add_item (browser, item);
     }
-    current = katze_item_get_meta_integer (KATZE_ITEM (_session), "current");
-    if (!(item = katze_array_get_nth_item (_session, current)))
-    {
-        current = 0;
-        item = katze_array_get_nth_item (_session, 0);
-    }
+    item = katze_array_get_nth_item (_session, current);
     midori_browser_set_current_page (browser, current);
     if (!g_strcmp0 (katze_item_get_uri (item), ""))
         midori_browser_activate_action (browser, "Location");
 
+    /* Delayed pages would only show that they are delayed */
+    if (load_on_startup != MIDORI_STARTUP_DELAYED_PAGES
+     && (restore_tabs = katze_object_get_int (settings, "restore-background-tabs")))
+        midori_browser_restore_tabs (browser, restore_tabs);
+
     g_object_unref (settings);
     g_object_unref (_session);
 
@@ -1451,24 +1758,16 @@ signal_handler (int signal_id)
 #endif
 
 static void
-midori_soup_session_block_uris_cb (SoupSession* session,
-                                   SoupMessage* msg,
-                                   gchar*       blocked_uris)
+midori_soup_session_block_uris_cb (SoupSession*      session,
+                                   SoupMessage*      msg,
+                                   MidoriUriBlocker* blocker)
 {
-    static GRegex* regex = NULL;
-    SoupURI* soup_uri;
-    gchar* uri;
-    if (!regex)
-        regex = g_regex_new (blocked_uris, 0, 0, NULL);
-    soup_uri = soup_message_get_uri (msg);
-    uri = soup_uri_to_string (soup_uri, FALSE);
-    if (g_regex_match (regex, uri, 0, 0))
+    if (midori_uri_blocker_match (blocker, soup_message_get_uri (msg)))
     {
-        soup_uri = soup_uri_new ("http://.invalid");
+        SoupURI* soup_uri = soup_uri_new ("http://.invalid");
         soup_message_set_uri (msg, soup_uri);
         soup_uri_free (soup_uri);
     }
-    g_free (uri);
 }
 
 typedef struct {
@@ -1549,6 +1848,8 @@ midori_clear_page_icons_cb (void)
 {
     gchar* cache = g_build_filename (g_get_user_cache_dir (),
                                      PACKAGE_NAME, "icons", NULL);
+    katze_clear_cached_icons ();
+    /* Icon files written by older versions */
     sokoke_remove_path (cache, TRUE);
     g_free (cache);
     cache = g_build_filename (g_get_user_data_dir (),
@@ -1566,7 +1867,8 @@ midori_clear_web_cookies_cb (void)
     for (; cookies != NULL; cookies = g_slist_next (cookies))
     {
         SoupCookie* cookie = cookies->data;
-        soup_cookie_set_max_age (cookie, 0);
+        /* Deleting makes KatzeHttpCookies remove it from the database */
+        soup_cookie_jar_delete_cookie (SOUP_COOKIE_JAR (jar), cookie);
         soup_cookie_free (cookie);
     }
     g_slist_free (cookies);
@@ -1612,6 +1914,8 @@ main (int    argc,
     gboolean version;
     gchar** uris;
     gchar* block_uris;
+    gchar* block_list;
+    MidoriUriBlocker* blocker;
     gint inactivity_reset;
     MidoriApp* app;
     gboolean result;
@@ -1642,6 +1946,8 @@ main (int    argc,
        N_("Addresses"), NULL },
        { "block-uris", 'b', 0, G_OPTION_ARG_STRING, &block_uris,
        N_("Block URIs according to regular expression PATTERN"), _("PATTERN") },
+       { "block-list", 0, 0, G_OPTION_ARG_FILENAME, &block_list,
+       N_("Block URIs according to the rules in FILE"), N_("FILE") },
        #ifdef HAVE_X11_EXTENSIONS_SCRNSAVER_H
        { "inactivity-reset", 'i', 0, G_OPTION_ARG_INT, &inactivity_reset,
        /* i18n: CLI: Close tabs, clear private data, open starting page */
@@ -1667,7 +1973,6 @@ main (int    argc,
     gchar* uri_ready;
     gchar* errmsg;
     sqlite3* db;
-    gint max_history_age;
     gint clear_prefs = MIDORI_CLEAR_NONE;
     #ifdef G_ENABLE_DEBUG
         gboolean startup_timer = g_getenv ("MIDORI_STARTTIME") != NULL;
@@ -1725,6 +2030,7 @@ main (int    argc,
     version = FALSE;
     uris = NULL;
     block_uris = NULL;
+    block_list = NULL;
     inactivity_reset = 0;
     error = NULL;
     if (!gtk_init_with_args (&argc, &argv, _("[Addresses]"), entries,
@@ -1824,6 +2130,29 @@ main (int    argc,
     }
     #endif
 
+    /* Running without the rules would let blocked pages through */
+    blocker = NULL;
+    if (block_list)
+    {
+        gchar* rules;
+
+        if (!g_file_get_contents (block_list, &rules, NULL, &error))
+        {
+            g_printerr (_("The block list couldn't be loaded: %s\n"),
+                        error->message);
+            return 1;
+        }
+        /* A pattern given as well is one more rule */
+        if (block_uris)
+            katze_assign (rules, g_strdup_printf ("%s\n/%s/", rules, block_uris));
+        blocker = midori_uri_blocker_new_from_rules (rules);
+        g_free (rules);
+        if (!blocker)
+            return 1;
+    }
+    else if (block_uris && !(blocker = midori_uri_blocker_new (block_uris)))
+        return 1;
+
     sokoke_register_privacy_item ("page-icons", _("Website icons"),
         G_CALLBACK (midori_clear_page_icons_cb));
     sokoke_register_privacy_item ("web-cookies", _("Cookies"),
@@ -1887,13 +2216,14 @@ main (int    argc,
             for (i = 0; uris[i] != NULL; i++)
                 midori_browser_activate_action (browser, uris[i]);
         }
-        if (block_uris)
+        if (blocker)
             g_signal_connect (session, "request-queued",
-                G_CALLBACK (midori_soup_session_block_uris_cb),
-                g_strdup (block_uris));
+                G_CALLBACK (midori_soup_session_block_uris_cb), blocker);
         midori_setup_inactivity_reset (browser, inactivity_reset, webapp);
         midori_startup_timer ("App created: \t%f");
         gtk_main ();
+        if (blocker)
+            midori_uri_blocker_print_stats (blocker);
         return 0;
     }
 
@@ -2057,6 +2387,15 @@ main (int    argc,
             _("The history couldn't be loaded: %s\n"), errmsg);
         g_free (errmsg);
     }
+    else
+    {
+        MidoriCompletionIndex* completion = g_object_get_data (
+            G_OBJECT (history), "completion");
+        g_signal_connect (bookmarks, "add-item",
+            G_CALLBACK (midori_bookmarks_add_item_completion_cb), completion);
+        g_signal_connect (bookmarks, "remove-item",
+            G_CALLBACK (midori_bookmarks_remove_item_completion_cb), completion);
+    }
     g_free (bookmarks_file);
     midori_startup_timer ("History read: \t%f");
 
@@ -2188,20 +2527,26 @@ main (int    argc,
     g_idle_add (midori_load_cookie_jar, settings);
     g_idle_add (midori_load_extensions, app);
     g_idle_add (midori_load_session, _session);
+    g_timeout_add_seconds_full (G_PRIORITY_LOW, 60,
+        (GSourceFunc)midori_maintain_databases_first_cb, app, NULL);
 
     if (execute)
         g_object_set_data (G_OBJECT (app), "execute-command", uris);
-    if (block_uris)
-            g_signal_connect (webkit_get_default_session (), "request-queued",
-                G_CALLBACK (midori_soup_session_block_uris_cb),
-                g_strdup (block_uris));
-
+    if (blocker)
+        g_signal_connect (webkit_get_default_session (), "request-queued",
+            G_CALLBACK (midori_soup_session_block_uris_cb), blocker);
 
     gtk_main ();
 
+    if (blocker)
+    {
+        midori_uri_blocker_print_stats (blocker);
+        midori_uri_blocker_free (blocker);
+    }
+
     settings = katze_object_get_object (app, "settings");
-    g_object_get (settings, "maximum-history-age", &max_history_age, NULL);
-    midori_history_terminate (history, max_history_age);
+    midori_history_terminate (history);
+    midori_speed_dial_flush (midori_speed_dial_get_default ());
     /* Removing KatzeHttpCookies makes it save outstanding changes */
     soup_session_remove_feature_by_type (webkit_get_default_session (),
                                          KATZE_TYPE_HTTP_COOKIES);
@@ -14,11 +14,14 @@
 #include "midori-browser.h"
 
 #include "midori-array.h"
+#include "midori-completionindex.h"
+#include "midori-historywriter.h"
 #include "midori-view.h"
 #include "midori-preferences.h"
 #include "midori-panel.h"
 #include "midori-locationaction.h"
 #include "midori-searchaction.h"
+#include "midori-speeddial.h"
 #include "midori-stock.h"
 #include "midori-findbar.h"
 #include "midori-transferbar.h"
@@ -85,6 +88,7 @@ struct _MidoriBrowser
     gint last_window_width, last_window_height;
     guint alloc_timeout;
     guint panel_timeout;
+    guint hibernate_timeout;
 
     gint clear_private_data;
 
@@ -440,28 +444,18 @@ static void
 midori_browser_update_history_title (MidoriBrowser* browser,
                                      KatzeItem*     item)
 {
-    sqlite3* db;
-    static sqlite3_stmt* stmt = NULL;
+    MidoriHistoryWriter* writer;
+    MidoriCompletionIndex* completion;
 
     g_return_if_fail (katze_item_get_uri (item) != NULL);
 
-    db = g_object_get_data (G_OBJECT (browser->history), "db");
-    g_return_if_fail (db != NULL);
-    if (!stmt)
-    {
-        const gchar* sqlcmd;
-
-        sqlcmd = "UPDATE history SET title=? WHERE uri = ? and date=?";
-        sqlite3_prepare_v2 (db, sqlcmd, -1, &stmt, NULL);
-    }
-    sqlite3_bind_text (stmt, 1, katze_item_get_name (item), -1, 0);
-    sqlite3_bind_text (stmt, 2, katze_item_get_uri (item), -1, 0);
-    sqlite3_bind_int64 (stmt, 3, katze_item_get_added (item));
-
-    if (sqlite3_step (stmt) != SQLITE_DONE)
-        g_printerr (_("Failed to update title: %s\n"), sqlite3_errmsg (db));
-    sqlite3_reset (stmt);
-    sqlite3_clear_bindings (stmt);
+    writer = g_object_get_data (G_OBJECT (browser->history), "writer");
+    g_return_if_fail (writer != NULL);
+    midori_history_writer_set_title (writer, katze_item_get_uri (item),
+                                     katze_item_get_name (item));
+    if ((completion = g_object_get_data (G_OBJECT (browser->history), "completion")))
+        midori_completion_index_set_title (completion, katze_item_get_uri (item),
+                                           katze_item_get_name (item));
 }
 
 static void
@@ -978,27 +972,13 @@ midori_browser_prepare_download (MidoriBrowser*  browser,
 #else
 static void
 midori_browser_save_transfer_cb (KatzeNetRequest* request,
-                                 gchar*           filename)
+                                 gpointer         user_data)
 {
-    FILE* fp;
-    size_t ret;
-
-    if (request->data)
-    {
-        if ((fp = fopen (filename, "wb")))
-        {
-            ret = fwrite (request->data, 1, request->length, fp);
-            fclose (fp);
-            if ((ret - request->length) != 0)
-            {
-                /* Once we have a download interface this should be
-                   indicated graphically. */
-                g_warning ("Error writing to file %s "
-                           "in midori_browser_save_transfer_cb", filename);
-            }
-        }
-    }
-    g_free (filename);
+    /* Once we have a download interface this should be
+       indicated graphically. */
+    if (request->status == KATZE_NET_FAILED)
+        g_warning ("Error saving %s "
+                   "in midori_browser_save_transfer_cb", request->uri);
 }
 #endif
 
@@ -1074,9 +1054,11 @@ midori_browser_save_uri (MidoriBrowser* browser,
             webkit_download_start (download);
         g_free (destination);
         #else
-        katze_net_load_uri (NULL, uri, NULL,
-            (KatzeNetTransferCb)midori_browser_save_transfer_cb, filename);
+        /* The transfer keeps a copy of the filename */
+        katze_net_load_uri_to_file (NULL, uri, filename, NULL,
+            (KatzeNetTransferCb)midori_browser_save_transfer_cb, NULL);
         #endif
+        g_free (filename);
 
         g_free (last_dir);
         last_dir = folder;
@@ -1095,165 +1077,54 @@ midori_view_save_as_cb (GtkWidget*   menuitem,
     midori_browser_save_uri (browser, uri);
 }
 
-static gchar*
-midori_browser_speed_dial_get_next_free_slot (void)
-{
-    GRegex* regex;
-    GMatchInfo* match_info;
-    gchar* speed_dial_body;
-    gchar* body_fname;
-    gchar* slot_id = NULL;
-
-    body_fname = g_build_filename (sokoke_set_config_dir (NULL),
-                                   "speeddial.json", NULL);
-
-    if (g_access (body_fname, F_OK) != 0)
-    {
-        gchar* filename = g_build_filename ("midori", "res", "speeddial.json", NULL);
-        gchar* filepath = sokoke_find_data_filename (filename);
-        g_free (filename);
-        if (g_file_get_contents (filepath, &speed_dial_body, NULL, NULL))
-        {
-            g_file_set_contents (body_fname, speed_dial_body, -1, NULL);
-
-            g_free (speed_dial_body);
-        }
-        g_free (filepath);
-        g_free (body_fname);
-        return g_strdup ("s1");
-    }
-    else
-        g_file_get_contents (body_fname, &speed_dial_body, NULL, NULL);
-
-    regex = g_regex_new ("\"id\":\"(s[0-9]{1,2})\",\"href\":\"#\"",
-                         G_REGEX_MULTILINE, 0, NULL);
-
-    if (g_regex_match (regex, speed_dial_body, 0, &match_info))
-    {
-        slot_id = g_match_info_fetch (match_info, 1);
-        g_match_info_free (match_info);
-    }
-
-    if (!g_strcmp0 (slot_id, ""))
-        g_free (slot_id);
-
-    g_free (body_fname);
-    g_free (speed_dial_body);
-    g_free (regex);
-
-    return slot_id;
-}
-
 static void
 midori_browser_add_speed_dial (MidoriBrowser* browser)
 {
+    MidoriSpeedDial* dial;
+    const gchar* slot_id;
     GdkPixbuf* img;
-    gchar* replace_from;
-    gchar* replace_by;
-    gsize len;
+    gchar* thumb_filename;
+    gchar* thumb_uri;
+    gchar* title;
+    gint i;
 
     GtkWidget* view = midori_browser_get_current_tab (browser);
+    const gchar* uri = midori_view_get_display_uri (MIDORI_VIEW (view));
 
-    gchar* uri = g_strdup (midori_view_get_display_uri (MIDORI_VIEW (view)));
-    gchar* title = g_strdup (midori_view_get_display_title (MIDORI_VIEW (view)));
-    gchar* slot_id = midori_browser_speed_dial_get_next_free_slot ();
-
-    GRegex* reg_quotes = g_regex_new ("'", 0, 0, NULL);
-    GRegex* reg_others = g_regex_new ("[\\\"\\\\]", 0, 0, NULL);
-    gchar* temp_title = g_regex_replace_literal (reg_others, title,
-                                                 -1, 0, " ", 0, NULL);
-    g_free (title);
-    title = g_regex_replace_literal (reg_quotes, temp_title, -1, 0,
-                                     "\\\\'", 0, NULL);
-
-    g_free (temp_title);
-    g_regex_unref (reg_quotes);
-    g_regex_unref (reg_others);
-
-    if (slot_id == NULL)
-    {
-        g_free (uri);
-        g_free (title);
+    dial = midori_speed_dial_get_default ();
+    if (!(slot_id = midori_speed_dial_get_next_free_slot (dial)))
         return;
-    }
 
-    if ((len = g_utf8_strlen (title, -1)) > 15)
-    {
-        /**
-          * The case when a quote was escaped with a backslash and the
-          * backslash becomes the last character of the ellipsized string.
-          * This causes JSON parsing to fail.
-          * For example: "My Foo Bar \'b\..."
-          **/
-        GRegex* reg_unsafe = g_regex_new ("([\\\\]+\\.)", 0, 0, NULL);
+    if (!(img = midori_view_get_snapshot (MIDORI_VIEW (view), 240, 160)))
+        return;
 
-        gchar* temp;
-        gchar* ellipsized = g_malloc0 ( len + 1);
+    /* The page refers to the file rather than embedding it */
+    thumb_filename = sokoke_speed_dial_thumb_filename (uri);
+    gdk_pixbuf_save (img, thumb_filename, "png", NULL,
+                     "compression", "7", NULL);
+    thumb_uri = g_filename_to_uri (thumb_filename, NULL, NULL);
+    g_object_unref (img);
 
+    title = g_strdup (midori_view_get_display_title (MIDORI_VIEW (view)));
+    if (g_utf8_strlen (title, -1) > 15)
+    {
+        gchar* ellipsized = g_malloc0 (strlen (title) + 1);
         g_utf8_strncpy (ellipsized, title, 15);
-        g_free (title);
-
-        temp = g_strdup_printf ("%s...", ellipsized);
-        g_free  (ellipsized);
-
-        title = g_regex_replace_literal (reg_unsafe, temp, -1, 0, ".", 0, NULL);
-        g_free (temp);
-
-        g_regex_unref (reg_unsafe);
+        katze_assign (title, g_strdup_printf ("%s...", ellipsized));
+        g_free (ellipsized);
     }
 
-    if ((img = midori_view_get_snapshot (MIDORI_VIEW (view), 240, 160)))
-    {
-        GRegex* regex;
-        gchar* replace;
-        gchar* file_content;
-        gchar* encoded;
-        gchar* speed_dial_body;
-        gchar* body_fname;
-        gsize sz;
+    midori_speed_dial_set_shortcut (dial, slot_id, uri, title, thumb_uri);
 
-        body_fname = g_build_filename (sokoke_set_config_dir (NULL),
-                                       "speeddial.json", NULL);
+    i = 0;
+    while ((view = gtk_notebook_get_nth_page (GTK_NOTEBOOK (
+                                              browser->notebook), i++)))
+        if (midori_view_is_blank (MIDORI_VIEW (view)))
+            midori_view_reload (MIDORI_VIEW (view), FALSE);
 
-        if (g_file_get_contents (body_fname, &speed_dial_body, NULL, NULL))
-        {
-            gint i;
-
-            gdk_pixbuf_save_to_buffer (img, &file_content, &sz, "png", NULL, NULL);
-            encoded = g_base64_encode ((guchar *)file_content, sz);
-
-            replace_from = g_strdup_printf (
-                "\\{\"id\":\"%s\",\"href\":\"#\",\"title\":\"\",\"img\":\"\"\\}",
-                slot_id);
-            replace_by = g_strdup_printf (
-                "{\"id\":\"%s\",\"href\":\"%s\",\"title\":\"%s\",\"img\":\"%s\"}",
-                slot_id, uri, title, encoded);
-
-            regex = g_regex_new (replace_from, G_REGEX_MULTILINE, 0, NULL);
-            replace = g_regex_replace (regex, speed_dial_body, -1,
-                                       1, replace_by, 0, NULL);
-
-            g_file_set_contents (body_fname, replace, -1, NULL);
-
-            i = 0;
-            while ((view = gtk_notebook_get_nth_page (GTK_NOTEBOOK (
-                                                      browser->notebook), i++)))
-                if (midori_view_is_blank (MIDORI_VIEW (view)))
-                    midori_view_reload (MIDORI_VIEW (view), FALSE);
-
-            g_object_unref (img);
-            g_regex_unref (regex);
-            g_free (encoded);
-            g_free (file_content);
-            g_free (speed_dial_body);
-            g_free (replace_from);
-            g_free (replace_by);
-            g_free (replace);
-        }
-        g_free (body_fname);
-    }
-    g_free (uri);
-    g_free (slot_id);
+    g_free (title);
+    g_free (thumb_uri);
+    g_free (thumb_filename);
 }
 
 
@@ -1502,6 +1373,86 @@ midori_view_search_text_cb (GtkWidget*     view,
     midori_findbar_search_text (MIDORI_FINDBAR (browser->find), view, found, typing);
 }
 
+static void
+midori_browser_set_tab_visible (GtkWidget* view,
+                                gboolean   visible)
+{
+    SoupSession* session = webkit_get_default_session ();
+    SoupSessionFeature* scheduler;
+
+    /* Requests of the current tab go before those of other tabs */
+    scheduler = soup_session_get_feature (session, KATZE_TYPE_HTTP_SCHEDULER);
+    if (scheduler)
+        katze_http_scheduler_set_owner_visible (
+            KATZE_HTTP_SCHEDULER (scheduler), view, visible);
+}
+
+static gint
+midori_browser_compare_hidden_time (gconstpointer view1,
+                                    gconstpointer view2)
+{
+    return midori_view_get_hidden_time (MIDORI_VIEW (view2))
+         - midori_view_get_hidden_time (MIDORI_VIEW (view1));
+}
+
+static gboolean
+midori_browser_hibernate_tabs_cb (MidoriBrowser* browser)
+{
+    gint hibernate_after = katze_object_get_int (browser->settings,
+                                                 "hibernate-tabs-after");
+    gint maximum_loaded = katze_object_get_int (browser->settings,
+                                                "maximum-loaded-tabs");
+    GList* children;
+    GList* hidden = NULL;
+    gint loaded = 0;
+
+    children = gtk_container_get_children (GTK_CONTAINER (browser->notebook));
+    for (; children; children = g_list_delete_link (children, children))
+    {
+        MidoriView* view = children->data;
+        glong hidden_time;
+
+        if (midori_view_is_deferred (view))
+            continue;
+
+        hidden_time = midori_view_get_hidden_time (view);
+        if (hibernate_after && hidden_time >= hibernate_after * 60
+         && midori_view_hibernate (view))
+            continue;
+
+        loaded++;
+        if (hidden_time)
+            hidden = g_list_insert_sorted (hidden, view,
+                midori_browser_compare_hidden_time);
+    }
+
+    /* Tabs that weren't looked at the longest go first */
+    for (; hidden; hidden = g_list_delete_link (hidden, hidden))
+        if (maximum_loaded && loaded > maximum_loaded
+         && midori_view_hibernate (hidden->data))
+            loaded--;
+
+    return TRUE;
+}
+
+static void
+midori_browser_update_hibernation (MidoriBrowser* browser)
+{
+    gboolean hibernate = katze_object_get_int (browser->settings,
+                                               "hibernate-tabs-after")
+                      || katze_object_get_int (browser->settings,
+                                               "maximum-loaded-tabs");
+
+    if (hibernate && !browser->hibernate_timeout)
+        browser->hibernate_timeout = g_timeout_add_seconds (60,
+            (GSourceFunc)midori_browser_hibernate_tabs_cb, browser);
+    else if (!hibernate && browser->hibernate_timeout)
+    {
+        g_source_remove (browser->hibernate_timeout);
+        browser->hibernate_timeout = 0;
+    }
+}
+
 static gboolean
 midori_browser_tab_destroy_cb (GtkWidget*     widget,
                                MidoriBrowser* browser)
@@ -1509,6 +1460,8 @@ midori_browser_tab_destroy_cb (GtkWidget*     widget,
     KatzeItem* item;
     const gchar* uri;
 
+    midori_browser_set_tab_visible (widget, FALSE);
+
     if (browser->proxy_array && MIDORI_IS_VIEW (widget))
     {
         item = midori_view_get_proxy_item (MIDORI_VIEW (widget));
@@ -2180,6 +2133,7 @@ _action_add_desktop_shortcut_activate (GtkAction*     action,
     const gchar* app_name = katze_item_get_name (item);
     gchar* app_exec = g_strconcat ("midori -a ", katze_item_get_uri (item), NULL);
     const gchar* icon_uri = midori_view_get_icon_uri (MIDORI_VIEW (tab));
+    GdkPixbuf* icon;
     gchar* app_icon;
     GKeyFile* keyfile = g_key_file_new ();
     gchar* filename = g_strconcat (app_name, ".desktop", NULL);
@@ -2193,9 +2147,25 @@ _action_add_desktop_shortcut_activate (GtkAction*     action,
     }
     app_dir = g_build_filename (g_get_user_data_dir (),
                                 "applications", filename, NULL);
-    app_icon = katze_net_get_cached_path (NULL, icon_uri, "icons");
-    if (!g_file_test (app_icon, G_FILE_TEST_EXISTS))
-        katze_assign (app_icon, g_strdup (STOCK_WEB_BROWSER));
+    /* Icons are kept in a database, the launcher needs a file */
+    icon = icon_uri ? katze_get_cached_icon (katze_item_get_uri (item), icon_uri, NULL) : NULL;
+    if (icon)
+    {
+        gchar* checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, icon_uri, -1);
+        gchar* icon_dir = g_build_filename (g_get_user_data_dir (),
+                                            PACKAGE_NAME, "icons", NULL);
+        gchar* icon_file = g_strconcat (checksum, ".png", NULL);
+        katze_mkdir_with_parents (icon_dir, 0700);
+        app_icon = g_build_filename (icon_dir, icon_file, NULL);
+        if (!gdk_pixbuf_save (icon, app_icon, "png", NULL, NULL))
+            katze_assign (app_icon, g_strdup (STOCK_WEB_BROWSER));
+        g_object_unref (icon);
+        g_free (icon_file);
+        g_free (icon_dir);
+        g_free (checksum);
+    }
+    else
+        app_icon = g_strdup (STOCK_WEB_BROWSER);
     g_key_file_set_string (keyfile, "Desktop Entry", "Version", "1.0");
     g_key_file_set_string (keyfile, "Desktop Entry", "Type", "Application");
     g_key_file_set_string (keyfile, "Desktop Entry", "Name", app_name);
@@ -2207,6 +2177,7 @@ _action_add_desktop_shortcut_activate (GtkAction*     action,
     g_free (app_dir);
     g_free (filename);
     g_free (app_exec);
+    g_free (app_icon);
     g_key_file_free (keyfile);
     #elif defined(GDK_WINDOWING_QUARTZ)
     /* TODO: Implement */
@@ -3208,50 +3179,31 @@ midori_browser_get_uri_extension (const gchar* uri)
     return g_strdup (period);
 }
 
-static void
-midori_browser_source_transfer_cb (KatzeNetRequest* request,
-                                   MidoriBrowser*   browser)
+/* The source is written to a temporary file as it arrives */
+typedef struct
 {
     gchar* filename;
-    gchar* extension;
-    gchar* unique_filename;
     gchar* text_editor;
-    gint fd;
-    FILE* fp;
-    size_t ret;
+} MidoriBrowserSource;
 
-    if (request->data)
+static void
+midori_browser_source_transfer_cb (KatzeNetRequest*     request,
+                                   MidoriBrowserSource* source)
+{
+    if (request->status == KATZE_NET_DONE)
     {
-        extension = midori_browser_get_uri_extension (request->uri);
-        filename = g_strdup_printf ("%uXXXXXX%s",
-                                    g_str_hash (request->uri), extension);
-        g_free (extension);
-        if (((fd = g_file_open_tmp (filename, &unique_filename, NULL)) != -1))
-        {
-            if ((fp = fdopen (fd, "w")))
-            {
-                ret = fwrite (request->data, 1, request->length, fp);
-                fclose (fp);
-                if ((ret - request->length) != 0)
-                {
-                    g_warning ("Error writing to file %s "
-                               "in midori_browser_source_transfer_cb()", filename);
-                }
-                g_object_get (browser->settings,
-                    "text-editor", &text_editor, NULL);
-                if (text_editor && *text_editor)
-                    sokoke_spawn_program (text_editor, unique_filename);
-                else
-                    sokoke_show_uri (NULL, unique_filename,
-                                     gtk_get_current_event_time (), NULL);
-
-                g_free (unique_filename);
-                g_free (text_editor);
-            }
-            close (fd);
-        }
-        g_free (filename);
+        if (source->text_editor && *source->text_editor)
+            sokoke_spawn_program (source->text_editor, source->filename);
+        else
+            sokoke_show_uri (NULL, source->filename,
+                             gtk_get_current_event_time (), NULL);
     }
+    else
+        g_unlink (source->filename);
+
+    g_free (source->filename);
+    g_free (source->text_editor);
+    g_slice_free (MidoriBrowserSource, source);
 }
 
 static void
@@ -3261,6 +3213,10 @@ _action_source_view_activate (GtkAction*     action,
     GtkWidget* view;
     gchar* text_editor;
     const gchar* uri;
+    gchar* extension;
+    gchar* template;
+    gchar* filename;
+    gint fd;
 
     if (!(view = midori_browser_get_current_tab (browser)))
         return;
@@ -3304,14 +3260,30 @@ _action_source_view_activate (GtkAction*     action,
 
     if (g_str_has_prefix (uri, "file://"))
     {
-        gchar* filename = g_filename_from_uri (uri, NULL, NULL);
+        filename = g_filename_from_uri (uri, NULL, NULL);
         sokoke_spawn_program (text_editor, filename);
         g_free (filename);
+        g_free (text_editor);
         return;
     }
-    katze_net_load_uri (NULL, uri, NULL,
-        (KatzeNetTransferCb)midori_browser_source_transfer_cb, browser);
-    g_free (text_editor);
+
+    extension = midori_browser_get_uri_extension (uri);
+    template = g_strdup_printf ("%uXXXXXX%s", g_str_hash (uri), extension);
+    g_free (extension);
+    if ((fd = g_file_open_tmp (template, &filename, NULL)) != -1)
+    {
+        MidoriBrowserSource* source = g_slice_new (MidoriBrowserSource);
+
+        close (fd);
+        source->filename = filename;
+        source->text_editor = text_editor;
+        /* Not shared with other transfers, the page may have changed */
+        katze_net_load_uri_to_file (NULL, uri, filename, NULL,
+            (KatzeNetTransferCb)midori_browser_source_transfer_cb, source);
+    }
+    else
+        g_free (text_editor);
+    g_free (template);
 }
 
 static void
@@ -3504,6 +3476,34 @@ _action_location_reset_uri (GtkAction*     action,
 }
 
 
+typedef struct
+{
+    MidoriView* view;
+    gchar* uri;
+    gchar* search_uri;
+} MidoriLocationGuess;
+
+static void
+midori_browser_location_guess_cb (SoupAddress* address,
+                                  guint        status,
+                                  gpointer     data)
+{
+    MidoriLocationGuess* guess = data;
+
+    /* The typed text wasn't a host after all, search for it instead
+       unless the user has already gone somewhere else */
+    if (guess->view)
+    {
+        if (status == SOUP_STATUS_CANT_RESOLVE
+         && !g_strcmp0 (midori_view_get_display_uri (guess->view), guess->uri))
+            midori_view_set_uri (guess->view, guess->search_uri);
+        g_object_remove_weak_pointer (G_OBJECT (guess->view),
+                                      (gpointer*)&guess->view);
+    }
+    g_free (guess->uri);
+    g_free (guess->search_uri);
+    g_slice_free (MidoriLocationGuess, guess);
+}
 
 static void
 _action_location_submit_uri (GtkAction*     action,
@@ -3514,10 +3514,20 @@ _action_location_submit_uri (GtkAction*     action,
     gchar* stripped_uri;
     gchar* new_uri;
     gint n;
+    MidoriLocationGuess* guess = NULL;
 
     stripped_uri = g_strdup (uri);
     g_strstrip (stripped_uri);
     new_uri = sokoke_magic_uri (stripped_uri);
+    if (new_uri && sokoke_magic_uri_needs_lookup (stripped_uri))
+    {
+        /* Navigate right away and confirm the host name meanwhile */
+        guess = g_slice_new (MidoriLocationGuess);
+        guess->view = NULL;
+        guess->uri = g_strdup (new_uri);
+        guess->search_uri = sokoke_search_uri (
+            browser->location_entry_search, stripped_uri);
+    }
     if (!new_uri)
     {
         gchar** parts;
@@ -3525,8 +3535,7 @@ _action_location_submit_uri (GtkAction*     action,
         const gchar* search_uri = NULL;
         time_t now;
         gint64 day;
-        sqlite3* db;
-        static sqlite3_stmt* statement = NULL;
+        MidoriHistoryWriter* writer;
 
         /* Do we have a keyword and a string? */
         parts = g_strsplit (stripped_uri, " ", 2);
@@ -3553,23 +3562,14 @@ _action_location_submit_uri (GtkAction*     action,
         now = time (NULL);
         day = sokoke_time_t_to_julian (&now);
 
-        db = g_object_get_data (G_OBJECT (browser->history), "db");
-        if (!statement)
+        if (browser->history
+         && (writer = g_object_get_data (G_OBJECT (browser->history), "writer")))
         {
-            const gchar* sqlcmd;
-            sqlcmd = "INSERT INTO search (keywords, uri, day) VALUES (?,?,?)";
-            sqlite3_prepare_v2 (db, sqlcmd, strlen (sqlcmd) + 1, &statement, NULL);
+            midori_history_writer_add_search (writer, keywords, search_uri, day);
+            midori_completion_index_add_search (g_object_get_data (
+                G_OBJECT (browser->history), "completion"),
+                search_uri, keywords, now);
         }
-        sqlite3_bind_text (statement, 1, keywords, -1, 0);
-        sqlite3_bind_text (statement, 2, search_uri, -1, 0);
-        sqlite3_bind_int64 (statement, 3, day);
-
-        if (sqlite3_step (statement) != SQLITE_DONE)
-            g_printerr (_("Failed to insert new history item: %s\n"),
-                        sqlite3_errmsg (db));
-        sqlite3_reset (statement);
-        if (sqlite3_step (statement) == SQLITE_DONE)
-            sqlite3_clear_bindings (statement);
 
         g_free (keywords);
     }
@@ -3585,6 +3585,16 @@ _action_location_submit_uri (GtkAction*     action,
         midori_browser_set_current_uri (browser, new_uri);
     g_free (new_uri);
     gtk_widget_grab_focus (midori_browser_get_current_tab (browser));
+
+    if (guess)
+    {
+        guess->view = MIDORI_VIEW (midori_browser_get_current_tab (browser));
+        g_object_add_weak_pointer (G_OBJECT (guess->view),
+                                   (gpointer*)&guess->view);
+        if (!sokoke_prefetch_uri (guess->uri,
+                                  midori_browser_location_guess_cb, guess))
+            midori_browser_location_guess_cb (NULL, SOUP_STATUS_OK, guess);
+    }
 }
 
 static void
@@ -4700,6 +4710,8 @@ gtk_notebook_switch_page_cb (GtkWidget*       notebook,
     if (!(widget = midori_browser_get_current_tab (browser)))
         return;
 
+    midori_browser_set_tab_visible (widget, FALSE);
+
     action = _action_by_name (browser, "Location");
     text = midori_location_action_get_text (MIDORI_LOCATION_ACTION (action));
     g_object_set_data_full (G_OBJECT (widget), "midori-browser-typed-text",
@@ -4722,6 +4734,8 @@ gtk_notebook_switch_page_after_cb (GtkWidget*       notebook,
     if (!(widget = midori_browser_get_current_tab (browser)))
         return;
 
+    midori_browser_set_tab_visible (widget, TRUE);
+
     view = MIDORI_VIEW (widget);
     uri = g_object_get_data (G_OBJECT (widget), "midori-browser-typed-text");
     if (!uri)
@@ -5109,6 +5123,17 @@ midori_browser_window_state_event_cb (MidoriBrowser*       browser,
         window_state = MIDORI_WINDOW_FULLSCREEN;
     g_object_set (browser->settings, "last-window-state", window_state, NULL);
 
+    if (event->changed_mask & GDK_WINDOW_STATE_ICONIFIED)
+    {
+        /* Tabs of a minimized window remain mapped */
+        gboolean iconified = event->new_window_state & GDK_WINDOW_STATE_ICONIFIED;
+        GList* children;
+
+        children = gtk_container_get_children (GTK_CONTAINER (browser->notebook));
+        for (; children; children = g_list_delete_link (children, children))
+            midori_view_set_throttled (children->data, iconified);
+    }
+
     if (event->changed_mask & GDK_WINDOW_STATE_FULLSCREEN)
     {
         if (event->new_window_state & GDK_WINDOW_STATE_FULLSCREEN)
@@ -5183,6 +5208,8 @@ midori_browser_destroy_cb (MidoriBrowser* browser)
         g_source_remove (browser->panel_timeout);
     if (G_UNLIKELY (browser->alloc_timeout))
         g_source_remove (browser->alloc_timeout);
+    if (browser->hibernate_timeout)
+        g_source_remove (browser->hibernate_timeout);
 
     /* Destroy panel first, so panels don't need special care */
     gtk_widget_destroy (browser->panel);
@@ -5346,8 +5373,8 @@ midori_browser_new_history_item (MidoriBrowser* browser,
 {
     time_t now;
     gint64 day;
-    sqlite3* db;
-    static sqlite3_stmt* stmt = NULL;
+    MidoriHistoryWriter* writer;
+    MidoriCompletionIndex* completion;
 
     g_return_if_fail (katze_item_get_uri (item) != NULL);
 
@@ -5355,25 +5382,13 @@ midori_browser_new_history_item (MidoriBrowser* browser,
     katze_item_set_added (item, now);
     day = sokoke_time_t_to_julian (&now);
 
-    db = g_object_get_data (G_OBJECT (browser->history), "db");
-    g_return_if_fail (db != NULL);
-    if (!stmt)
-    {
-        const gchar* sqlcmd;
-
-        sqlcmd = "INSERT INTO history (uri, title, date, day) VALUES (?,?,?,?)";
-        sqlite3_prepare_v2 (db, sqlcmd, -1, &stmt, NULL);
-    }
-    sqlite3_bind_text (stmt, 1, katze_item_get_uri (item), -1, 0);
-    sqlite3_bind_text (stmt, 2, katze_item_get_name (item), -1, 0);
-    sqlite3_bind_int64 (stmt, 3, katze_item_get_added (item));
-    sqlite3_bind_int64 (stmt, 4, day);
-
-    if (sqlite3_step (stmt) != SQLITE_DONE)
-        g_printerr (_("Failed to insert new history item: %s\n"),
-                    sqlite3_errmsg (db));
-    sqlite3_reset (stmt);
-    sqlite3_clear_bindings (stmt);
+    writer = g_object_get_data (G_OBJECT (browser->history), "writer");
+    g_return_if_fail (writer != NULL);
+    midori_history_writer_add_visit (writer, katze_item_get_uri (item),
+        katze_item_get_name (item), katze_item_get_added (item), day);
+    if ((completion = g_object_get_data (G_OBJECT (browser->history), "completion")))
+        midori_completion_index_add_visit (completion, katze_item_get_uri (item),
+            katze_item_get_name (item), katze_item_get_added (item));
 
     /* FIXME: Workaround for the lack of a database interface */
     katze_array_add_item (browser->history, item);
@@ -6225,6 +6240,8 @@ _midori_browser_update_settings (MidoriBrowser* browser)
     _action_set_active (browser, "Panel", show_panel);
     _action_set_active (browser, "Statusbar", browser->show_statusbar);
 
+    midori_browser_update_hibernation (browser);
+
     g_free (toolbar_items);
 }
 
@@ -6290,6 +6307,9 @@ midori_browser_settings_notify (MidoriWebSettings* web_settings,
     }
     else if (name == g_intern_string ("maximum-history-age"))
         browser->maximum_history_age = g_value_get_boolean (&value);
+    else if (name == g_intern_string ("hibernate-tabs-after")
+          || name == g_intern_string ("maximum-loaded-tabs"))
+        midori_browser_update_hibernation (browser);
     else if (name == g_intern_string ("news-aggregator"))
     {
         katze_assign (browser->news_aggregator, g_value_dup_string (&value));
@@ -6718,6 +6738,7 @@ midori_browser_add_item (MidoriBrowser* browser,
                          KatzeItem*     item)
 {
     const gchar* uri;
+    gchar* new_uri;
     const gchar* title;
     GtkWidget* view;
     gint page;
@@ -6738,13 +6759,17 @@ midori_browser_add_item (MidoriBrowser* browser,
     /* Blank pages should not be delayed */
     if (katze_item_get_meta_integer (item, "delay") > 0
      && strcmp (uri, "about:blank") != 0)
-    {
-        gchar* new_uri = g_strdup_printf ("pause:%s", uri);
-        midori_view_set_uri (MIDORI_VIEW (view), new_uri);
-        g_free (new_uri);
-    }
+        new_uri = g_strdup_printf ("pause:%s", uri);
     else
-        midori_view_set_uri (MIDORI_VIEW (view), uri);
+        new_uri = g_strdup (uri);
+
+    /* Tabs restored in the background only load when they are needed */
+    if (g_object_get_data (G_OBJECT (item), "midori-view-defer")
+     && *uri && strcmp (uri, "about:blank") != 0)
+        midori_view_defer_uri (MIDORI_VIEW (view), new_uri);
+    else
+        midori_view_set_uri (MIDORI_VIEW (view), new_uri);
+    g_free (new_uri);
 
     proxy_item = midori_view_get_proxy_item (MIDORI_VIEW (view));
     if ((keys = katze_item_get_meta_keys (item)))
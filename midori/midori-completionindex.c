@@ -0,0 +1,884 @@
+/*
+ Copyright (C) 2010 Christian Dywan <christian@twotoasts.de>
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ See the file COPYING for the full license text.
+*/
+
+#if HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include "midori-completionindex.h"
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <sqlite3.h>
+
+/* The weight of a visit halves every this many days */
+#define FRECENCY_HALF_LIFE 14.0
+/* Bookmarks rank as high as this many recent visits */
+#define BOOKMARK_BOOST 5.0
+/* The julian day of the 1st of January 1970 */
+#define JULIAN_EPOCH 719163
+
+typedef struct
+{
+    const gchar* token;
+    MidoriCompletionEntry* entry;
+} MidoriCompletionToken;
+
+/* Entries by URI and a sorted array of lowercase tokens of the URI
+   and title of each entry, so that all entries with a token
+   starting with a given prefix are one binary search away. */
+typedef struct
+{
+    GHashTable* entries;
+    GArray* tokens;
+    GStringChunk* strings;
+    gboolean sorted;
+} MidoriCompletionTable;
+
+typedef enum
+{
+    MIDORI_COMPLETION_OP_VISIT,
+    MIDORI_COMPLETION_OP_SEARCH,
+    MIDORI_COMPLETION_OP_TITLE,
+    MIDORI_COMPLETION_OP_BOOKMARK,
+    MIDORI_COMPLETION_OP_REMOVE,
+    MIDORI_COMPLETION_OP_CLEAR
+} MidoriCompletionOpType;
+
+typedef struct
+{
+    MidoriCompletionOpType type;
+    gchar* uri;
+    gchar* title;
+    gint64 date;
+} MidoriCompletionOp;
+
+struct _MidoriCompletionIndex
+{
+    gchar* history_filename;
+    gchar* bookmarks_filename;
+
+    MidoriCompletionTable* table;
+    guint serial;
+    /* Changes made while the table is being built */
+    GQueue* pending;
+
+    GThread* thread;
+    GMutex* mutex;
+    MidoriCompletionTable* built;
+    guint install_id;
+};
+
+static void
+midori_completion_entry_free (MidoriCompletionEntry* entry)
+{
+    g_free (entry->uri);
+    g_free (entry->title);
+    g_free (entry->haystack);
+    g_slice_free (MidoriCompletionEntry, entry);
+}
+
+static MidoriCompletionTable*
+midori_completion_table_new (void)
+{
+    MidoriCompletionTable* table = g_slice_new (MidoriCompletionTable);
+    table->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+        NULL, (GDestroyNotify)midori_completion_entry_free);
+    table->tokens = g_array_new (FALSE, FALSE, sizeof (MidoriCompletionToken));
+    table->strings = g_string_chunk_new (4096);
+    table->sorted = TRUE;
+    return table;
+}
+
+static void
+midori_completion_table_free (MidoriCompletionTable* table)
+{
+    g_hash_table_destroy (table->entries);
+    g_array_free (table->tokens, TRUE);
+    g_string_chunk_free (table->strings);
+    g_slice_free (MidoriCompletionTable, table);
+}
+
+static inline gboolean
+midori_completion_is_token_char (gchar c)
+{
+    /* Like the simple tokenizer of SQLite, see sokoke_fts_prefix_query */
+    return g_ascii_isalnum (c) || (guchar)c >= 0x80;
+}
+
+static gint
+midori_completion_compare_strings (gconstpointer a,
+                                   gconstpointer b)
+{
+    return strcmp (*(const gchar**)a, *(const gchar**)b);
+}
+
+/* Returns the distinct tokens of a lowercase string, sorted */
+static GPtrArray*
+midori_completion_tokenize (const gchar* text)
+{
+    GPtrArray* tokens = g_ptr_array_new ();
+    const gchar* start = NULL;
+    const gchar* p;
+    guint i, j;
+
+    for (p = text; ; p++)
+    {
+        gboolean token_char = *p && midori_completion_is_token_char (*p);
+        if (token_char && !start)
+            start = p;
+        else if (!token_char && start)
+        {
+            g_ptr_array_add (tokens, g_strndup (start, p - start));
+            start = NULL;
+        }
+        if (!*p)
+            break;
+    }
+
+    g_ptr_array_sort (tokens, midori_completion_compare_strings);
+    for (i = j = 0; i < tokens->len; i++)
+    {
+        if (j && !strcmp (tokens->pdata[i], tokens->pdata[j - 1]))
+            g_free (tokens->pdata[i]);
+        else
+            tokens->pdata[j++] = tokens->pdata[i];
+    }
+    g_ptr_array_set_size (tokens, j);
+    return tokens;
+}
+
+static void
+midori_completion_tokens_free (GPtrArray* tokens)
+{
+    g_ptr_array_foreach (tokens, (GFunc)g_free, NULL);
+    g_ptr_array_free (tokens, TRUE);
+}
+
+static gchar*
+midori_completion_haystack (const gchar* uri,
+                            const gchar* title)
+{
+    const gchar* scheme_end;
+    gchar* text;
+    gchar* haystack;
+
+    /* Every URI would match the scheme and www */
+    if ((scheme_end = strstr (uri, "://")) && scheme_end - uri < 10)
+        uri = scheme_end + 3;
+    if (g_str_has_prefix (uri, "www."))
+        uri = &uri[4];
+
+    text = g_strconcat (uri, " ", title, NULL);
+    haystack = g_utf8_strdown (text, -1);
+    g_free (text);
+    return haystack;
+}
+
+/* Index of the first token not sorting before @prefix */
+static guint
+midori_completion_table_lower_bound (MidoriCompletionTable* table,
+                                     const gchar*           prefix)
+{
+    guint lower = 0;
+    guint upper = table->tokens->len;
+
+    while (lower < upper)
+    {
+        guint middle = lower + (upper - lower) / 2;
+        MidoriCompletionToken* token = &g_array_index (table->tokens,
+            MidoriCompletionToken, middle);
+        if (strcmp (token->token, prefix) < 0)
+            lower = middle + 1;
+        else
+            upper = middle;
+    }
+    return lower;
+}
+
+static void
+midori_completion_table_add_tokens (MidoriCompletionTable* table,
+                                    MidoriCompletionEntry* entry)
+{
+    GPtrArray* tokens;
+    guint i;
+
+    tokens = midori_completion_tokenize (entry->haystack);
+    for (i = 0; i < tokens->len; i++)
+    {
+        MidoriCompletionToken token;
+        token.token = g_string_chunk_insert_const (table->strings,
+                                                   tokens->pdata[i]);
+        token.entry = entry;
+        if (table->sorted)
+            g_array_insert_val (table->tokens,
+                midori_completion_table_lower_bound (table, token.token), token);
+        else
+            g_array_append_val (table->tokens, token);
+    }
+    midori_completion_tokens_free (tokens);
+}
+
+static void
+midori_completion_table_index_entry (MidoriCompletionTable* table,
+                                     MidoriCompletionEntry* entry)
+{
+    g_free (entry->haystack);
+    entry->haystack = midori_completion_haystack (entry->uri, entry->title);
+    /* While building, entries are indexed and sorted once at the end,
+       with their final titles */
+    if (table->sorted)
+        midori_completion_table_add_tokens (table, entry);
+}
+
+static void
+midori_completion_table_unindex_entry (MidoriCompletionTable* table,
+                                       MidoriCompletionEntry* entry)
+{
+    GPtrArray* tokens;
+    guint i;
+
+    /* Tokens aren't sorted, nor even added, while building */
+    if (!entry->haystack || !table->sorted)
+        return;
+
+    tokens = midori_completion_tokenize (entry->haystack);
+    for (i = 0; i < tokens->len; i++)
+    {
+        guint j = midori_completion_table_lower_bound (table, tokens->pdata[i]);
+        for (; j < table->tokens->len; j++)
+        {
+            MidoriCompletionToken* token = &g_array_index (table->tokens,
+                MidoriCompletionToken, j);
+            if (strcmp (token->token, tokens->pdata[i]))
+                break;
+            if (token->entry == entry)
+            {
+                g_array_remove_index (table->tokens, j);
+                break;
+            }
+        }
+    }
+    midori_completion_tokens_free (tokens);
+}
+
+static MidoriCompletionEntry*
+midori_completion_table_ensure_entry (MidoriCompletionTable* table,
+                                      const gchar*           uri,
+                                      const gchar*           title)
+{
+    MidoriCompletionEntry* entry = g_hash_table_lookup (table->entries, uri);
+
+    if (entry)
+    {
+        if (title && *title && g_strcmp0 (title, entry->title))
+        {
+            midori_completion_table_unindex_entry (table, entry);
+            g_free (entry->title);
+            entry->title = g_strdup (title);
+            midori_completion_table_index_entry (table, entry);
+        }
+        return entry;
+    }
+
+    entry = g_slice_new0 (MidoriCompletionEntry);
+    entry->uri = g_strdup (uri);
+    entry->title = g_strdup (title);
+    g_hash_table_insert (table->entries, entry->uri, entry);
+    midori_completion_table_index_entry (table, entry);
+    return entry;
+}
+
+static void
+midori_completion_table_remove (MidoriCompletionTable* table,
+                                const gchar*           uri)
+{
+    MidoriCompletionEntry* entry = g_hash_table_lookup (table->entries, uri);
+
+    if (!entry)
+        return;
+    midori_completion_table_unindex_entry (table, entry);
+    g_hash_table_remove (table->entries, uri);
+}
+
+static void
+midori_completion_table_sort (MidoriCompletionTable* table)
+{
+    GHashTableIter iter;
+    MidoriCompletionEntry* entry;
+
+    g_hash_table_iter_init (&iter, table->entries);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer*)&entry))
+        midori_completion_table_add_tokens (table, entry);
+    g_array_sort (table->tokens, midori_completion_compare_strings);
+    table->sorted = TRUE;
+}
+
+static void
+midori_completion_index_apply (MidoriCompletionIndex* index,
+                               MidoriCompletionOp*    op)
+{
+    MidoriCompletionTable* table = index->table;
+    MidoriCompletionEntry* entry;
+
+    switch (op->type)
+    {
+    case MIDORI_COMPLETION_OP_VISIT:
+        entry = midori_completion_table_ensure_entry (table, op->uri, op->title);
+        entry->visits++;
+        entry->last_visit = MAX (entry->last_visit, op->date);
+        break;
+    case MIDORI_COMPLETION_OP_SEARCH:
+        /* Keywords are only a title for a page that has none */
+        entry = midori_completion_table_ensure_entry (table, op->uri,
+            g_hash_table_lookup (table->entries, op->uri) ? NULL : op->title);
+        entry->search = TRUE;
+        entry->visits++;
+        entry->last_visit = MAX (entry->last_visit, op->date);
+        break;
+    case MIDORI_COMPLETION_OP_TITLE:
+        if (g_hash_table_lookup (table->entries, op->uri))
+            midori_completion_table_ensure_entry (table, op->uri, op->title);
+        break;
+    case MIDORI_COMPLETION_OP_BOOKMARK:
+        /* A date of 1 adds the bookmark, 0 removes it */
+        if (op->date)
+        {
+            entry = midori_completion_table_ensure_entry (table, op->uri,
+                g_hash_table_lookup (table->entries, op->uri) ? NULL : op->title);
+            entry->bookmark = TRUE;
+        }
+        else if ((entry = g_hash_table_lookup (table->entries, op->uri)))
+        {
+            entry->bookmark = FALSE;
+            if (!entry->visits)
+                midori_completion_table_remove (table, op->uri);
+        }
+        break;
+    case MIDORI_COMPLETION_OP_REMOVE:
+        entry = g_hash_table_lookup (table->entries, op->uri);
+        /* Bookmarks stay, they aren't part of the history */
+        if (entry && entry->bookmark)
+        {
+            entry->visits = 0;
+            entry->last_visit = 0;
+            entry->search = FALSE;
+        }
+        else
+            midori_completion_table_remove (table, op->uri);
+        break;
+    case MIDORI_COMPLETION_OP_CLEAR:
+    {
+        GHashTableIter iter;
+
+        index->table = midori_completion_table_new ();
+        g_hash_table_iter_init (&iter, table->entries);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer*)&entry))
+            if (entry->bookmark)
+                midori_completion_table_ensure_entry (index->table,
+                    entry->uri, entry->title)->bookmark = TRUE;
+        midori_completion_table_free (table);
+        break;
+    }
+    default:
+        g_warn_if_reached ();
+    }
+}
+
+static void
+midori_completion_op_free (MidoriCompletionOp* op)
+{
+    g_free (op->uri);
+    g_free (op->title);
+    g_slice_free (MidoriCompletionOp, op);
+}
+
+static void
+midori_completion_index_push (MidoriCompletionIndex* index,
+                              MidoriCompletionOpType type,
+                              const gchar*           uri,
+                              const gchar*           title,
+                              gint64                 date)
+{
+    MidoriCompletionOp* op = g_slice_new (MidoriCompletionOp);
+    op->type = type;
+    op->uri = g_strdup (uri);
+    op->title = g_strdup (title);
+    op->date = date;
+
+    /* Replayed once the table that is being built is installed */
+    if (!index->table)
+    {
+        g_queue_push_tail (index->pending, op);
+        return;
+    }
+
+    midori_completion_index_apply (index, op);
+    midori_completion_op_free (op);
+}
+
+static void
+midori_completion_index_read_history (MidoriCompletionTable* table,
+                                      const gchar*           filename)
+{
+    sqlite3* db;
+    sqlite3_stmt* stmt;
+
+    if (sqlite3_open_v2 (filename, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        sqlite3_close (db);
+        return;
+    }
+
+    if (sqlite3_prepare_v2 (db,
+        "SELECT uri, title, visit_count, last_visit FROM urls",
+        -1, &stmt, NULL) == SQLITE_OK)
+    {
+        while (sqlite3_step (stmt) == SQLITE_ROW)
+        {
+            MidoriCompletionEntry* entry = midori_completion_table_ensure_entry (
+                table, (const gchar*)sqlite3_column_text (stmt, 0),
+                (const gchar*)sqlite3_column_text (stmt, 1));
+            entry->visits = sqlite3_column_int (stmt, 2);
+            entry->last_visit = sqlite3_column_int64 (stmt, 3);
+        }
+        sqlite3_finalize (stmt);
+    }
+
+    /* Searches are stored per day, the time of day is lost */
+    if (sqlite3_prepare_v2 (db,
+        "SELECT replace (uri, '%s', keywords), keywords, count (), max (day) "
+        "FROM search GROUP BY uri, keywords",
+        -1, &stmt, NULL) == SQLITE_OK)
+    {
+        while (sqlite3_step (stmt) == SQLITE_ROW)
+        {
+            const gchar* uri = (const gchar*)sqlite3_column_text (stmt, 0);
+            MidoriCompletionEntry* entry = g_hash_table_lookup (table->entries, uri);
+            gint64 date = (sqlite3_column_int64 (stmt, 3) - JULIAN_EPOCH) * 86400;
+            if (!entry)
+                entry = midori_completion_table_ensure_entry (table, uri,
+                    (const gchar*)sqlite3_column_text (stmt, 1));
+            entry->search = TRUE;
+            entry->visits += sqlite3_column_int (stmt, 2);
+            entry->last_visit = MAX (entry->last_visit, date);
+        }
+        sqlite3_finalize (stmt);
+    }
+
+    sqlite3_close (db);
+}
+
+static void
+midori_completion_index_read_bookmarks (MidoriCompletionTable* table,
+                                        const gchar*           filename)
+{
+    sqlite3* db;
+    sqlite3_stmt* stmt;
+
+    if (sqlite3_open_v2 (filename, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        sqlite3_close (db);
+        return;
+    }
+
+    if (sqlite3_prepare_v2 (db,
+        "SELECT uri, title FROM bookmarks WHERE uri != ''",
+        -1, &stmt, NULL) == SQLITE_OK)
+    {
+        while (sqlite3_step (stmt) == SQLITE_ROW)
+        {
+            const gchar* uri = (const gchar*)sqlite3_column_text (stmt, 0);
+            MidoriCompletionEntry* entry = g_hash_table_lookup (table->entries, uri);
+            if (!entry)
+                entry = midori_completion_table_ensure_entry (table, uri,
+                    (const gchar*)sqlite3_column_text (stmt, 1));
+            entry->bookmark = TRUE;
+        }
+        sqlite3_finalize (stmt);
+    }
+
+    sqlite3_close (db);
+}
+
+static gboolean
+midori_completion_index_install_cb (gpointer data)
+{
+    MidoriCompletionIndex* index = data;
+    MidoriCompletionOp* op;
+
+    g_mutex_lock (index->mutex);
+    index->table = index->built;
+    index->built = NULL;
+    index->install_id = 0;
+    g_mutex_unlock (index->mutex);
+
+    while ((op = g_queue_pop_head (index->pending)))
+    {
+        midori_completion_index_apply (index, op);
+        midori_completion_op_free (op);
+    }
+    return FALSE;
+}
+
+static gpointer
+midori_completion_index_build (gpointer data)
+{
+    MidoriCompletionIndex* index = data;
+    MidoriCompletionTable* table = midori_completion_table_new ();
+
+    table->sorted = FALSE;
+    midori_completion_index_read_history (table, index->history_filename);
+    if (index->bookmarks_filename)
+        midori_completion_index_read_bookmarks (table, index->bookmarks_filename);
+    midori_completion_table_sort (table);
+
+    g_mutex_lock (index->mutex);
+    index->built = table;
+    index->install_id = g_idle_add (midori_completion_index_install_cb, index);
+    g_mutex_unlock (index->mutex);
+    return NULL;
+}
+
+/**
+ * midori_completion_index_new:
+ * @history_filename: the history database
+ * @bookmarks_filename: the bookmarks database, or %NULL
+ *
+ * Creates an in-memory index of history, searches and bookmarks,
+ * which is read from the databases in a background thread.
+ *
+ * Until the index is ready, changes are remembered and lookups
+ * fail so that the caller can query the database instead.
+ *
+ * Return value: a new #MidoriCompletionIndex
+ **/
+MidoriCompletionIndex*
+midori_completion_index_new (const gchar* history_filename,
+                             const gchar* bookmarks_filename)
+{
+    MidoriCompletionIndex* index;
+
+    g_return_val_if_fail (history_filename != NULL, NULL);
+
+    index = g_slice_new0 (MidoriCompletionIndex);
+    index->history_filename = g_strdup (history_filename);
+    index->bookmarks_filename = g_strdup (bookmarks_filename);
+    index->pending = g_queue_new ();
+    index->mutex = g_mutex_new ();
+    index->thread = g_thread_create (midori_completion_index_build,
+                                     index, TRUE, NULL);
+    if (!index->thread)
+        index->table = midori_completion_table_new ();
+    return index;
+}
+
+/**
+ * midori_completion_index_is_ready:
+ * @index: a #MidoriCompletionIndex
+ *
+ * Determines whether the index has been read and can be used.
+ *
+ * Return value: %TRUE if the index is ready
+ **/
+gboolean
+midori_completion_index_is_ready (MidoriCompletionIndex* index)
+{
+    g_return_val_if_fail (index != NULL, FALSE);
+
+    return index->table != NULL;
+}
+
+typedef struct
+{
+    MidoriCompletionEntry* entry;
+    gdouble score;
+} MidoriCompletionMatch;
+
+static gdouble
+midori_completion_entry_score (MidoriCompletionEntry* entry,
+                               gint64                 now)
+{
+    gdouble age = MAX (now - entry->last_visit, 0) / 86400.0;
+    gdouble score = entry->visits * pow (0.5, age / FRECENCY_HALF_LIFE);
+    return entry->bookmark ? score + BOOKMARK_BOOST : score;
+}
+
+static gboolean
+midori_completion_entry_has_prefix (MidoriCompletionEntry* entry,
+                                    const gchar*           prefix)
+{
+    const gchar* haystack = entry->haystack;
+    const gchar* p = haystack;
+
+    while ((p = strstr (p, prefix)))
+    {
+        if (p == haystack || !midori_completion_is_token_char (p[-1]))
+            return TRUE;
+        p++;
+    }
+    return FALSE;
+}
+
+/**
+ * midori_completion_index_lookup:
+ * @index: a #MidoriCompletionIndex
+ * @key: the text typed by the user
+ * @max_items: the maximum number of matches
+ *
+ * Looks up entries of which the URI or title contain words
+ * starting with each of the words of @key, ranked by how
+ * often and how recently they were visited.
+ *
+ * The entries are owned by the index and only valid until
+ * the next change to it.
+ *
+ * Return value: a new array of #MidoriCompletionEntry, or %NULL
+ *     if the index isn't ready
+ **/
+GPtrArray*
+midori_completion_index_lookup (MidoriCompletionIndex* index,
+                                const gchar*           key,
+                                guint                  max_items)
+{
+    MidoriCompletionTable* table;
+    gchar* lowered;
+    GPtrArray* words;
+    GArray* matches;
+    GPtrArray* entries;
+    const gchar* pivot;
+    gint64 now;
+    guint i, j;
+
+    g_return_val_if_fail (index != NULL, NULL);
+    g_return_val_if_fail (key != NULL, NULL);
+
+    if (!(table = index->table))
+        return NULL;
+
+    lowered = g_utf8_strdown (key, -1);
+    words = midori_completion_tokenize (lowered);
+    g_free (lowered);
+    entries = g_ptr_array_new ();
+    if (!words->len || !max_items)
+    {
+        midori_completion_tokens_free (words);
+        return entries;
+    }
+
+    /* The longest word narrows down the candidates the most */
+    pivot = words->pdata[0];
+    for (i = 1; i < words->len; i++)
+        if (strlen (words->pdata[i]) > strlen (pivot))
+            pivot = words->pdata[i];
+
+    /* An entry may have several tokens starting with the pivot */
+    index->serial++;
+    now = time (NULL);
+    matches = g_array_sized_new (FALSE, FALSE,
+        sizeof (MidoriCompletionMatch), max_items + 1);
+    for (i = midori_completion_table_lower_bound (table, pivot);
+         i < table->tokens->len; i++)
+    {
+        MidoriCompletionToken* token = &g_array_index (table->tokens,
+            MidoriCompletionToken, i);
+        MidoriCompletionMatch match;
+
+        if (!g_str_has_prefix (token->token, pivot))
+            break;
+        if (token->entry->serial == index->serial)
+            continue;
+        token->entry->serial = index->serial;
+
+        for (j = 0; j < words->len; j++)
+            if (words->pdata[j] != pivot
+             && !midori_completion_entry_has_prefix (token->entry, words->pdata[j]))
+                break;
+        if (j < words->len)
+            continue;
+
+        /* Keep the best matches sorted by descending score */
+        match.entry = token->entry;
+        match.score = midori_completion_entry_score (token->entry, now);
+        for (j = matches->len; j > 0; j--)
+            if (g_array_index (matches, MidoriCompletionMatch, j - 1).score >= match.score)
+                break;
+        if (j < max_items)
+        {
+            g_array_insert_val (matches, j, match);
+            if (matches->len > max_items)
+                g_array_set_size (matches, max_items);
+        }
+    }
+
+    for (i = 0; i < matches->len; i++)
+        g_ptr_array_add (entries,
+            g_array_index (matches, MidoriCompletionMatch, i).entry);
+    g_array_free (matches, TRUE);
+    midori_completion_tokens_free (words);
+    return entries;
+}
+
+/**
+ * midori_completion_index_add_visit:
+ * @index: a #MidoriCompletionIndex
+ * @uri: the visited URI
+ * @title: the title, or %NULL
+ * @date: the time of the visit
+ *
+ * Adds a visit of a page to the index.
+ **/
+void
+midori_completion_index_add_visit (MidoriCompletionIndex* index,
+                                   const gchar*           uri,
+                                   const gchar*           title,
+                                   gint64                 date)
+{
+    g_return_if_fail (index != NULL);
+    g_return_if_fail (uri != NULL);
+
+    midori_completion_index_push (index, MIDORI_COMPLETION_OP_VISIT,
+                                  uri, title, date);
+}
+
+/**
+ * midori_completion_index_add_search:
+ * @index: a #MidoriCompletionIndex
+ * @uri: the URI of the search engine
+ * @keywords: the search keywords
+ * @date: the time of the search
+ *
+ * Adds a web search to the index.
+ **/
+void
+midori_completion_index_add_search (MidoriCompletionIndex* index,
+                                    const gchar*           uri,
+                                    const gchar*           keywords,
+                                    gint64                 date)
+{
+    gchar** parts;
+    gchar* search_uri;
+
+    g_return_if_fail (index != NULL);
+    g_return_if_fail (uri != NULL);
+    g_return_if_fail (keywords != NULL);
+
+    /* Same as replace () in the query reading the search table */
+    parts = g_strsplit (uri, "%s", -1);
+    search_uri = g_strjoinv (keywords, parts);
+    g_strfreev (parts);
+    midori_completion_index_push (index, MIDORI_COMPLETION_OP_SEARCH,
+                                  search_uri, keywords, date);
+    g_free (search_uri);
+}
+
+/**
+ * midori_completion_index_set_title:
+ * @index: a #MidoriCompletionIndex
+ * @uri: a visited URI
+ * @title: the new title
+ *
+ * Updates the title of a page in the index.
+ **/
+void
+midori_completion_index_set_title (MidoriCompletionIndex* index,
+                                   const gchar*           uri,
+                                   const gchar*           title)
+{
+    g_return_if_fail (index != NULL);
+    g_return_if_fail (uri != NULL);
+
+    midori_completion_index_push (index, MIDORI_COMPLETION_OP_TITLE,
+                                  uri, title, 0);
+}
+
+/**
+ * midori_completion_index_set_bookmark:
+ * @index: a #MidoriCompletionIndex
+ * @uri: the URI of the bookmark
+ * @title: the title of the bookmark
+ * @bookmark: %TRUE if it was added, %FALSE if it was removed
+ *
+ * Adds or removes a bookmark in the index.
+ **/
+void
+midori_completion_index_set_bookmark (MidoriCompletionIndex* index,
+                                      const gchar*           uri,
+                                      const gchar*           title,
+                                      gboolean               bookmark)
+{
+    g_return_if_fail (index != NULL);
+    g_return_if_fail (uri != NULL);
+
+    midori_completion_index_push (index, MIDORI_COMPLETION_OP_BOOKMARK,
+                                  uri, title, bookmark ? 1 : 0);
+}
+
+/**
+ * midori_completion_index_remove:
+ * @index: a #MidoriCompletionIndex
+ * @uri: a visited URI
+ *
+ * Removes all visits of a page from the index.
+ **/
+void
+midori_completion_index_remove (MidoriCompletionIndex* index,
+                                const gchar*           uri)
+{
+    g_return_if_fail (index != NULL);
+    g_return_if_fail (uri != NULL);
+
+    midori_completion_index_push (index, MIDORI_COMPLETION_OP_REMOVE,
+                                  uri, NULL, 0);
+}
+
+/**
+ * midori_completion_index_clear:
+ * @index: a #MidoriCompletionIndex
+ *
+ * Removes all history and searches, but not bookmarks, from the index.
+ **/
+void
+midori_completion_index_clear (MidoriCompletionIndex* index)
+{
+    g_return_if_fail (index != NULL);
+
+    midori_completion_index_push (index, MIDORI_COMPLETION_OP_CLEAR,
+                                  NULL, NULL, 0);
+}
+
+/**
+ * midori_completion_index_free:
+ * @index: a #MidoriCompletionIndex
+ *
+ * Frees the index, waiting for it to be read if needed.
+ **/
+void
+midori_completion_index_free (MidoriCompletionIndex* index)
+{
+    g_return_if_fail (index != NULL);
+
+    if (index->thread)
+        g_thread_join (index->thread);
+    if (index->install_id)
+        g_source_remove (index->install_id);
+    if (index->built)
+        midori_completion_table_free (index->built);
+    if (index->table)
+        midori_completion_table_free (index->table);
+    g_queue_foreach (index->pending, (GFunc)midori_completion_op_free, NULL);
+    g_queue_free (index->pending);
+    g_mutex_free (index->mutex);
+    g_free (index->history_filename);
+    g_free (index->bookmarks_filename);
+    g_slice_free (MidoriCompletionIndex, index);
+}
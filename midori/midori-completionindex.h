@@ -0,0 +1,82 @@
+/*
+ Copyright (C) 2010 Christian Dywan <christian@twotoasts.de>
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ See the file COPYING for the full license text.
+*/
+
+#ifndef __MIDORI_COMPLETION_INDEX_H__
+#define __MIDORI_COMPLETION_INDEX_H__ 1
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MidoriCompletionIndex MidoriCompletionIndex;
+
+typedef struct
+{
+    gchar* uri;
+    gchar* title;
+    guint visits;
+    gint64 last_visit;
+    gboolean bookmark;
+    gboolean search;
+
+    /*< private >*/
+    gchar* haystack;
+    guint serial;
+} MidoriCompletionEntry;
+
+MidoriCompletionIndex*
+midori_completion_index_new          (const gchar*           history_filename,
+                                      const gchar*           bookmarks_filename);
+
+gboolean
+midori_completion_index_is_ready     (MidoriCompletionIndex* index);
+
+GPtrArray*
+midori_completion_index_lookup       (MidoriCompletionIndex* index,
+                                      const gchar*           key,
+                                      guint                  max_items);
+
+void
+midori_completion_index_add_visit    (MidoriCompletionIndex* index,
+                                      const gchar*           uri,
+                                      const gchar*           title,
+                                      gint64                 date);
+
+void
+midori_completion_index_add_search   (MidoriCompletionIndex* index,
+                                      const gchar*           uri,
+                                      const gchar*           keywords,
+                                      gint64                 date);
+
+void
+midori_completion_index_set_title    (MidoriCompletionIndex* index,
+                                      const gchar*           uri,
+                                      const gchar*           title);
+
+void
+midori_completion_index_set_bookmark (MidoriCompletionIndex* index,
+                                      const gchar*           uri,
+                                      const gchar*           title,
+                                      gboolean               bookmark);
+
+void
+midori_completion_index_remove       (MidoriCompletionIndex* index,
+                                      const gchar*           uri);
+
+void
+midori_completion_index_clear        (MidoriCompletionIndex* index);
+
+void
+midori_completion_index_free         (MidoriCompletionIndex* index);
+
+G_END_DECLS
+
+#endif /* !__MIDORI_COMPLETION_INDEX_H__ */
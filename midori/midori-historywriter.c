@@ -0,0 +1,459 @@
+/*
+ Copyright (C) 2010 Christian Dywan <christian@twotoasts.de>
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ See the file COPYING for the full license text.
+*/
+
+#if HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include "midori-historywriter.h"
+
+#include "sokoke.h"
+
+#include <glib/gi18n.h>
+#include <sqlite3.h>
+
+/* Writes arriving within this many milliseconds share one transaction */
+#define BATCH_INTERVAL 300
+/* Number of expired visits removed in one transaction */
+#define EXPIRY_BATCH 500
+
+typedef enum
+{
+    MIDORI_HISTORY_OP_VISIT,
+    MIDORI_HISTORY_OP_TITLE,
+    MIDORI_HISTORY_OP_SEARCH,
+    MIDORI_HISTORY_OP_EXEC,
+    MIDORI_HISTORY_OP_MAINTAIN,
+    MIDORI_HISTORY_OP_EXPIRE,
+    MIDORI_HISTORY_OP_FLUSH,
+    MIDORI_HISTORY_OP_QUIT
+} MidoriHistoryOpType;
+
+typedef struct
+{
+    MidoriHistoryOpType type;
+    gchar* uri;
+    gchar* title;
+    gint64 date;
+    gint64 day;
+} MidoriHistoryOp;
+
+struct _MidoriHistoryWriter
+{
+    sqlite3* db;
+    sqlite3_stmt* url_stmt;
+    sqlite3_stmt* visit_stmt;
+    sqlite3_stmt* title_stmt;
+    sqlite3_stmt* search_stmt;
+    sqlite3_stmt* expire_stmt;
+    sqlite3_stmt* expire_search_stmt;
+
+    GThread* thread;
+    GAsyncQueue* queue;
+
+    GMutex* flush_mutex;
+    GCond* flush_cond;
+    guint flush_requests;
+    guint flushed;
+};
+
+static void
+midori_history_op_free (MidoriHistoryOp* op)
+{
+    g_free (op->uri);
+    g_free (op->title);
+    g_slice_free (MidoriHistoryOp, op);
+}
+
+static void
+midori_history_writer_push (MidoriHistoryWriter* writer,
+                            MidoriHistoryOpType  type,
+                            const gchar*         uri,
+                            const gchar*         title,
+                            gint64               date,
+                            gint64               day)
+{
+    MidoriHistoryOp* op = g_slice_new (MidoriHistoryOp);
+    op->type = type;
+    op->uri = g_strdup (uri);
+    op->title = g_strdup (title);
+    op->date = date;
+    op->day = day;
+    g_async_queue_push (writer->queue, op);
+}
+
+static gboolean
+midori_history_writer_step (MidoriHistoryWriter* writer,
+                            sqlite3_stmt*        stmt)
+{
+    gint result = sqlite3_step (stmt);
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    return result == SQLITE_DONE;
+}
+
+static void
+midori_history_writer_run (MidoriHistoryWriter* writer,
+                           MidoriHistoryOp*     op)
+{
+    char* errmsg = NULL;
+
+    switch (op->type)
+    {
+    case MIDORI_HISTORY_OP_VISIT:
+        sqlite3_bind_text (writer->url_stmt, 1, op->uri, -1, SQLITE_STATIC);
+        sqlite3_bind_text (writer->url_stmt, 2, op->title, -1, SQLITE_STATIC);
+        sqlite3_bind_text (writer->visit_stmt, 1, op->uri, -1, SQLITE_STATIC);
+        sqlite3_bind_int64 (writer->visit_stmt, 2, op->date);
+        sqlite3_bind_int64 (writer->visit_stmt, 3, op->day);
+        if (!midori_history_writer_step (writer, writer->url_stmt)
+         || !midori_history_writer_step (writer, writer->visit_stmt))
+            g_printerr (_("Failed to insert new history item: %s\n"),
+                        sqlite3_errmsg (writer->db));
+        break;
+    case MIDORI_HISTORY_OP_TITLE:
+        sqlite3_bind_text (writer->title_stmt, 1, op->title, -1, SQLITE_STATIC);
+        sqlite3_bind_text (writer->title_stmt, 2, op->uri, -1, SQLITE_STATIC);
+        if (!midori_history_writer_step (writer, writer->title_stmt))
+            g_printerr (_("Failed to update title: %s\n"),
+                        sqlite3_errmsg (writer->db));
+        break;
+    case MIDORI_HISTORY_OP_SEARCH:
+        sqlite3_bind_text (writer->search_stmt, 1, op->title, -1, SQLITE_STATIC);
+        sqlite3_bind_text (writer->search_stmt, 2, op->uri, -1, SQLITE_STATIC);
+        sqlite3_bind_int64 (writer->search_stmt, 3, op->day);
+        if (!midori_history_writer_step (writer, writer->search_stmt))
+            g_printerr (_("Failed to insert new history item: %s\n"),
+                        sqlite3_errmsg (writer->db));
+        break;
+    case MIDORI_HISTORY_OP_EXEC:
+        if (sqlite3_exec (writer->db, op->uri, NULL, NULL, &errmsg) != SQLITE_OK)
+        {
+            g_printerr (_("Failed to remove history item: %s\n"), errmsg);
+            sqlite3_free (errmsg);
+        }
+        break;
+    case MIDORI_HISTORY_OP_MAINTAIN:
+        /* A vacuum can't run inside of the batch transaction */
+        sqlite3_exec (writer->db, "COMMIT;", NULL, NULL, NULL);
+        sokoke_maintain_database (writer->db);
+        sqlite3_exec (writer->db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+        break;
+    case MIDORI_HISTORY_OP_EXPIRE:
+    {
+        gint changes;
+
+        sqlite3_bind_int64 (writer->expire_stmt, 1, op->day);
+        sqlite3_bind_int64 (writer->expire_stmt, 2, EXPIRY_BATCH);
+        sqlite3_bind_int64 (writer->expire_search_stmt, 1, op->day);
+        sqlite3_bind_int64 (writer->expire_search_stmt, 2, EXPIRY_BATCH);
+        if (!midori_history_writer_step (writer, writer->expire_stmt))
+        {
+            /* i18n: Couldn't remove items that are older than n days */
+            g_printerr (_("Failed to remove old history items: %s\n"),
+                        sqlite3_errmsg (writer->db));
+            break;
+        }
+        changes = sqlite3_changes (writer->db);
+        midori_history_writer_step (writer, writer->expire_search_stmt);
+        changes = MAX (changes, sqlite3_changes (writer->db));
+        /* Continue with the next batch after pending writes */
+        if (changes == EXPIRY_BATCH)
+            midori_history_writer_push (writer, MIDORI_HISTORY_OP_EXPIRE,
+                                        NULL, NULL, 0, op->day);
+        break;
+    }
+    default:
+        g_warn_if_reached ();
+    }
+}
+
+static gpointer
+midori_history_writer_thread (gpointer data)
+{
+    MidoriHistoryWriter* writer = data;
+    gboolean running = TRUE;
+
+    while (running)
+    {
+        MidoriHistoryOp* op;
+        GTimeVal deadline;
+        gboolean flush = FALSE;
+
+        /* Sleep until there is something to write, then collect
+           everything arriving shortly after into one transaction */
+        op = g_async_queue_pop (writer->queue);
+        g_get_current_time (&deadline);
+        g_time_val_add (&deadline, BATCH_INTERVAL * 1000);
+        sqlite3_exec (writer->db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+        do
+        {
+            if (op->type == MIDORI_HISTORY_OP_QUIT)
+                running = FALSE;
+            else if (op->type == MIDORI_HISTORY_OP_FLUSH)
+                flush = TRUE;
+            else
+                midori_history_writer_run (writer, op);
+            midori_history_op_free (op);
+        }
+        while (running && !flush
+            && (op = g_async_queue_timed_pop (writer->queue, &deadline)));
+        sqlite3_exec (writer->db, "COMMIT;", NULL, NULL, NULL);
+
+        if (flush)
+        {
+            g_mutex_lock (writer->flush_mutex);
+            writer->flushed++;
+            g_cond_broadcast (writer->flush_cond);
+            g_mutex_unlock (writer->flush_mutex);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * midori_history_writer_new:
+ * @filename: the history database, with tables already created
+ * @errmsg: location for an error message, or %NULL
+ *
+ * Opens a second connection to the history database and starts
+ * a thread writing new visits, titles and searches in batches,
+ * so that the user interface never waits for the disk.
+ *
+ * Return value: a new #MidoriHistoryWriter, or %NULL
+ **/
+MidoriHistoryWriter*
+midori_history_writer_new (const gchar* filename,
+                           char**       errmsg)
+{
+    MidoriHistoryWriter* writer;
+    sqlite3* db;
+
+    if (!(db = sokoke_open_database (filename, errmsg)))
+        return NULL;
+    sqlite3_busy_timeout (db, 5000);
+
+    writer = g_slice_new0 (MidoriHistoryWriter);
+    writer->db = db;
+    sqlite3_prepare_v2 (db,
+        "INSERT OR IGNORE INTO urls (uri, title) VALUES (?,?)",
+        -1, &writer->url_stmt, NULL);
+    /* The visit count of the page is updated by a trigger */
+    sqlite3_prepare_v2 (db,
+        "INSERT INTO visits (url, date, day) "
+        "SELECT id, ?2, ?3 FROM urls WHERE uri = ?1",
+        -1, &writer->visit_stmt, NULL);
+    sqlite3_prepare_v2 (db,
+        "UPDATE urls SET title = ? WHERE uri = ?",
+        -1, &writer->title_stmt, NULL);
+    sqlite3_prepare_v2 (db,
+        "INSERT INTO search (keywords, uri, day) VALUES (?,?,?)",
+        -1, &writer->search_stmt, NULL);
+    /* Visits and searches before the day ?1 days ago expire, oldest
+       first, comparing the indexed date and day against a cutoff */
+    sqlite3_prepare_v2 (db,
+        "DELETE FROM visits WHERE rowid IN (SELECT rowid FROM visits "
+        "WHERE date < CAST (strftime ('%s', 'now', 'start of day', "
+        "                             (1 - ?1) || ' days') AS integer) "
+        "ORDER BY date LIMIT ?2)",
+        -1, &writer->expire_stmt, NULL);
+    sqlite3_prepare_v2 (db,
+        "DELETE FROM search WHERE rowid IN (SELECT rowid FROM search "
+        "WHERE day < julianday ('now', 'start of day', (1 - ?1) || ' days') "
+        "          - julianday ('0001-01-01') + 1 "
+        "LIMIT ?2)",
+        -1, &writer->expire_search_stmt, NULL);
+
+    writer->queue = g_async_queue_new ();
+    writer->flush_mutex = g_mutex_new ();
+    writer->flush_cond = g_cond_new ();
+    writer->thread = g_thread_create (midori_history_writer_thread,
+                                      writer, TRUE, NULL);
+    return writer;
+}
+
+/**
+ * midori_history_writer_add_visit:
+ * @writer: a #MidoriHistoryWriter
+ * @uri: the URI of the page
+ * @title: the title of the page, or %NULL
+ * @date: the time of the visit
+ * @day: the julian day of the visit
+ *
+ * Queues a visit of a page, adding the page if it's new.
+ **/
+void
+midori_history_writer_add_visit (MidoriHistoryWriter* writer,
+                                 const gchar*         uri,
+                                 const gchar*         title,
+                                 gint64               date,
+                                 gint64               day)
+{
+    g_return_if_fail (writer != NULL);
+    g_return_if_fail (uri != NULL);
+
+    midori_history_writer_push (writer, MIDORI_HISTORY_OP_VISIT,
+                                uri, title, date, day);
+}
+
+/**
+ * midori_history_writer_set_title:
+ * @writer: a #MidoriHistoryWriter
+ * @uri: the URI of the page
+ * @title: the new title
+ *
+ * Queues an update of the title of a page.
+ **/
+void
+midori_history_writer_set_title (MidoriHistoryWriter* writer,
+                                 const gchar*         uri,
+                                 const gchar*         title)
+{
+    g_return_if_fail (writer != NULL);
+    g_return_if_fail (uri != NULL);
+
+    midori_history_writer_push (writer, MIDORI_HISTORY_OP_TITLE,
+                                uri, title, 0, 0);
+}
+
+/**
+ * midori_history_writer_add_search:
+ * @writer: a #MidoriHistoryWriter
+ * @keywords: the search terms
+ * @uri: the URI of the search engine
+ * @day: the julian day of the search
+ *
+ * Queues a search.
+ **/
+void
+midori_history_writer_add_search (MidoriHistoryWriter* writer,
+                                  const gchar*         keywords,
+                                  const gchar*         uri,
+                                  gint64               day)
+{
+    g_return_if_fail (writer != NULL);
+    g_return_if_fail (keywords != NULL);
+
+    midori_history_writer_push (writer, MIDORI_HISTORY_OP_SEARCH,
+                                uri, keywords, 0, day);
+}
+
+/**
+ * midori_history_writer_exec:
+ * @writer: a #MidoriHistoryWriter
+ * @sqlcmd: SQL statements
+ *
+ * Queues arbitrary statements, such as removing items, so
+ * that they are applied in order with pending writes.
+ **/
+void
+midori_history_writer_exec (MidoriHistoryWriter* writer,
+                            const gchar*         sqlcmd)
+{
+    g_return_if_fail (writer != NULL);
+    g_return_if_fail (sqlcmd != NULL);
+
+    midori_history_writer_push (writer, MIDORI_HISTORY_OP_EXEC,
+                                sqlcmd, NULL, 0, 0);
+}
+
+/**
+ * midori_history_writer_maintain:
+ * @writer: a #MidoriHistoryWriter
+ *
+ * Queues incremental vacuuming and optimization of the database.
+ **/
+void
+midori_history_writer_maintain (MidoriHistoryWriter* writer)
+{
+    g_return_if_fail (writer != NULL);
+
+    midori_history_writer_push (writer, MIDORI_HISTORY_OP_MAINTAIN,
+                                NULL, NULL, 0, 0);
+}
+
+/**
+ * midori_history_writer_expire:
+ * @writer: a #MidoriHistoryWriter
+ * @max_history_age: the number of days to keep
+ *
+ * Queues removal of visits and searches older than @max_history_age
+ * days. They are removed in small batches, each batch queued again
+ * behind writes that are pending by then, so that new writes aren't
+ * held up by a large expiry. A batch may share a transaction with
+ * writes that arrive in the same interval.
+ **/
+void
+midori_history_writer_expire (MidoriHistoryWriter* writer,
+                              gint                 max_history_age)
+{
+    g_return_if_fail (writer != NULL);
+
+    midori_history_writer_push (writer, MIDORI_HISTORY_OP_EXPIRE,
+                                NULL, NULL, 0, max_history_age);
+}
+
+/**
+ * midori_history_writer_flush:
+ * @writer: a #MidoriHistoryWriter
+ *
+ * Blocks until all queued writes are committed.
+ **/
+void
+midori_history_writer_flush (MidoriHistoryWriter* writer)
+{
+    guint request;
+
+    g_return_if_fail (writer != NULL);
+
+    g_mutex_lock (writer->flush_mutex);
+    request = ++writer->flush_requests;
+    midori_history_writer_push (writer, MIDORI_HISTORY_OP_FLUSH,
+                                NULL, NULL, 0, 0);
+    while (writer->flushed < request)
+        g_cond_wait (writer->flush_cond, writer->flush_mutex);
+    g_mutex_unlock (writer->flush_mutex);
+}
+
+/**
+ * midori_history_writer_free:
+ * @writer: a #MidoriHistoryWriter
+ *
+ * Commits all queued writes, stops the thread and
+ * closes the connection.
+ **/
+void
+midori_history_writer_free (MidoriHistoryWriter* writer)
+{
+    MidoriHistoryOp* op;
+
+    g_return_if_fail (writer != NULL);
+
+    midori_history_writer_push (writer, MIDORI_HISTORY_OP_QUIT,
+                                NULL, NULL, 0, 0);
+    g_thread_join (writer->thread);
+    /* Unfinished expiry is resumed on the next start */
+    while ((op = g_async_queue_try_pop (writer->queue)))
+        midori_history_op_free (op);
+
+    sqlite3_finalize (writer->url_stmt);
+    sqlite3_finalize (writer->visit_stmt);
+    sqlite3_finalize (writer->title_stmt);
+    sqlite3_finalize (writer->search_stmt);
+    sqlite3_finalize (writer->expire_stmt);
+    sqlite3_finalize (writer->expire_search_stmt);
+    sqlite3_close (writer->db);
+    g_async_queue_unref (writer->queue);
+    g_mutex_free (writer->flush_mutex);
+    g_cond_free (writer->flush_cond);
+    g_slice_free (MidoriHistoryWriter, writer);
+}
@@ -0,0 +1,62 @@
+/*
+ Copyright (C) 2010 Christian Dywan <christian@twotoasts.de>
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ See the file COPYING for the full license text.
+*/
+
+#ifndef __MIDORI_HISTORY_WRITER_H__
+#define __MIDORI_HISTORY_WRITER_H__ 1
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MidoriHistoryWriter MidoriHistoryWriter;
+
+MidoriHistoryWriter*
+midori_history_writer_new       (const gchar*         filename,
+                                 char**               errmsg);
+
+void
+midori_history_writer_add_visit (MidoriHistoryWriter* writer,
+                                 const gchar*         uri,
+                                 const gchar*         title,
+                                 gint64               date,
+                                 gint64               day);
+
+void
+midori_history_writer_set_title (MidoriHistoryWriter* writer,
+                                 const gchar*         uri,
+                                 const gchar*         title);
+
+void
+midori_history_writer_add_search (MidoriHistoryWriter* writer,
+                                  const gchar*         keywords,
+                                  const gchar*         uri,
+                                  gint64               day);
+
+void
+midori_history_writer_exec      (MidoriHistoryWriter* writer,
+                                 const gchar*         sqlcmd);
+
+void
+midori_history_writer_maintain  (MidoriHistoryWriter* writer);
+
+void
+midori_history_writer_expire    (MidoriHistoryWriter* writer,
+                                 gint                 max_history_age);
+
+void
+midori_history_writer_flush     (MidoriHistoryWriter* writer);
+
+void
+midori_history_writer_free      (MidoriHistoryWriter* writer);
+
+G_END_DECLS
+
+#endif /* !__MIDORI_HISTORY_WRITER_H__ */
@@ -16,6 +16,8 @@
 #include "marshal.h"
 #include "sokoke.h"
 #include "midori-browser.h"
+#include "midori-completionindex.h"
+#include "midori-historywriter.h"
 
 #include <string.h>
 #include <glib/gi18n.h>
@@ -25,6 +27,8 @@
 
 #define COMPLETION_DELAY 200
 #define MAX_ITEMS 25
+/* Hosts of the topmost matches are resolved in advance */
+#define PREFETCH_ITEMS 3
 
 struct _MidoriLocationAction
 {
@@ -37,6 +41,11 @@ struct _MidoriLocationAction
     gchar* secondary_icon;
 
     guint completion_timeout;
+    volatile gint completion_generation;
+    GThread* completion_thread;
+    GAsyncQueue* completion_queue;
+    gchar* history_filename;
+    gchar* bookmarks_filename;
     gchar* key;
     GtkWidget* popup;
     GtkWidget* treeview;
@@ -86,6 +95,7 @@ enum
     YALIGN_COL,
     BACKGROUND_COL,
     STYLE_COL,
+    MARKUP_COL,
     N_COLS
 };
 
@@ -118,12 +128,13 @@ static void
 midori_location_action_disconnect_proxy (GtkAction* action,
                                          GtkWidget* proxy);
 
-static void
-midori_location_entry_render_text_cb (GtkCellLayout*   layout,
-                                      GtkCellRenderer* renderer,
-                                      GtkTreeModel*    model,
-                                      GtkTreeIter*     iter,
-                                      gpointer         data);
+static gchar*
+midori_location_action_row_markup (gchar**      keys,
+                                   const gchar* uri_escaped,
+                                   const gchar* title);
+
+static gchar**
+midori_location_action_split_key (MidoriLocationAction* action);
 
 static void
 midori_location_action_popdown_completion (MidoriLocationAction* location_action);
@@ -268,7 +279,7 @@ midori_location_action_create_model (void)
     GtkTreeModel* model = (GtkTreeModel*) gtk_list_store_new (N_COLS,
         GDK_TYPE_PIXBUF, G_TYPE_STRING, G_TYPE_STRING,
         G_TYPE_INT, G_TYPE_BOOLEAN, G_TYPE_FLOAT,
-        GDK_TYPE_COLOR, G_TYPE_BOOLEAN);
+        GDK_TYPE_COLOR, G_TYPE_BOOLEAN, G_TYPE_STRING);
     return model;
 }
 
@@ -333,68 +344,81 @@ midori_location_action_treeview_button_press_cb (GtkWidget*            treeview,
     return FALSE;
 }
 
-static gboolean
-midori_location_action_popup_timeout_cb (gpointer data)
+static void
+midori_location_action_insert_match (MidoriLocationAction*  action,
+                                     GtkListStore*          store,
+                                     gint                   position,
+                                     gchar**                keys,
+                                     MidoriCompletionEntry* entry)
 {
-    MidoriLocationAction* action = data;
-    GtkTreeViewColumn* column;
-    GtkListStore* store;
-    gchar* effective_key;
-    gint i;
-    gint result;
-    static sqlite3_stmt* stmt;
-    const gchar* sqlcmd;
-    gint matches, searches, height, screen_height, browser_height, sep;
-    MidoriBrowser* browser;
-    GtkStyle* style;
-
-    if (!action->entry || !gtk_widget_has_focus (action->entry) || !action->history)
-        return FALSE;
-
-    if (!(action->key && *action->key))
+    GdkPixbuf* icon = katze_load_cached_icon (entry->uri, NULL);
+    if (!icon)
+        icon = action->default_icon;
+    if (!entry->search /* history_view */)
     {
-        midori_location_action_popdown_completion (action);
-        return FALSE;
+        gchar* markup = midori_location_action_row_markup (keys,
+            entry->uri, entry->title);
+        gtk_list_store_insert_with_values (store, NULL, position,
+            URI_COL, entry->uri, TITLE_COL, entry->title, YALIGN_COL, 0.25,
+            MARKUP_COL, markup, FAVICON_COL, icon, -1);
+        g_free (markup);
     }
-
-    if (!stmt)
+    else /* search_view */
     {
-        sqlite3* db;
-        db = g_object_get_data (G_OBJECT (action->history), "db");
-        sqlcmd = "SELECT type, uri, title FROM ("
-                 "  SELECT 1 AS type, uri, title, count() AS ct FROM history "
-                 "      WHERE uri LIKE ?1 OR title LIKE ?1 GROUP BY uri "
-                 "  UNION ALL "
-                 "  SELECT 2 AS type, replace(uri, '%s', keywords) AS uri, "
-                 "      keywords AS title, count() AS ct FROM search "
-                 "      WHERE uri LIKE ?1 OR title LIKE ?1 GROUP BY uri "
-                 "  UNION ALL "
-                 "  SELECT 1 AS type, uri, title, 50 AS ct FROM bookmarks "
-                 "      WHERE title LIKE ?1 OR uri LIKE ?1 AND uri !='' "
-                 ") GROUP BY uri ORDER BY ct DESC LIMIT ?2";
-        sqlite3_prepare_v2 (db, sqlcmd, strlen (sqlcmd) + 1, &stmt, NULL);
+        gchar* search_title = g_strdup_printf (_("Search for %s"), entry->title);
+        gchar* markup = g_markup_escape_text (search_title, -1);
+        gtk_list_store_insert_with_values (store, NULL, position,
+            URI_COL, entry->uri, TITLE_COL, search_title, YALIGN_COL, 0.25,
+            MARKUP_COL, markup, STYLE_COL, 1, FAVICON_COL, icon, -1);
+        g_free (markup);
+        g_free (search_title);
     }
-    effective_key = g_strdup_printf ("%%%s%%", action->key);
-    i = 0;
-    do
+}
+
+static void
+midori_location_action_render_icon_cb (GtkCellLayout*   layout,
+                                       GtkCellRenderer* renderer,
+                                       GtkTreeModel*    model,
+                                       GtkTreeIter*     iter,
+                                       GtkWidget*       widget)
+{
+    MidoriLocationAction* action;
+    GdkPixbuf* icon;
+    gchar* uri;
+
+    action = g_object_get_data (G_OBJECT (renderer), "location-action");
+    gtk_tree_model_get (model, iter, URI_COL, &uri, FAVICON_COL, &icon, -1);
+    /* Icons are loaded in the background, the row is drawn again then */
+    if (uri && icon && icon == action->default_icon)
     {
-        if (effective_key[i] == ' ')
-            effective_key[i] = '%';
-        i++;
+        GdkPixbuf* cached = katze_load_cached_icon (uri, widget);
+        if (cached)
+        {
+            g_object_set (renderer, "pixbuf", cached, NULL);
+            g_object_unref (cached);
+        }
     }
-    while (effective_key[i] != '\0');
-    sqlite3_bind_text (stmt, 1, effective_key, -1, g_free);
-    sqlite3_bind_int64 (stmt, 2, MAX_ITEMS);
+    if (icon)
+        g_object_unref (icon);
+    g_free (uri);
+}
 
-    result = sqlite3_step (stmt);
-    if (result != SQLITE_ROW && !action->search_engines)
+static void
+midori_location_action_show_matches (MidoriLocationAction* action,
+                                     GPtrArray*            entries)
+{
+    GtkTreeViewColumn* column;
+    GtkListStore* store;
+    gint i;
+    gchar** keys;
+    gint matches, searches, height, screen_height, browser_height, sep;
+    MidoriBrowser* browser;
+    GtkStyle* style;
+
+    if (!entries->len && !action->search_engines)
     {
-        if (result == SQLITE_ERROR)
-            g_print (_("Failed to select from history\n"));
-        sqlite3_reset (stmt);
-        sqlite3_clear_bindings (stmt);
         midori_location_action_popdown_completion (action);
-        return FALSE;
+        return;
     }
 
     if (G_UNLIKELY (!action->popup))
@@ -431,21 +455,25 @@ midori_location_action_popup_timeout_cb (gpointer data)
 
         column = gtk_tree_view_column_new ();
         renderer = gtk_cell_renderer_pixbuf_new ();
+        g_object_set_data (G_OBJECT (renderer), "location-action", action);
         gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (column), renderer, FALSE);
         gtk_cell_layout_set_attributes (GTK_CELL_LAYOUT (column), renderer,
             "pixbuf", FAVICON_COL, "yalign", YALIGN_COL,
             "cell-background-gdk", BACKGROUND_COL,
             NULL);
+        gtk_cell_layout_set_cell_data_func (GTK_CELL_LAYOUT (column), renderer,
+            (GtkCellLayoutDataFunc)midori_location_action_render_icon_cb,
+            treeview, NULL);
         renderer = gtk_cell_renderer_text_new ();
         g_object_set_data (G_OBJECT (renderer), "location-action", action);
         gtk_cell_renderer_set_fixed_size (renderer, 1, -1);
         gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (column), renderer, TRUE);
+        g_object_set (renderer,
+            "ellipsize-set", TRUE, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
         gtk_cell_layout_set_attributes (GTK_CELL_LAYOUT (column), renderer,
+            "markup", MARKUP_COL,
             "cell-background-gdk", BACKGROUND_COL,
             NULL);
-        gtk_cell_layout_set_cell_data_func (GTK_CELL_LAYOUT (column), renderer,
-                                            midori_location_entry_render_text_cb,
-                                            action, NULL);
         gtk_tree_view_append_column (GTK_TREE_VIEW (treeview), column);
 
         action->popup = popup;
@@ -458,34 +486,16 @@ midori_location_action_popup_timeout_cb (gpointer data)
 
     matches = searches = 0;
     style = gtk_widget_get_style (action->treeview);
-    while (result == SQLITE_ROW)
+    keys = midori_location_action_split_key (action);
+    for (i = 0; i < (gint)entries->len; i++)
     {
-        sqlite3_int64 type = sqlite3_column_int64 (stmt, 0);
-        const unsigned char* uri = sqlite3_column_text (stmt, 1);
-        const unsigned char* title = sqlite3_column_text (stmt, 2);
-        GdkPixbuf* icon = katze_load_cached_icon ((gchar*)uri, NULL);
-        if (!icon)
-            icon = action->default_icon;
-        if (type == 1 /* history_view */)
-        {
-            gtk_list_store_insert_with_values (store, NULL, matches,
-                URI_COL, uri, TITLE_COL, title, YALIGN_COL, 0.25,
-                FAVICON_COL, icon, -1);
-        }
-        else if (type == 2 /* search_view */)
-        {
-            gchar* search_title = g_strdup_printf (_("Search for %s"), title);
-            gtk_list_store_insert_with_values (store, NULL, matches,
-                URI_COL, uri, TITLE_COL, search_title, YALIGN_COL, 0.25,
-                STYLE_COL, 1, FAVICON_COL, icon, -1);
-            g_free (search_title);
-        }
-
+        MidoriCompletionEntry* entry = g_ptr_array_index (entries, i);
+        midori_location_action_insert_match (action, store, matches, keys, entry);
+        if (i < PREFETCH_ITEMS && !entry->search)
+            sokoke_prefetch_uri (entry->uri, NULL, NULL);
         matches++;
-        result = sqlite3_step (stmt);
     }
-    sqlite3_reset (stmt);
-    sqlite3_clear_bindings (stmt);
+    g_strfreev (keys);
 
     if (action->search_engines)
     {
@@ -495,15 +505,18 @@ midori_location_action_popup_timeout_cb (gpointer data)
         {
             gchar* uri;
             gchar* title;
+            gchar* markup;
 
             uri = sokoke_search_uri (katze_item_get_uri (item), action->key);
             title = g_strdup_printf (_("Search with %s"), katze_item_get_name (item));
+            markup = g_markup_escape_text (title, -1);
             gtk_list_store_insert_with_values (store, NULL, matches + i,
                 URI_COL, uri, TITLE_COL, title, YALIGN_COL, 0.25,
                 BACKGROUND_COL, style ? &style->bg[GTK_STATE_NORMAL] : NULL,
-                STYLE_COL, 1, FAVICON_COL, NULL, -1);
+                MARKUP_COL, markup, STYLE_COL, 1, FAVICON_COL, NULL, -1);
             g_free (uri);
             g_free (title);
+            g_free (markup);
             i++;
             if (i > 4)
                 break;
@@ -533,10 +546,276 @@ midori_location_action_popup_timeout_cb (gpointer data)
     gtk_widget_set_size_request (action->treeview, -1, height);
     midori_location_action_popup_position (action->popup, action->entry);
     gtk_widget_show_all (action->popup);
+}
+
+typedef struct
+{
+    MidoriLocationAction* action;
+    gint generation;
+    gchar* key;
+    GPtrArray* entries;
+} MidoriCompletionQuery;
+
+static void
+midori_completion_query_free (MidoriCompletionQuery* query)
+{
+    guint i;
+
+    if (query->entries)
+    {
+        for (i = 0; i < query->entries->len; i++)
+        {
+            MidoriCompletionEntry* entry = g_ptr_array_index (query->entries, i);
+            g_free (entry->uri);
+            g_free (entry->title);
+            g_slice_free (MidoriCompletionEntry, entry);
+        }
+        g_ptr_array_free (query->entries, TRUE);
+    }
+    g_free (query->key);
+    g_slice_free (MidoriCompletionQuery, query);
+}
+
+static gboolean
+midori_completion_query_is_stale (MidoriCompletionQuery* query)
+{
+    return query->generation
+        != g_atomic_int_get (&query->action->completion_generation);
+}
+
+static int
+midori_completion_query_progress_cb (void* data)
+{
+    /* A non-zero value interrupts the statement */
+    return midori_completion_query_is_stale (data);
+}
+
+static sqlite3*
+midori_location_action_completion_open (MidoriLocationAction* action,
+                                        sqlite3_stmt**        stmt)
+{
+    sqlite3* db;
+    const gchar* sqlcmd;
+
+    if (sqlite3_open_v2 (action->history_filename, &db,
+                         SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        g_printerr (_("Failed to open database: %s\n"), sqlite3_errmsg (db));
+        sqlite3_close (db);
+        return NULL;
+    }
+    sqlite3_busy_timeout (db, 1000);
+    if (action->bookmarks_filename)
+    {
+        gchar* sql = sqlite3_mprintf ("ATTACH DATABASE '%q' AS bookmarks",
+                                      action->bookmarks_filename);
+        sqlite3_exec (db, sql, NULL, NULL, NULL);
+        sqlite3_free (sql);
+    }
+
+    /* ?1 is a full text query for history and searches,
+       the few bookmarks are matched with a LIKE pattern in ?3 */
+    sqlcmd = "SELECT type, uri, title FROM ("
+             "  SELECT 1 AS type, uri, title, visit_count AS ct FROM urls "
+             "      WHERE id IN (SELECT docid FROM urls_fts "
+             "                   WHERE urls_fts MATCH ?1) "
+             "  UNION ALL "
+             "  SELECT 2 AS type, replace(uri, '%s', keywords) AS uri, "
+             "      keywords AS title, count() AS ct FROM search "
+             "      WHERE rowid IN (SELECT docid FROM search_fts "
+             "                      WHERE search_fts MATCH ?1) GROUP BY uri "
+             "  UNION ALL "
+             "  SELECT 1 AS type, uri, title, 50 AS ct FROM bookmarks "
+             "      WHERE title LIKE ?3 OR uri LIKE ?3 AND uri !='' "
+             ") GROUP BY uri ORDER BY ct DESC LIMIT ?2";
+    if (sqlite3_prepare_v2 (db, sqlcmd, -1, stmt, NULL) != SQLITE_OK)
+    {
+        /* No full text index, SQLite may be built without FTS3 */
+        sqlcmd = "SELECT type, uri, title FROM ("
+                 "  SELECT 1 AS type, uri, title, visit_count AS ct FROM urls "
+                 "      WHERE uri LIKE ?3 OR title LIKE ?3 "
+                 "  UNION ALL "
+                 "  SELECT 2 AS type, replace(uri, '%s', keywords) AS uri, "
+                 "      keywords AS title, count() AS ct FROM search "
+                 "      WHERE uri LIKE ?3 OR title LIKE ?3 GROUP BY uri "
+                 "  UNION ALL "
+                 "  SELECT 1 AS type, uri, title, 50 AS ct FROM bookmarks "
+                 "      WHERE title LIKE ?3 OR uri LIKE ?3 AND uri !='' "
+                 ") GROUP BY uri ORDER BY ct DESC LIMIT ?2";
+        if (sqlite3_prepare_v2 (db, sqlcmd, -1, stmt, NULL) != SQLITE_OK)
+        {
+            g_printerr (_("Failed to select from history\n"));
+            sqlite3_close (db);
+            return NULL;
+        }
+    }
+    return db;
+}
+
+static void
+midori_completion_query_run (MidoriCompletionQuery* query,
+                             sqlite3*               db,
+                             sqlite3_stmt*          stmt)
+{
+    gchar* effective_key;
+    gchar* match_key;
+    gint i;
+    gint result;
+
+    effective_key = g_strdup_printf ("%%%s%%", query->key);
+    i = 0;
+    do
+    {
+        if (effective_key[i] == ' ')
+            effective_key[i] = '%';
+        i++;
+    }
+    while (effective_key[i] != '\0');
+    match_key = sokoke_fts_prefix_query (query->key);
+    sqlite3_bind_text (stmt, 1, match_key ? match_key : g_strdup (""), -1, g_free);
+    sqlite3_bind_int64 (stmt, 2, MAX_ITEMS);
+    sqlite3_bind_text (stmt, 3, effective_key, -1, g_free);
+
+    sqlite3_progress_handler (db, 1000, midori_completion_query_progress_cb, query);
+    query->entries = g_ptr_array_new ();
+    while ((result = sqlite3_step (stmt)) == SQLITE_ROW)
+    {
+        MidoriCompletionEntry* entry = g_slice_new0 (MidoriCompletionEntry);
+        entry->search = sqlite3_column_int64 (stmt, 0) == 2;
+        entry->uri = g_strdup ((const gchar*)sqlite3_column_text (stmt, 1));
+        entry->title = g_strdup ((const gchar*)sqlite3_column_text (stmt, 2));
+        g_ptr_array_add (query->entries, entry);
+    }
+    if (result == SQLITE_ERROR)
+        g_print (_("Failed to select from history\n"));
+    sqlite3_progress_handler (db, 0, NULL, NULL);
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+}
+
+static gboolean
+midori_completion_query_done_cb (gpointer data)
+{
+    MidoriCompletionQuery* query = data;
+    MidoriLocationAction* action = query->action;
+
+    /* Results for anything but the latest key are dropped */
+    if (!midori_completion_query_is_stale (query) && query->entries
+     && action->entry && gtk_widget_has_focus (action->entry)
+     && action->key && *action->key)
+        midori_location_action_show_matches (action, query->entries);
 
+    midori_completion_query_free (query);
+    g_object_unref (action);
     return FALSE;
 }
 
+static gpointer
+midori_location_action_completion_thread (gpointer data)
+{
+    MidoriLocationAction* action = data;
+    MidoriCompletionQuery* query;
+    sqlite3* db = NULL;
+    sqlite3_stmt* stmt = NULL;
+
+    /* A query without a key asks the thread to quit */
+    while ((query = g_async_queue_pop (action->completion_queue))->key)
+    {
+        /* A newer key was typed while this query was queued */
+        if (!midori_completion_query_is_stale (query)
+         && (db || (db = midori_location_action_completion_open (action, &stmt))))
+            midori_completion_query_run (query, db, stmt);
+        g_idle_add (midori_completion_query_done_cb, query);
+    }
+    midori_completion_query_free (query);
+
+    if (db)
+    {
+        sqlite3_finalize (stmt);
+        sqlite3_close (db);
+    }
+    return NULL;
+}
+
+static gboolean
+midori_location_action_completion_start (MidoriLocationAction* action)
+{
+    sqlite3* db = g_object_get_data (G_OBJECT (action->history), "db");
+    sqlite3_stmt* stmt;
+
+    if (!db)
+        return FALSE;
+
+    /* The worker opens its own connection to the same files */
+    if (sqlite3_prepare_v2 (db, "PRAGMA database_list", -1, &stmt, NULL) != SQLITE_OK)
+        return FALSE;
+    while (sqlite3_step (stmt) == SQLITE_ROW)
+    {
+        const gchar* name = (const gchar*)sqlite3_column_text (stmt, 1);
+        const gchar* filename = (const gchar*)sqlite3_column_text (stmt, 2);
+        if (!g_strcmp0 (name, "main"))
+            katze_assign (action->history_filename, g_strdup (filename));
+        else if (!g_strcmp0 (name, "bookmarks"))
+            katze_assign (action->bookmarks_filename, g_strdup (filename));
+    }
+    sqlite3_finalize (stmt);
+    if (!(action->history_filename && *action->history_filename))
+        return FALSE;
+
+    action->completion_queue = g_async_queue_new ();
+    action->completion_thread = g_thread_create (
+        midori_location_action_completion_thread, action, TRUE, NULL);
+    if (!action->completion_thread)
+    {
+        g_async_queue_unref (action->completion_queue);
+        action->completion_queue = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean
+midori_location_action_popup_timeout_cb (gpointer data)
+{
+    MidoriLocationAction* action = data;
+    MidoriCompletionIndex* completion;
+    GPtrArray* entries;
+    MidoriCompletionQuery* query;
+
+    action->completion_timeout = 0;
+
+    if (!action->entry || !gtk_widget_has_focus (action->entry) || !action->history)
+        return FALSE;
+
+    if (!(action->key && *action->key))
+    {
+        midori_location_action_popdown_completion (action);
+        return FALSE;
+    }
+
+    /* The in-memory index answers without touching the database,
+       until it is ready the query runs in a separate thread */
+    completion = g_object_get_data (G_OBJECT (action->history), "completion");
+    if (completion
+     && (entries = midori_completion_index_lookup (completion, action->key, MAX_ITEMS)))
+    {
+        midori_location_action_show_matches (action, entries);
+        g_ptr_array_free (entries, TRUE);
+        return FALSE;
+    }
+
+    if (!action->completion_thread && !midori_location_action_completion_start (action))
+        return FALSE;
+
+    query = g_slice_new0 (MidoriCompletionQuery);
+    query->action = g_object_ref (action);
+    query->generation = g_atomic_int_get (&action->completion_generation);
+    query->key = g_strdup (action->key);
+    g_async_queue_push (action->completion_queue, query);
+    return FALSE;
+}
+
+
 static void
 midori_location_action_popup_completion (MidoriLocationAction* action,
                                          GtkWidget*            entry,
@@ -544,6 +823,8 @@ midori_location_action_popup_completion (MidoriLocationAction* action,
 {
     if (action->completion_timeout)
         g_source_remove (action->completion_timeout);
+    /* Cancels any query for the previous key */
+    g_atomic_int_inc (&action->completion_generation);
     katze_assign (action->key, key);
     action->entry = entry;
     g_signal_connect (entry, "destroy",
@@ -567,6 +848,7 @@ midori_location_action_popdown_completion (MidoriLocationAction* location_action
         g_source_remove (location_action->completion_timeout);
         location_action->completion_timeout = 0;
     }
+    g_atomic_int_inc (&location_action->completion_generation);
     location_action->completion_index = -1;
 }
 
@@ -593,6 +875,11 @@ midori_location_action_init (MidoriLocationAction* location_action)
     location_action->popup = NULL;
     location_action->entry = NULL;
     location_action->history = NULL;
+    location_action->completion_generation = 0;
+    location_action->completion_thread = NULL;
+    location_action->completion_queue = NULL;
+    location_action->history_filename = NULL;
+    location_action->bookmarks_filename = NULL;
 }
 
 static void
@@ -613,6 +900,17 @@ midori_location_action_finalize (GObject* object)
     katze_object_assign (location_action->default_icon, NULL);
     katze_object_assign (location_action->history, NULL);
 
+    /* Pending queries hold a reference, so the queue is empty here */
+    if (location_action->completion_thread)
+    {
+        g_async_queue_push (location_action->completion_queue,
+                            g_slice_new0 (MidoriCompletionQuery));
+        g_thread_join (location_action->completion_thread);
+        g_async_queue_unref (location_action->completion_queue);
+    }
+    katze_assign (location_action->history_filename, NULL);
+    katze_assign (location_action->bookmarks_filename, NULL);
+
     G_OBJECT_CLASS (midori_location_action_parent_class)->finalize (object);
 }
 
@@ -629,7 +927,7 @@ midori_location_action_toggle_arrow_cb (GtkWidget*            widget,
     if (location_action->history != NULL)
     {
         sqlite3* db = g_object_get_data (G_OBJECT (location_action->history), "db");
-        const char* sqlcmd = "SELECT uri FROM history LIMIT 1";
+        const char* sqlcmd = "SELECT uri FROM urls LIMIT 1";
         sqlite3_stmt* statement;
         sqlite3_prepare_v2 (db, sqlcmd, -1, &statement, NULL);
         result = sqlite3_step (statement);
@@ -908,26 +1206,27 @@ midori_location_action_key_press_event_cb (GtkEntry*    entry,
             {
                 gchar* uri;
                 gchar* sqlcmd;
-                sqlite3* db;
-                gchar* errmsg;
-                gint result;
-
-                gtk_tree_model_get (model, &iter, URI_COL, &uri, -1);
-                sqlcmd = sqlite3_mprintf ("DELETE FROM history "
-                                          "WHERE uri = '%q'", uri);
-                g_free (uri);
-                db = g_object_get_data (G_OBJECT (location_action->history), "db");
-                result = sqlite3_exec (db, sqlcmd, NULL, NULL, &errmsg);
-                sqlite3_free (sqlcmd);
-                if (result == SQLITE_ERROR)
+                MidoriHistoryWriter* writer;
+                MidoriCompletionIndex* completion;
+                gboolean style;
+
+                gtk_tree_model_get (model, &iter, URI_COL, &uri,
+                                    STYLE_COL, &style, -1);
+                /* Only history items can be deleted, not searches */
+                if (style)
                 {
-                    gtk_list_store_set (GTK_LIST_STORE (model), &iter,
-                                        URI_COL, errmsg, -1);
-                    sqlite3_free (errmsg);
+                    g_free (uri);
                     break;
                 }
-                if (result != SQLITE_OK || sqlite3_changes (db) == 0)
-                    break;
+                sqlcmd = sqlite3_mprintf ("DELETE FROM visits WHERE url = "
+                    "(SELECT id FROM urls WHERE uri = '%q')", uri);
+                writer = g_object_get_data (G_OBJECT (location_action->history), "writer");
+                midori_history_writer_exec (writer, sqlcmd);
+                sqlite3_free (sqlcmd);
+                if ((completion = g_object_get_data (
+                    G_OBJECT (location_action->history), "completion")))
+                    midori_completion_index_remove (completion, uri);
+                g_free (uri);
                 if (!gtk_list_store_remove (GTK_LIST_STORE (model), &iter))
                 {
                     midori_location_action_popdown_completion (location_action);
@@ -1058,28 +1357,16 @@ midori_location_action_icon_released_cb (GtkWidget*           widget,
     }
 }
 
-static void
-midori_location_entry_render_text_cb (GtkCellLayout*   layout,
-                                      GtkCellRenderer* renderer,
-                                      GtkTreeModel*    model,
-                                      GtkTreeIter*     iter,
-                                      gpointer         data)
+static gchar*
+midori_location_action_highlight (gchar**      keys,
+                                  const gchar* text)
 {
-    MidoriLocationAction* action = data;
-    gchar* uri_escaped;
-    gchar* uri;
-    gchar* title;
-    gboolean style;
     gchar* desc;
-    gchar* desc_uri;
     gchar* desc_iter;
     gchar* temp_iter;
-    gchar* desc_title;
-    const gchar* str;
+    gchar* start;
     gchar* key;
-    gchar** keys;
     gint key_idx;
-    gchar* start;
     gchar* skey;
     gchar* temp;
     gchar* temp_concat;
@@ -1087,144 +1374,78 @@ midori_location_entry_render_text_cb (GtkCellLayout*   layout,
     gchar** parts;
     size_t offset;
 
-    gtk_tree_model_get (model, iter, URI_COL, &uri_escaped, TITLE_COL, &title,
-        STYLE_COL, &style, -1);
-
-    if (style) /* A search engine action */
-    {
-        g_object_set (renderer, "text", title,
-            "ellipsize-set", TRUE, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
-        g_free (uri_escaped);
-        g_free (title);
-        return;
-    }
-
-    desc = desc_uri = desc_title = key = NULL;
-    if (action->key)
-        str = action->key;
-    else
-        str = "";
-
-    key = g_utf8_strdown (str, -1);
-    keys = g_strsplit_set (key, " %", -1);
-    g_free (key);
-
-    uri = sokoke_uri_unescape_string (uri_escaped);
-    g_free (uri_escaped);
-
-    if (G_LIKELY (uri))
+    desc = NULL;
+    temp_iter = temp = g_utf8_strdown (text, -1);
+    desc_iter = (gchar*)text;
+    key_idx = 0;
+    key = keys[key_idx];
+    offset = 0;
+    while (key && (start = strstr (temp_iter, key)) && start)
     {
-        temp_iter = temp = g_utf8_strdown (uri, -1);
-        desc_iter = uri;
-        key_idx = 0;
-        key = keys[key_idx];
-        offset = 0;
-        while (key && (start = strstr (temp_iter, key)) && start)
+        gsize len = strlen (key);
+        if (len)
         {
-            gsize len = strlen (key);
-            if (len)
+            offset = (start - temp_iter);
+            skey = g_strndup (desc_iter + offset, len);
+            parts = g_strsplit (desc_iter, skey, 2);
+            if (parts[0] && parts[1])
             {
-                offset = (start - temp_iter);
-                skey = g_strndup (desc_iter + offset, len);
-                parts = g_strsplit (desc_iter, skey, 2);
-                if (parts[0] && parts[1])
+                if (desc)
                 {
-                    if (desc_uri)
-                    {
-                        temp_markup = g_markup_printf_escaped ("%s<b>%s</b>",
-                            parts[0], skey);
-                        temp_concat = g_strconcat (desc_uri, temp_markup, NULL);
-                        g_free (temp_markup);
-                        katze_assign (desc_uri, temp_concat);
-                    }
-                    else
-                    {
-                        desc_uri = g_markup_printf_escaped ("%s<b>%s</b>",
-                            parts[0], skey);
-                    }
+                    temp_markup = g_markup_printf_escaped ("%s<b>%s</b>",
+                        parts[0], skey);
+                    temp_concat = g_strconcat (desc, temp_markup, NULL);
+                    g_free (temp_markup);
+                    katze_assign (desc, temp_concat);
                 }
-                g_strfreev (parts);
-                g_free (skey);
-
-                offset += len;
-                temp_iter += offset;
-                desc_iter += offset;
-            }
-            key_idx++;
-            key = keys[key_idx];
-            if (key == NULL)
-                break;
-        }
-        if (key)
-            katze_assign (desc_uri, NULL);
-        if (desc_uri)
-        {
-            temp_markup = g_markup_escape_text (desc_iter, -1);
-            temp_concat = g_strconcat (desc_uri, temp_markup, NULL);
-            g_free (temp_markup);
-            katze_assign (desc_uri, temp_concat);
-        }
-        else
-            desc_uri = g_markup_escape_text (uri, -1);
-        g_free (temp);
-    }
-
-    if (G_LIKELY (title))
-    {
-        temp_iter = temp = g_utf8_strdown (title, -1);
-        desc_iter = title;
-        key_idx = 0;
-        key = keys[key_idx];
-        offset = 0;
-        while (key && (start = strstr (temp_iter, key)) && start)
-        {
-            gsize len = strlen (key);
-            if (len)
-            {
-                offset = (start - temp_iter);
-                skey = g_strndup (desc_iter + offset, len);
-                parts = g_strsplit (desc_iter, skey, 2);
-                if (parts[0] && parts[1])
+                else
                 {
-                    if (desc_title)
-                    {
-                        temp_markup = g_markup_printf_escaped ("%s<b>%s</b>",
-                            parts[0], skey);
-                        temp_concat = g_strconcat (desc_title, temp_markup, NULL);
-                        g_free (temp_markup);
-                        katze_assign (desc_title, temp_concat);
-                    }
-                    else
-                    {
-                        desc_title = g_markup_printf_escaped ("%s<b>%s</b>",
-                            parts[0], skey);
-                    }
+                    desc = g_markup_printf_escaped ("%s<b>%s</b>",
+                        parts[0], skey);
                 }
-                g_strfreev (parts);
-                g_free (skey);
-
-                offset += len;
-                temp_iter += offset;
-                desc_iter += offset;
             }
-            key_idx++;
-            key = keys[key_idx];
-            if (key == NULL)
-                break;
-        }
-        if (key)
-            katze_assign (desc_title, NULL);
-        if (desc_title)
-        {
-            temp_markup = g_markup_escape_text (desc_iter, -1);
-            temp_concat = g_strconcat (desc_title, temp_markup, NULL);
-            g_free (temp_markup);
-            katze_assign (desc_title, temp_concat);
+            g_strfreev (parts);
+            g_free (skey);
+
+            offset += len;
+            temp_iter += offset;
+            desc_iter += offset;
         }
-        else
-            desc_title = g_markup_escape_text (title, -1);
-        g_free (temp);
+        key_idx++;
+        key = keys[key_idx];
+        if (key == NULL)
+            break;
+    }
+    if (key)
+        katze_assign (desc, NULL);
+    if (desc)
+    {
+        temp_markup = g_markup_escape_text (desc_iter, -1);
+        temp_concat = g_strconcat (desc, temp_markup, NULL);
+        g_free (temp_markup);
+        katze_assign (desc, temp_concat);
     }
+    else
+        desc = g_markup_escape_text (text, -1);
+    g_free (temp);
+    return desc;
+}
+
+/* Computed once when a row is inserted, rather than on every
+   redraw of the row, which hover selection causes a lot of */
+static gchar*
+midori_location_action_row_markup (gchar**      keys,
+                                   const gchar* uri_escaped,
+                                   const gchar* title)
+{
+    gchar* uri;
+    gchar* desc;
+    gchar* desc_uri;
+    gchar* desc_title;
+
+    uri = sokoke_uri_unescape_string (uri_escaped);
+    desc_uri = uri ? midori_location_action_highlight (keys, uri) : NULL;
+    desc_title = title ? midori_location_action_highlight (keys, title) : NULL;
 
     if (desc_title)
     {
@@ -1236,13 +1457,17 @@ midori_location_entry_render_text_cb (GtkCellLayout*   layout,
     else
         desc = desc_uri;
 
-    g_object_set (renderer, "markup", desc,
-        "ellipsize-set", TRUE, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
-
     g_free (uri);
-    g_free (title);
-    g_strfreev (keys);
-    g_free (desc);
+    return desc;
+}
+
+static gchar**
+midori_location_action_split_key (MidoriLocationAction* action)
+{
+    gchar* key = g_utf8_strdown (action->key ? action->key : "", -1);
+    gchar** keys = g_strsplit_set (key, " %", -1);
+    g_free (key);
+    return keys;
 }
 
 static void
@@ -1290,6 +1515,7 @@ midori_location_action_entry_popup_cb (GtkComboBox*          combo_box,
     const gchar* sqlcmd;
     static sqlite3_stmt* stmt = NULL;
     gint matches;
+    gchar** keys;
 
     store = GTK_LIST_STORE (gtk_combo_box_get_model (combo_box));
     gtk_list_store_clear (store);
@@ -1301,8 +1527,8 @@ midori_location_action_entry_popup_cb (GtkComboBox*          combo_box,
         g_return_if_fail (location_action->history != NULL);
         db = g_object_get_data (G_OBJECT (location_action->history), "db");
         g_return_if_fail (db != NULL);
-        sqlcmd = "SELECT uri, title FROM history"
-                 " GROUP BY uri ORDER BY count() DESC LIMIT ?";
+        sqlcmd = "SELECT uri, title FROM urls"
+                 " ORDER BY visit_count DESC LIMIT ?";
         sqlite3_prepare_v2 (db, sqlcmd, -1, &stmt, NULL);
     }
 
@@ -1317,20 +1543,25 @@ midori_location_action_entry_popup_cb (GtkComboBox*          combo_box,
     }
 
     matches = 0;
+    keys = midori_location_action_split_key (location_action);
     do
     {
         const unsigned char* uri = sqlite3_column_text (stmt, 0);
         const unsigned char* title = sqlite3_column_text (stmt, 1);
         GdkPixbuf* icon = katze_load_cached_icon ((gchar*)uri, NULL);
+        gchar* markup = midori_location_action_row_markup (keys,
+            (const gchar*)uri, (const gchar*)title);
         if (!icon)
             icon = location_action->default_icon;
         gtk_list_store_insert_with_values (store, NULL, matches,
             URI_COL, uri, TITLE_COL, title, YALIGN_COL, 0.25,
-            FAVICON_COL, icon, -1);
+            MARKUP_COL, markup, FAVICON_COL, icon, -1);
+        g_free (markup);
         matches++;
         result = sqlite3_step (stmt);
     }
     while (result == SQLITE_ROW);
+    g_strfreev (keys);
     sqlite3_reset (stmt);
     sqlite3_clear_bindings (stmt);
 }
@@ -1407,14 +1638,20 @@ midori_location_action_connect_proxy (GtkAction* action,
 
         /* Setup the renderer for the favicon */
         renderer = gtk_cell_renderer_pixbuf_new ();
+        g_object_set_data (G_OBJECT (renderer), "location-action", action);
         gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (entry), renderer, FALSE);
         gtk_cell_layout_set_attributes (GTK_CELL_LAYOUT (entry), renderer,
             "pixbuf", FAVICON_COL, "yalign", YALIGN_COL, NULL);
+        gtk_cell_layout_set_cell_data_func (GTK_CELL_LAYOUT (entry), renderer,
+            (GtkCellLayoutDataFunc)midori_location_action_render_icon_cb,
+            entry, NULL);
         renderer = gtk_cell_renderer_text_new ();
         g_object_set_data (G_OBJECT (renderer), "location-action", action);
+        g_object_set (renderer,
+            "ellipsize-set", TRUE, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
         gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (entry), renderer, TRUE);
-        gtk_cell_layout_set_cell_data_func (GTK_CELL_LAYOUT (entry),
-            renderer, midori_location_entry_render_text_cb, action, NULL);
+        gtk_cell_layout_set_attributes (GTK_CELL_LAYOUT (entry), renderer,
+            "markup", MARKUP_COL, NULL);
 
         gtk_combo_box_set_active (GTK_COMBO_BOX (entry), -1);
         gtk_container_forall (GTK_CONTAINER (entry),
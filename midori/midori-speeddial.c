@@ -0,0 +1,705 @@
+/*
+ Copyright (C) 2010 Christian Dywan <christian@twotoasts.de>
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ See the file COPYING for the full license text.
+*/
+
+#if HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include "midori-speeddial.h"
+
+#include "sokoke.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+/* Changes in quick succession, like resizing, are saved once */
+#define SPEED_DIAL_SAVE_DELAY 2
+#define SPEED_DIAL_DEFAULT_SHORTCUTS 9
+
+typedef struct
+{
+    gchar* id;
+    gchar* href;
+    gchar* title;
+    gchar* img;
+} MidoriSpeedDialShortcut;
+
+/* The shortcuts as shown by the speed dial page, which sends the whole
+   model back on every change, and the page data derived from them.
+   speeddial.json holds the data as a quoted Javascript string. */
+struct _MidoriSpeedDial
+{
+    gchar* filename;
+    GPtrArray* shortcuts;
+    gint width;
+    gint thumb;
+
+    gchar* json;
+    guint serial;
+    guint save_id;
+};
+
+static void
+midori_speed_dial_shortcut_free (MidoriSpeedDialShortcut* shortcut)
+{
+    g_free (shortcut->id);
+    g_free (shortcut->href);
+    g_free (shortcut->title);
+    g_free (shortcut->img);
+    g_slice_free (MidoriSpeedDialShortcut, shortcut);
+}
+
+static MidoriSpeedDialShortcut*
+midori_speed_dial_shortcut_new (const gchar* id)
+{
+    MidoriSpeedDialShortcut* shortcut = g_slice_new (MidoriSpeedDialShortcut);
+    shortcut->id = g_strdup (id);
+    shortcut->href = g_strdup ("#");
+    shortcut->title = g_strdup ("");
+    shortcut->img = g_strdup ("");
+    return shortcut;
+}
+
+static void
+midori_speed_dial_json_skip_space (const gchar** p)
+{
+    while (g_ascii_isspace (**p))
+        (*p)++;
+}
+
+/* Parses the four hexadecimal digits of a \u escape */
+static gboolean
+midori_speed_dial_json_parse_hex (const gchar* s,
+                                  gunichar*    c)
+{
+    gchar hex[5];
+
+    if (!(g_ascii_isxdigit (s[0]) && g_ascii_isxdigit (s[1])
+       && g_ascii_isxdigit (s[2]) && g_ascii_isxdigit (s[3])))
+        return FALSE;
+    memcpy (hex, s, 4);
+    hex[4] = '\0';
+    *c = strtoul (hex, NULL, 16);
+    return TRUE;
+}
+
+/* Besides JSON escapes this accepts \' which the page uses
+   to be able to pass the data quoted to the console. */
+static gchar*
+midori_speed_dial_json_parse_string (const gchar** p)
+{
+    GString* string;
+    const gchar* s = *p;
+
+    if (*s != '"')
+        return NULL;
+    s++;
+
+    string = g_string_new (NULL);
+    while (*s && *s != '"')
+    {
+        if (*s != '\\')
+        {
+            g_string_append_c (string, *s++);
+            continue;
+        }
+
+        s++;
+        switch (*s)
+        {
+        case 'b': g_string_append_c (string, '\b'); break;
+        case 'f': g_string_append_c (string, '\f'); break;
+        case 'n': g_string_append_c (string, '\n'); break;
+        case 'r': g_string_append_c (string, '\r'); break;
+        case 't': g_string_append_c (string, '\t'); break;
+        case 'u':
+        {
+            gunichar c, low;
+
+            if (!midori_speed_dial_json_parse_hex (&s[1], &c))
+                goto error;
+            s += 4;
+            /* Characters outside of the BMP are escaped as a pair of
+               UTF-16 surrogates, an unpaired one is replaced */
+            if (c >= 0xD800 && c <= 0xDBFF && s[1] == '\\' && s[2] == 'u'
+             && midori_speed_dial_json_parse_hex (&s[3], &low)
+             && low >= 0xDC00 && low <= 0xDFFF)
+            {
+                c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                s += 6;
+            }
+            else if (c >= 0xD800 && c <= 0xDFFF)
+                c = 0xFFFD;
+            g_string_append_unichar (string, c);
+            break;
+        }
+        case '\0':
+            goto error;
+        default:
+            g_string_append_c (string, *s);
+        }
+        s++;
+    }
+
+    if (*s != '"')
+        goto error;
+    *p = s + 1;
+    return g_string_free (string, FALSE);
+
+error:
+    g_string_free (string, TRUE);
+    return NULL;
+}
+
+/* Skips to the comma or bracket following the value */
+static gboolean
+midori_speed_dial_json_skip_value (const gchar** p)
+{
+    gint depth = 0;
+
+    while (**p)
+    {
+        if (**p == '"')
+        {
+            gchar* string = midori_speed_dial_json_parse_string (p);
+            if (!string)
+                return FALSE;
+            g_free (string);
+            continue;
+        }
+        else if (**p == '{' || **p == '[')
+            depth++;
+        else if (**p == '}' || **p == ']')
+        {
+            if (!depth)
+                return TRUE;
+            depth--;
+        }
+        else if (**p == ',' && !depth)
+            return TRUE;
+        (*p)++;
+    }
+    return FALSE;
+}
+
+/* The page stores some numbers as strings */
+static gboolean
+midori_speed_dial_json_parse_int (const gchar** p,
+                                  gint*         value)
+{
+    gchar* end;
+
+    if (**p == '"')
+    {
+        gchar* string = midori_speed_dial_json_parse_string (p);
+        if (!string)
+            return FALSE;
+        *value = atoi (string);
+        g_free (string);
+        return TRUE;
+    }
+
+    *value = strtol (*p, &end, 10);
+    if (end == *p)
+        return midori_speed_dial_json_skip_value (p);
+    *p = end;
+    return TRUE;
+}
+
+/* Calls @member_cb for every member of an object, which has to
+   consume the value or skip it. */
+static gboolean
+midori_speed_dial_json_parse_object (const gchar** p,
+                                     gboolean    (*member_cb) (const gchar*  key,
+                                                               const gchar** p,
+                                                               gpointer      data),
+                                     gpointer      data)
+{
+    midori_speed_dial_json_skip_space (p);
+    if (**p != '{')
+        return FALSE;
+    (*p)++;
+    midori_speed_dial_json_skip_space (p);
+
+    while (**p != '}')
+    {
+        gchar* key;
+        gboolean valid;
+
+        if (!(key = midori_speed_dial_json_parse_string (p)))
+            return FALSE;
+        midori_speed_dial_json_skip_space (p);
+        if (**p != ':')
+        {
+            g_free (key);
+            return FALSE;
+        }
+        (*p)++;
+        midori_speed_dial_json_skip_space (p);
+        valid = member_cb (key, p, data);
+        g_free (key);
+        if (!valid)
+            return FALSE;
+
+        midori_speed_dial_json_skip_space (p);
+        if (**p == ',')
+        {
+            (*p)++;
+            midori_speed_dial_json_skip_space (p);
+        }
+        else if (**p != '}')
+            return FALSE;
+    }
+    (*p)++;
+    return TRUE;
+}
+
+static gboolean
+midori_speed_dial_parse_shortcut_cb (const gchar*             key,
+                                     const gchar**            p,
+                                     MidoriSpeedDialShortcut* shortcut)
+{
+    gchar** field;
+
+    if (!strcmp (key, "id"))
+        field = &shortcut->id;
+    else if (!strcmp (key, "href"))
+        field = &shortcut->href;
+    else if (!strcmp (key, "title"))
+        field = &shortcut->title;
+    else if (!strcmp (key, "img"))
+        field = &shortcut->img;
+    else
+        return midori_speed_dial_json_skip_value (p);
+
+    if (**p == '"')
+    {
+        gchar* value = midori_speed_dial_json_parse_string (p);
+        if (!value)
+            return FALSE;
+        katze_assign (*field, value);
+        return TRUE;
+    }
+    return midori_speed_dial_json_skip_value (p);
+}
+
+static gboolean
+midori_speed_dial_parse_cb (const gchar*     key,
+                            const gchar**    p,
+                            MidoriSpeedDial* dial)
+{
+    if (!strcmp (key, "width"))
+        return midori_speed_dial_json_parse_int (p, &dial->width);
+    if (!strcmp (key, "thumb"))
+        return midori_speed_dial_json_parse_int (p, &dial->thumb);
+    if (strcmp (key, "shortcuts") || **p != '[')
+        return midori_speed_dial_json_skip_value (p);
+
+    (*p)++;
+    midori_speed_dial_json_skip_space (p);
+    while (**p != ']')
+    {
+        MidoriSpeedDialShortcut* shortcut = midori_speed_dial_shortcut_new (NULL);
+
+        g_ptr_array_add (dial->shortcuts, shortcut);
+        if (!midori_speed_dial_json_parse_object (p,
+            (gpointer)midori_speed_dial_parse_shortcut_cb, shortcut))
+            return FALSE;
+        if (!shortcut->id)
+            shortcut->id = g_strdup_printf ("s%d", dial->shortcuts->len);
+
+        midori_speed_dial_json_skip_space (p);
+        if (**p == ',')
+        {
+            (*p)++;
+            midori_speed_dial_json_skip_space (p);
+        }
+        else if (**p != ']')
+            return FALSE;
+    }
+    (*p)++;
+    return TRUE;
+}
+
+static void
+midori_speed_dial_free_shortcuts (GPtrArray* shortcuts)
+{
+    g_ptr_array_foreach (shortcuts, (GFunc)midori_speed_dial_shortcut_free, NULL);
+    g_ptr_array_free (shortcuts, TRUE);
+}
+
+/* The shortcuts are only replaced if all of @json is valid */
+static gboolean
+midori_speed_dial_parse (MidoriSpeedDial* dial,
+                         const gchar*     json)
+{
+    MidoriSpeedDial parsed = { NULL, NULL, 0, 0, NULL, 0, 0 };
+    const gchar* p = json;
+
+    parsed.shortcuts = g_ptr_array_new ();
+    if (!midori_speed_dial_json_parse_object (&p,
+        (gpointer)midori_speed_dial_parse_cb, &parsed))
+    {
+        midori_speed_dial_free_shortcuts (parsed.shortcuts);
+        return FALSE;
+    }
+
+    if (dial->shortcuts)
+        midori_speed_dial_free_shortcuts (dial->shortcuts);
+    dial->shortcuts = parsed.shortcuts;
+    dial->width = parsed.width;
+    dial->thumb = parsed.thumb;
+    return TRUE;
+}
+
+/* speeddial.json is a Javascript string literal containing JSON */
+static gboolean
+midori_speed_dial_load_file (MidoriSpeedDial* dial,
+                             const gchar*     filename)
+{
+    gchar* contents;
+    GString* json;
+    const gchar* p;
+    gboolean valid;
+
+    if (!g_file_get_contents (filename, &contents, NULL, NULL))
+        return FALSE;
+
+    p = contents;
+    midori_speed_dial_json_skip_space (&p);
+    if (*p != '\'')
+    {
+        g_free (contents);
+        return FALSE;
+    }
+
+    json = g_string_new (NULL);
+    for (p++; *p && *p != '\''; p++)
+    {
+        if (*p == '\\' && p[1])
+            p++;
+        g_string_append_c (json, *p);
+    }
+
+    valid = *p == '\'' && midori_speed_dial_parse (dial, json->str);
+    g_string_free (json, TRUE);
+    g_free (contents);
+    return valid;
+}
+
+static void
+midori_speed_dial_json_append_string (GString*     json,
+                                      const gchar* string)
+{
+    g_string_append_c (json, '"');
+    for (; *string; string++)
+    {
+        switch (*string)
+        {
+        case '"': g_string_append (json, "\\\""); break;
+        case '\\': g_string_append (json, "\\\\"); break;
+        case '\n': g_string_append (json, "\\n"); break;
+        case '\r': g_string_append (json, "\\r"); break;
+        case '\t': g_string_append (json, "\\t"); break;
+        /* Keeps the data from ending the script element of the page */
+        case '<': g_string_append (json, "\\u003c"); break;
+        default:
+            if ((guchar)*string < 0x20)
+                g_string_append_printf (json, "\\u%04x", (guchar)*string);
+            else
+                g_string_append_c (json, *string);
+        }
+    }
+    g_string_append_c (json, '"');
+}
+
+/**
+ * midori_speed_dial_get_json:
+ * @dial: a #MidoriSpeedDial
+ *
+ * Retrieves the shortcuts in the form expected by the speed dial
+ * page, which is the same that is stored in speeddial.json.
+ *
+ * Return value: a quoted Javascript string, owned by @dial
+ **/
+const gchar*
+midori_speed_dial_get_json (MidoriSpeedDial* dial)
+{
+    GString* json;
+    GString* quoted;
+    const gchar* p;
+    guint i;
+
+    if (dial->json)
+        return dial->json;
+
+    json = g_string_new ("{\"shortcuts\":[");
+    for (i = 0; i < dial->shortcuts->len; i++)
+    {
+        MidoriSpeedDialShortcut* shortcut = g_ptr_array_index (dial->shortcuts, i);
+
+        if (i)
+            g_string_append_c (json, ',');
+        g_string_append (json, "{\"id\":");
+        midori_speed_dial_json_append_string (json, shortcut->id);
+        g_string_append (json, ",\"href\":");
+        midori_speed_dial_json_append_string (json, shortcut->href);
+        g_string_append (json, ",\"title\":");
+        midori_speed_dial_json_append_string (json, shortcut->title);
+        g_string_append (json, ",\"img\":");
+        midori_speed_dial_json_append_string (json, shortcut->img);
+        g_string_append_c (json, '}');
+    }
+    g_string_append_c (json, ']');
+    if (dial->width)
+        g_string_append_printf (json, ",\"width\":%d", dial->width);
+    if (dial->thumb)
+        g_string_append_printf (json, ",\"thumb\":%d", dial->thumb);
+    g_string_append_c (json, '}');
+
+    quoted = g_string_sized_new (json->len + 2);
+    g_string_append_c (quoted, '\'');
+    for (p = json->str; *p; p++)
+    {
+        if (*p == '\\' || *p == '\'')
+            g_string_append_c (quoted, '\\');
+        g_string_append_c (quoted, *p);
+    }
+    g_string_append_c (quoted, '\'');
+    g_string_free (json, TRUE);
+
+    dial->json = g_string_free (quoted, FALSE);
+    return dial->json;
+}
+
+/**
+ * midori_speed_dial_get_serial:
+ * @dial: a #MidoriSpeedDial
+ *
+ * Retrieves a number that changes whenever the shortcuts
+ * change, so that derived data can be cached.
+ *
+ * Return value: the current serial
+ **/
+guint
+midori_speed_dial_get_serial (MidoriSpeedDial* dial)
+{
+    return dial->serial;
+}
+
+static gboolean
+midori_speed_dial_save_timeout_cb (MidoriSpeedDial* dial)
+{
+    dial->save_id = 0;
+    midori_speed_dial_flush (dial);
+    return FALSE;
+}
+
+static void
+midori_speed_dial_changed (MidoriSpeedDial* dial)
+{
+    katze_assign (dial->json, NULL);
+    dial->serial++;
+    if (!dial->save_id)
+        dial->save_id = g_timeout_add_seconds (SPEED_DIAL_SAVE_DELAY,
+            (GSourceFunc)midori_speed_dial_save_timeout_cb, dial);
+}
+
+/* Thumbnails of shortcuts that were changed or removed are deleted */
+static void
+midori_speed_dial_prune_thumbnails (MidoriSpeedDial* dial)
+{
+    GHashTable* used;
+    gchar* folder;
+    GDir* dir;
+    const gchar* name;
+    guint i;
+
+    used = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    for (i = 0; i < dial->shortcuts->len; i++)
+    {
+        MidoriSpeedDialShortcut* shortcut = g_ptr_array_index (dial->shortcuts, i);
+        gchar* filename;
+
+        if (!strcmp (shortcut->href, "#"))
+            continue;
+        filename = sokoke_speed_dial_thumb_filename (shortcut->href);
+        g_hash_table_insert (used, g_path_get_basename (filename), NULL);
+        g_free (filename);
+    }
+
+    folder = g_build_filename (g_get_user_cache_dir (), PACKAGE_NAME,
+                               "thumbnails", NULL);
+    if ((dir = g_dir_open (folder, 0, NULL)))
+    {
+        while ((name = g_dir_read_name (dir)))
+        {
+            gchar* filename;
+
+            if (!g_str_has_suffix (name, ".png")
+             || g_hash_table_lookup_extended (used, name, NULL, NULL))
+                continue;
+            filename = g_build_filename (folder, name, NULL);
+            g_unlink (filename);
+            g_free (filename);
+        }
+        g_dir_close (dir);
+    }
+    g_free (folder);
+    g_hash_table_destroy (used);
+}
+
+/**
+ * midori_speed_dial_flush:
+ * @dial: a #MidoriSpeedDial
+ *
+ * Saves pending changes immediately, and deletes thumbnails
+ * that are no longer used by any shortcut.
+ **/
+void
+midori_speed_dial_flush (MidoriSpeedDial* dial)
+{
+    GError* error = NULL;
+
+    if (!dial->save_id)
+        return;
+    g_source_remove (dial->save_id);
+    dial->save_id = 0;
+
+    /* This replaces the file atomically */
+    if (!g_file_set_contents (dial->filename,
+                              midori_speed_dial_get_json (dial), -1, &error))
+    {
+        g_printerr (_("The speed dial couldn't be saved. %s\n"), error->message);
+        g_error_free (error);
+        return;
+    }
+    midori_speed_dial_prune_thumbnails (dial);
+}
+
+/**
+ * midori_speed_dial_get_default:
+ *
+ * Retrieves the speed dial, loading it the first time.
+ *
+ * Return value: the #MidoriSpeedDial
+ **/
+MidoriSpeedDial*
+midori_speed_dial_get_default (void)
+{
+    static MidoriSpeedDial* dial = NULL;
+    gchar* filename;
+    guint i;
+
+    if (dial)
+        return dial;
+
+    dial = g_new0 (MidoriSpeedDial, 1);
+    dial->filename = g_build_filename (sokoke_set_config_dir (NULL),
+                                       "speeddial.json", NULL);
+    dial->serial = 1;
+    if (midori_speed_dial_load_file (dial, dial->filename))
+        return dial;
+
+    filename = sokoke_find_data_filename ("midori/res/speeddial.json");
+    if (!midori_speed_dial_load_file (dial, filename))
+    {
+        dial->shortcuts = g_ptr_array_new ();
+        for (i = 1; i <= SPEED_DIAL_DEFAULT_SHORTCUTS; i++)
+        {
+            gchar* id = g_strdup_printf ("s%d", i);
+            g_ptr_array_add (dial->shortcuts, midori_speed_dial_shortcut_new (id));
+            g_free (id);
+        }
+    }
+    g_free (filename);
+    return dial;
+}
+
+/**
+ * midori_speed_dial_get_next_free_slot:
+ * @dial: a #MidoriSpeedDial
+ *
+ * Looks for a shortcut that wasn't set yet.
+ *
+ * Return value: the id of the shortcut, or %NULL if all are in use
+ **/
+const gchar*
+midori_speed_dial_get_next_free_slot (MidoriSpeedDial* dial)
+{
+    guint i;
+
+    for (i = 0; i < dial->shortcuts->len; i++)
+    {
+        MidoriSpeedDialShortcut* shortcut = g_ptr_array_index (dial->shortcuts, i);
+        if (!strcmp (shortcut->href, "#"))
+            return shortcut->id;
+    }
+    return NULL;
+}
+
+/**
+ * midori_speed_dial_set_shortcut:
+ * @dial: a #MidoriSpeedDial
+ * @id: the id of a shortcut
+ * @uri: the URI
+ * @title: the title
+ * @img: the URI of the thumbnail
+ *
+ * Changes the shortcut @id.
+ **/
+void
+midori_speed_dial_set_shortcut (MidoriSpeedDial* dial,
+                                const gchar*     id,
+                                const gchar*     uri,
+                                const gchar*     title,
+                                const gchar*     img)
+{
+    guint i;
+
+    g_return_if_fail (id != NULL);
+
+    for (i = 0; i < dial->shortcuts->len; i++)
+    {
+        MidoriSpeedDialShortcut* shortcut = g_ptr_array_index (dial->shortcuts, i);
+        if (strcmp (shortcut->id, id))
+            continue;
+
+        katze_assign (shortcut->href, g_strdup (uri ? uri : "#"));
+        katze_assign (shortcut->title, g_strdup (title ? title : ""));
+        katze_assign (shortcut->img, g_strdup (img ? img : ""));
+        midori_speed_dial_changed (dial);
+        return;
+    }
+}
+
+/**
+ * midori_speed_dial_set_json:
+ * @dial: a #MidoriSpeedDial
+ * @json: the shortcuts as sent by the speed dial page
+ *
+ * Replaces all shortcuts with the data sent by the page.
+ *
+ * Return value: %TRUE if @json was valid
+ **/
+gboolean
+midori_speed_dial_set_json (MidoriSpeedDial* dial,
+                            const gchar*     json)
+{
+    g_return_val_if_fail (json != NULL, FALSE);
+
+    if (!midori_speed_dial_parse (dial, json))
+        return FALSE;
+    midori_speed_dial_changed (dial);
+    return TRUE;
+}
@@ -0,0 +1,49 @@
+/*
+ Copyright (C) 2010 Christian Dywan <christian@twotoasts.de>
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ See the file COPYING for the full license text.
+*/
+
+#ifndef __MIDORI_SPEED_DIAL_H__
+#define __MIDORI_SPEED_DIAL_H__ 1
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MidoriSpeedDial MidoriSpeedDial;
+
+MidoriSpeedDial*
+midori_speed_dial_get_default       (void);
+
+const gchar*
+midori_speed_dial_get_json          (MidoriSpeedDial* dial);
+
+guint
+midori_speed_dial_get_serial        (MidoriSpeedDial* dial);
+
+const gchar*
+midori_speed_dial_get_next_free_slot (MidoriSpeedDial* dial);
+
+void
+midori_speed_dial_set_shortcut      (MidoriSpeedDial* dial,
+                                     const gchar*     id,
+                                     const gchar*     uri,
+                                     const gchar*     title,
+                                     const gchar*     img);
+
+gboolean
+midori_speed_dial_set_json          (MidoriSpeedDial* dial,
+                                     const gchar*     json);
+
+void
+midori_speed_dial_flush             (MidoriSpeedDial* dial);
+
+G_END_DECLS
+
+#endif /* !__MIDORI_SPEED_DIAL_H__ */
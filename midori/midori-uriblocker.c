@@ -0,0 +1,336 @@
+/*
+ Copyright (C) 2010 Christian Dywan <christian@twotoasts.de>
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ See the file COPYING for the full license text.
+*/
+
+#if HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include "midori-uriblocker.h"
+
+#include <string.h>
+#include <glib/gi18n.h>
+
+typedef struct
+{
+    gchar* scheme; /* NULL matches any scheme */
+    gchar* path;
+} MidoriUriBlockerPrefix;
+
+/* Host rules block a host and all of its subdomains, prefix rules
+   are indexed by host and compared by scheme and path. Only regular
+   expressions need the URI as a string, so they are tried last.
+
+   A pattern file has one rule per line:
+     example.com
+     example.com/ads/
+     http://example.com/ads/
+     /banner[0-9]+\.gif/
+   Empty lines and lines starting with # are ignored. */
+struct _MidoriUriBlocker
+{
+    GHashTable* hosts;
+    GHashTable* prefixes;
+    GRegex* regex;
+
+    guint host_count;
+    guint prefix_count;
+    guint regex_count;
+    guint checked;
+};
+
+static void
+midori_uri_blocker_prefixes_free (GSList* prefixes)
+{
+    GSList* l;
+
+    for (l = prefixes; l != NULL; l = g_slist_next (l))
+    {
+        MidoriUriBlockerPrefix* prefix = l->data;
+        g_free (prefix->scheme);
+        g_free (prefix->path);
+        g_slice_free (MidoriUriBlockerPrefix, prefix);
+    }
+    g_slist_free (prefixes);
+}
+
+static void
+midori_uri_blocker_add_prefix (MidoriUriBlocker* blocker,
+                               const gchar*      rule)
+{
+    gboolean any_scheme = !strstr (rule, "://");
+    SoupURI* uri;
+    MidoriUriBlockerPrefix* prefix;
+    GSList* prefixes;
+    gchar* host;
+
+    if (any_scheme)
+    {
+        gchar* http_rule = g_strconcat ("http://", rule, NULL);
+        uri = soup_uri_new (http_rule);
+        g_free (http_rule);
+    }
+    else
+        uri = soup_uri_new (rule);
+    if (!uri || !uri->host)
+    {
+        g_printerr (_("Invalid block rule \"%s\"\n"), rule);
+        if (uri)
+            soup_uri_free (uri);
+        return;
+    }
+
+    prefix = g_slice_new (MidoriUriBlockerPrefix);
+    prefix->scheme = any_scheme ? NULL : g_strdup (uri->scheme);
+    prefix->path = g_strdup (uri->path ? uri->path : "/");
+    host = g_ascii_strdown (uri->host, -1);
+    soup_uri_free (uri);
+
+    if ((prefixes = g_hash_table_lookup (blocker->prefixes, host)))
+    {
+        g_slist_append (prefixes, prefix);
+        g_free (host);
+    }
+    else
+        g_hash_table_insert (blocker->prefixes, host,
+                             g_slist_prepend (NULL, prefix));
+}
+
+static gboolean
+midori_uri_blocker_add_rules (MidoriUriBlocker* blocker,
+                              gchar**           lines)
+{
+    GString* patterns = g_string_new (NULL);
+    gboolean valid = TRUE;
+    guint i;
+
+    for (i = 0; lines[i] != NULL; i++)
+    {
+        gchar* rule = g_strstrip (lines[i]);
+        gsize length = strlen (rule);
+
+        if (!length || rule[0] == '#')
+            continue;
+        if (length > 2 && rule[0] == '/' && rule[length - 1] == '/')
+        {
+            rule[length - 1] = '\0';
+            if (patterns->len)
+                g_string_append_c (patterns, '|');
+            g_string_append_printf (patterns, "(?:%s)", &rule[1]);
+        }
+        else if (strchr (rule, '/'))
+            midori_uri_blocker_add_prefix (blocker, rule);
+        else
+        {
+            if (rule[0] == '.')
+                rule++;
+            else if (g_str_has_prefix (rule, "*."))
+                rule += 2;
+            g_hash_table_insert (blocker->hosts,
+                                 g_ascii_strdown (rule, -1), NULL);
+        }
+    }
+
+    if (patterns->len)
+    {
+        GError* error = NULL;
+
+        /* All expressions are compiled into one */
+        blocker->regex = g_regex_new (patterns->str,
+            G_REGEX_OPTIMIZE, G_REGEX_MATCH_NOTEMPTY, &error);
+        if (!blocker->regex)
+        {
+            g_printerr (_("Invalid block pattern: %s\n"), error->message);
+            g_error_free (error);
+            valid = FALSE;
+        }
+    }
+    g_string_free (patterns, TRUE);
+    return valid;
+}
+
+/**
+ * midori_uri_blocker_new_from_rules:
+ * @rules: the contents of a pattern file
+ *
+ * Creates a blocker from @rules, one rule per line.
+ *
+ * Return value: a new #MidoriUriBlocker, or %NULL on error
+ **/
+MidoriUriBlocker*
+midori_uri_blocker_new_from_rules (const gchar* rules)
+{
+    MidoriUriBlocker* blocker;
+    gchar** lines;
+    gboolean valid;
+
+    g_return_val_if_fail (rules != NULL, NULL);
+
+    lines = g_strsplit (rules, "\n", -1);
+    blocker = g_slice_new0 (MidoriUriBlocker);
+    blocker->hosts = g_hash_table_new_full (g_str_hash, g_str_equal,
+        g_free, NULL);
+    blocker->prefixes = g_hash_table_new_full (g_str_hash, g_str_equal,
+        g_free, (GDestroyNotify)midori_uri_blocker_prefixes_free);
+    valid = midori_uri_blocker_add_rules (blocker, lines);
+    g_strfreev (lines);
+
+    if (!valid)
+    {
+        midori_uri_blocker_free (blocker);
+        return NULL;
+    }
+    return blocker;
+}
+
+/**
+ * midori_uri_blocker_new:
+ * @pattern: a regular expression
+ *
+ * Creates a blocker from the single regular expression @pattern.
+ *
+ * Return value: a new #MidoriUriBlocker, or %NULL on error
+ **/
+MidoriUriBlocker*
+midori_uri_blocker_new (const gchar* pattern)
+{
+    MidoriUriBlocker* blocker;
+    gchar* rule;
+
+    g_return_val_if_fail (pattern != NULL, NULL);
+
+    rule = g_strdup_printf ("/%s/", pattern);
+    blocker = midori_uri_blocker_new_from_rules (rule);
+    g_free (rule);
+    return blocker;
+}
+
+/**
+ * midori_uri_blocker_free:
+ * @blocker: a #MidoriUriBlocker
+ *
+ * Frees @blocker and all of its rules.
+ **/
+void
+midori_uri_blocker_free (MidoriUriBlocker* blocker)
+{
+    g_return_if_fail (blocker != NULL);
+
+    g_hash_table_destroy (blocker->hosts);
+    g_hash_table_destroy (blocker->prefixes);
+    if (blocker->regex)
+        g_regex_unref (blocker->regex);
+    g_slice_free (MidoriUriBlocker, blocker);
+}
+
+static gboolean
+midori_uri_blocker_match_host (MidoriUriBlocker* blocker,
+                               const gchar*      host)
+{
+    const gchar* domain;
+
+    if (!g_hash_table_size (blocker->hosts))
+        return FALSE;
+
+    /* Try www.example.com, example.com and com */
+    for (domain = host; domain; domain = strchr (domain, '.'))
+    {
+        if (*domain == '.')
+            domain++;
+        if (g_hash_table_lookup_extended (blocker->hosts, domain, NULL, NULL))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static gboolean
+midori_uri_blocker_match_prefix (MidoriUriBlocker* blocker,
+                                 SoupURI*          uri,
+                                 const gchar*      host)
+{
+    GSList* prefixes;
+
+    prefixes = g_hash_table_lookup (blocker->prefixes, host);
+    for (; prefixes != NULL; prefixes = g_slist_next (prefixes))
+    {
+        MidoriUriBlockerPrefix* prefix = prefixes->data;
+        if ((!prefix->scheme || !strcmp (prefix->scheme, uri->scheme))
+         && g_str_has_prefix (uri->path ? uri->path : "/", prefix->path))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * midori_uri_blocker_match:
+ * @blocker: a #MidoriUriBlocker
+ * @uri: a #SoupURI
+ *
+ * Determines whether @uri is matched by any of the rules.
+ *
+ * Return value: %TRUE if @uri should be blocked
+ **/
+gboolean
+midori_uri_blocker_match (MidoriUriBlocker* blocker,
+                          SoupURI*          uri)
+{
+    gchar* host;
+    gboolean blocked = FALSE;
+
+    g_return_val_if_fail (blocker != NULL, FALSE);
+    g_return_val_if_fail (uri != NULL, FALSE);
+
+    blocker->checked++;
+    if (uri->host)
+    {
+        host = g_ascii_strdown (uri->host, -1);
+        if (midori_uri_blocker_match_host (blocker, host))
+        {
+            blocker->host_count++;
+            blocked = TRUE;
+        }
+        else if (midori_uri_blocker_match_prefix (blocker, uri, host))
+        {
+            blocker->prefix_count++;
+            blocked = TRUE;
+        }
+        g_free (host);
+        if (blocked)
+            return TRUE;
+    }
+
+    if (blocker->regex)
+    {
+        gchar* string = soup_uri_to_string (uri, FALSE);
+        blocked = g_regex_match (blocker->regex, string, 0, NULL);
+        g_free (string);
+        if (blocked)
+            blocker->regex_count++;
+    }
+    return blocked;
+}
+
+/**
+ * midori_uri_blocker_print_stats:
+ * @blocker: a #MidoriUriBlocker
+ *
+ * Prints how many requests were blocked by which kind of rule.
+ **/
+void
+midori_uri_blocker_print_stats (MidoriUriBlocker* blocker)
+{
+    g_return_if_fail (blocker != NULL);
+
+    g_print (_("Blocked %u of %u requests: %u by host, %u by prefix, "
+               "%u by pattern\n"),
+             blocker->host_count + blocker->prefix_count + blocker->regex_count,
+             blocker->checked, blocker->host_count, blocker->prefix_count,
+             blocker->regex_count);
+}
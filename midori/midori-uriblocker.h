@@ -0,0 +1,39 @@
+/*
+ Copyright (C) 2010 Christian Dywan <christian@twotoasts.de>
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ See the file COPYING for the full license text.
+*/
+
+#ifndef __MIDORI_URI_BLOCKER_H__
+#define __MIDORI_URI_BLOCKER_H__ 1
+
+#include <libsoup/soup.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MidoriUriBlocker MidoriUriBlocker;
+
+MidoriUriBlocker*
+midori_uri_blocker_new              (const gchar*      pattern);
+
+MidoriUriBlocker*
+midori_uri_blocker_new_from_rules   (const gchar*      rules);
+
+void
+midori_uri_blocker_free             (MidoriUriBlocker* blocker);
+
+gboolean
+midori_uri_blocker_match            (MidoriUriBlocker* blocker,
+                                     SoupURI*          uri);
+
+void
+midori_uri_blocker_print_stats      (MidoriUriBlocker* blocker);
+
+G_END_DECLS
+
+#endif /* !__MIDORI_URI_BLOCKER_H__ */
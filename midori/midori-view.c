@@ -17,6 +17,7 @@
 #include "midori-view.h"
 #include "midori-stock.h"
 #include "midori-browser.h"
+#include "midori-speeddial.h"
 
 #include "marshal.h"
 #include "sokoke.h"
@@ -54,6 +55,9 @@ midori_search_action_get_icon (KatzeItem*    item,
 static void
 midori_view_construct_web_view (MidoriView* view);
 
+static void
+midori_view_ensure_web_view (MidoriView* view);
+
 static void
 midori_view_item_meta_data_changed (KatzeItem*   item,
                                     const gchar* key,
@@ -86,7 +90,6 @@ struct _MidoriView
     gchar* selected_text;
     MidoriWebSettings* settings;
     GtkWidget* web_view;
-    GtkWidget* thumb_view;
     KatzeArray* news_feeds;
 
     gboolean speed_dial_in_new_tabs;
@@ -97,6 +100,7 @@ struct _MidoriView
     gboolean close_buttons_on_tabs;
     MidoriNewPage open_new_pages_in;
     gboolean find_while_typing;
+    gboolean throttle_background_tabs;
     gint find_links;
 
     GtkWidget* menu_item;
@@ -107,8 +111,15 @@ struct _MidoriView
     KatzeItem* item;
     gint scrollh, scrollv;
     gboolean back_forward_set;
-    GHashTable* memory;
     GtkWidget* scrolled_window;
+    gchar* deferred_uri;
+    time_t hidden_since;
+    GdkPixbuf* snapshot;
+    gfloat zoom_level;
+    gchar* custom_encoding;
+    gboolean throttled;
+    guint32 timers_key;
+    GSList* timer_frames;
 };
 
 struct _MidoriViewClass
@@ -203,6 +214,7 @@ enum {
     ADD_BOOKMARK,
     SAVE_AS,
     ADD_SPEED_DIAL,
+    WEB_VIEW_CREATED,
 
     LAST_SIGNAL
 };
@@ -228,6 +240,12 @@ static gboolean
 midori_view_focus_in_event (GtkWidget*     widget,
                             GdkEventFocus* event);
 
+static void
+midori_view_map (GtkWidget* widget);
+
+static void
+midori_view_unmap (GtkWidget* widget);
+
 static void
 midori_view_settings_notify_cb (MidoriWebSettings* settings,
                                 GParamSpec*        pspec,
@@ -235,8 +253,9 @@ midori_view_settings_notify_cb (MidoriWebSettings* settings,
 
 static void
 midori_view_speed_dial_get_thumb (GtkWidget*   web_view,
-                                 const gchar* message,
-                                 MidoriView*  view);
+                                  const gchar* message,
+                                  MidoriView*  view,
+                                  gboolean     urgent);
 
 static void
 midori_view_speed_dial_save (GtkWidget*   web_view,
@@ -447,6 +466,29 @@ midori_view_class_init (MidoriViewClass* class)
         G_TYPE_NONE, 1,
         G_TYPE_STRING);
 
+    /**
+     * MidoriView::web-view-created:
+     * @view: the object on which the signal is emitted
+     * @web_view: the new web view
+     *
+     * Emitted when the web view of the view is created, which
+     * happens once it is needed and again after the view was
+     * hibernated. Handlers connected to the web view should
+     * be connected here so that they apply to a new web view.
+     *
+     * Since: 0.3.0
+     */
+    signals[WEB_VIEW_CREATED] = g_signal_new (
+        "web-view-created",
+        G_TYPE_FROM_CLASS (class),
+        (GSignalFlags)(G_SIGNAL_RUN_LAST),
+        0,
+        0,
+        NULL,
+        g_cclosure_marshal_VOID__OBJECT,
+        G_TYPE_NONE, 1,
+        GTK_TYPE_WIDGET);
+
     gobject_class = G_OBJECT_CLASS (class);
     gobject_class->finalize = midori_view_finalize;
     gobject_class->set_property = midori_view_set_property;
@@ -454,6 +496,8 @@ midori_view_class_init (MidoriViewClass* class)
 
     gtkwidget_class = GTK_WIDGET_CLASS (class);
     gtkwidget_class->focus_in_event = midori_view_focus_in_event;
+    gtkwidget_class->map = midori_view_map;
+    gtkwidget_class->unmap = midori_view_unmap;
 
     flags = G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS;
 
@@ -754,24 +798,39 @@ midori_view_icon_cb (GdkPixbuf*  icon,
     midori_view_update_icon (view, icon);
 }
 
-typedef void (*KatzeNetIconCb) (GdkPixbuf*  icon,
-                                MidoriView* view);
-
 typedef struct
 {
-    gchar* icon_file;
     gchar* icon_uri;
+    gchar* uri;
     MidoriView* view;
 } KatzeNetIconPriv;
 
 static void
 katze_net_icon_priv_free (KatzeNetIconPriv* priv)
 {
-    g_free (priv->icon_file);
     g_free (priv->icon_uri);
+    g_free (priv->uri);
+    g_object_unref (priv->view);
     g_slice_free (KatzeNetIconPriv, priv);
 }
 
+static gboolean
+katze_net_icon_priv_is_current (KatzeNetIconPriv* priv)
+{
+    /* The view may have moved on to another page meanwhile */
+    return !g_strcmp0 (priv->uri, priv->view->uri);
+}
+
+static void
+midori_view_get_icon_size (MidoriView* view,
+                           gint*       icon_width,
+                           gint*       icon_height)
+{
+    GtkSettings* settings = gtk_widget_get_settings (GTK_WIDGET (view));
+    gtk_icon_size_lookup_for_settings (settings, GTK_ICON_SIZE_MENU,
+                                       icon_width, icon_height);
+}
+
 static gboolean
 katze_net_icon_status_cb (KatzeNetRequest*  request,
                           KatzeNetIconPriv* priv)
@@ -781,12 +840,18 @@ katze_net_icon_status_cb (KatzeNetRequest*  request,
     case KATZE_NET_VERIFIED:
         if (request->mime_type && strncmp (request->mime_type, "image/", 6))
         {
+            /* Remembered so that the host isn't asked again */
+            katze_cache_icon (priv->uri, priv->icon_uri, NULL);
             katze_net_icon_priv_free (priv);
             return FALSE;
         }
         break;
     case KATZE_NET_MOVED:
         break;
+    case KATZE_NET_NOT_FOUND:
+        katze_cache_icon (priv->uri, priv->icon_uri, NULL);
+        katze_net_icon_priv_free (priv);
+        return FALSE;
     default:
         katze_net_icon_priv_free (priv);
         return FALSE;
@@ -795,60 +860,57 @@ katze_net_icon_status_cb (KatzeNetRequest*  request,
     return TRUE;
 }
 
+static void
+katze_net_icon_decoded_cb (GdkPixbuf*        icon,
+                           KatzeNetIconPriv* priv)
+{
+    if (katze_net_icon_priv_is_current (priv))
+    {
+        if (icon)
+            katze_assign (priv->view->icon_uri, g_strdup (priv->icon_uri));
+        midori_view_icon_cb (icon, priv->view);
+    }
+    else if (icon)
+        g_object_unref (icon);
+    katze_net_icon_priv_free (priv);
+}
+
 static void
 katze_net_icon_transfer_cb (KatzeNetRequest*  request,
                             KatzeNetIconPriv* priv)
 {
-    GdkPixbuf* pixbuf;
-    FILE* fp;
-    GdkPixbuf* pixbuf_scaled;
     gint icon_width, icon_height;
-    size_t ret;
-    GtkSettings* settings;
 
     if (request->status == KATZE_NET_MOVED)
         return;
 
-    pixbuf = NULL;
-    if (request->data)
+    if (!request->data)
     {
-        if ((fp = fopen (priv->icon_file, "wb")))
-        {
-            ret = fwrite (request->data, 1, request->length, fp);
-            fclose (fp);
-            if ((ret - request->length) != 0)
-            {
-                g_warning ("Error writing to file %s "
-                           "in katze_net_icon_transfer_cb()", priv->icon_file);
-            }
-            pixbuf = gdk_pixbuf_new_from_file (priv->icon_file, NULL);
-        }
-        else
-            pixbuf = katze_pixbuf_new_from_buffer ((guchar*)request->data,
-                request->length, request->mime_type, NULL);
-        if (pixbuf)
-            g_object_ref (pixbuf);
-        g_hash_table_insert (priv->view->memory,
-            g_strdup (priv->icon_file), pixbuf);
+        katze_net_icon_decoded_cb (NULL, priv);
+        return;
     }
 
-    if (!pixbuf)
+    /* Decoded, scaled and stored in a worker thread */
+    midori_view_get_icon_size (priv->view, &icon_width, &icon_height);
+    katze_load_icon_async (priv->uri, priv->icon_uri,
+        request->data, request->length, icon_width, icon_height,
+        (KatzeIconCb)katze_net_icon_decoded_cb, priv);
+}
+
+static void
+katze_net_icon_loaded_cb (GdkPixbuf*        icon,
+                          KatzeNetIconPriv* priv)
+{
+    if (icon || !katze_net_icon_priv_is_current (priv))
     {
-        midori_view_icon_cb (NULL, priv->view);
-        katze_net_icon_priv_free (priv);
+        katze_net_icon_decoded_cb (icon, priv);
         return;
     }
 
-    settings = gtk_widget_get_settings (priv->view->web_view);
-    gtk_icon_size_lookup_for_settings (settings, GTK_ICON_SIZE_MENU,
-                                       &icon_width, &icon_height);
-    pixbuf_scaled = gdk_pixbuf_scale_simple (pixbuf, icon_width, icon_height,
-                                             GDK_INTERP_BILINEAR);
-    g_object_unref (pixbuf);
-
-    katze_assign (priv->view->icon_uri, g_strdup (priv->icon_uri));
-    midori_view_icon_cb (pixbuf_scaled, priv->view);
-    katze_net_icon_priv_free (priv);
+    /* The icon wasn't stored yet */
+    katze_net_load_uri (NULL, priv->icon_uri,
+        (KatzeNetStatusCb)katze_net_icon_status_cb,
+        (KatzeNetTransferCb)katze_net_icon_transfer_cb, priv);
 }
 
 static void
@@ -857,10 +919,9 @@ _midori_web_view_load_icon (MidoriView* view)
     GdkPixbuf* pixbuf;
     KatzeNetIconPriv* priv;
     gchar* icon_uri;
-    gchar* icon_file;
     gint icon_width, icon_height;
     GdkPixbuf* pixbuf_scaled;
-    GtkSettings* settings;
+    gboolean missing;
 
     pixbuf = NULL;
     icon_uri = g_strdup (view->icon_uri);
@@ -883,45 +944,41 @@ _midori_web_view_load_icon (MidoriView* view)
                 icon_uri = g_strdup_printf ("%s/favicon.ico", view->uri);
         }
 
-        icon_file = katze_net_get_cached_path (NULL, icon_uri, "icons");
-        if (g_hash_table_lookup_extended (view->memory,
-                                          icon_file, NULL, (gpointer)&pixbuf))
+        midori_view_get_icon_size (view, &icon_width, &icon_height);
+        if ((pixbuf = katze_get_cached_icon (view->uri, icon_uri, &missing)))
         {
-            g_free (icon_file);
-            if (pixbuf)
+            katze_assign (view->icon_uri, icon_uri);
+            /* Icons in memory are already small, this is cheap */
+            if (gdk_pixbuf_get_width (pixbuf) != icon_width
+             || gdk_pixbuf_get_height (pixbuf) != icon_height)
             {
-                g_object_ref (pixbuf);
-                katze_assign (view->icon_uri, icon_uri);
+                pixbuf_scaled = gdk_pixbuf_scale_simple (pixbuf, icon_width,
+                    icon_height, GDK_INTERP_BILINEAR);
+                g_object_unref (pixbuf);
+                pixbuf = pixbuf_scaled;
             }
         }
-        else if ((pixbuf = gdk_pixbuf_new_from_file (icon_file, NULL)))
+        else if (missing)
         {
-            g_free (icon_file);
-            katze_assign (view->icon_uri, icon_uri);
+            /* Neither the icon database nor the network are asked
+               again for an icon that couldn't be loaded */
+            g_free (icon_uri);
         }
         else
         {
+            /* Read from the icon database in a worker thread, so that
+               restoring many tabs doesn't decode all icons at once */
             priv = g_slice_new (KatzeNetIconPriv);
-            priv->icon_file = icon_file;
             priv->icon_uri = icon_uri;
-            priv->view = view;
-
-            katze_net_load_uri (NULL, icon_uri,
-                (KatzeNetStatusCb)katze_net_icon_status_cb,
-                (KatzeNetTransferCb)katze_net_icon_transfer_cb, priv);
+            priv->uri = g_strdup (view->uri);
+            priv->view = g_object_ref (view);
+            katze_load_icon_async (view->uri, icon_uri, NULL, 0,
+                icon_width, icon_height,
+                (KatzeIconCb)katze_net_icon_loaded_cb, priv);
         }
     }
-
-    if (pixbuf)
-    {
-        settings = gtk_widget_get_settings (view->web_view);
-        gtk_icon_size_lookup_for_settings (settings, GTK_ICON_SIZE_MENU,
-                                           &icon_width, &icon_height);
-        pixbuf_scaled = gdk_pixbuf_scale_simple (pixbuf, icon_width,
-            icon_height, GDK_INTERP_BILINEAR);
-        g_object_unref (pixbuf);
-        pixbuf = pixbuf_scaled;
-    }
+    else
+        g_free (icon_uri);
 
     midori_view_update_icon (view, pixbuf);
 }
@@ -1061,6 +1118,11 @@ midori_view_web_view_resource_request_cb (WebKitWebView*         web_view,
                                           MidoriView*            view)
 {
     const gchar* uri = webkit_network_request_get_uri (request);
+    SoupMessage* msg = webkit_network_request_get_message (request);
+
+    /* Requests of background tabs may have to wait for their turn */
+    if (msg)
+        katze_http_scheduler_set_message_owner (msg, view);
 
     /* Only apply custom URIs to special pages for security purposes */
     if (!view->special)
@@ -1487,6 +1549,18 @@ webkit_web_view_load_finished_cb (WebKitWebView*  web_view,
     g_object_notify (G_OBJECT (view), "progress");
     midori_view_update_load_status (view, MIDORI_LOAD_FINISHED);
 
+    #if WEBKIT_CHECK_VERSION (1, 1, 2)
+    /* The encoding chosen before the view was hibernated reloads the page */
+    if (view->custom_encoding
+     && web_frame == webkit_web_view_get_main_frame (web_view))
+    {
+        gchar* encoding = view->custom_encoding;
+        view->custom_encoding = NULL;
+        g_object_set (web_view, "custom-encoding", encoding, NULL);
+        g_free (encoding);
+    }
+    #endif
+
     if (1)
     {
         JSContextRef js_context = webkit_web_frame_get_global_context (web_frame);
@@ -2815,10 +2889,10 @@ webkit_web_view_create_web_view_cb (GtkWidget*      web_view,
     {
         new_view = (MidoriView*)midori_view_new_with_title (NULL,
             view->settings, FALSE);
-        g_signal_connect (new_view->web_view, "web-view-ready",
+        g_signal_connect (midori_view_get_web_view (new_view), "web-view-ready",
                           G_CALLBACK (webkit_web_view_web_view_ready_cb), view);
     }
-    return new_view->web_view;
+    return midori_view_get_web_view (new_view);
 }
 
 static gboolean
@@ -2984,7 +3058,9 @@ webkit_web_view_console_message_cb (GtkWidget*   web_view,
                                     MidoriView*  view)
 {
     if (!strncmp (message, "speed_dial-get-thumbnail", 22))
-        midori_view_speed_dial_get_thumb (web_view, message, view);
+        midori_view_speed_dial_get_thumb (web_view, message, view, TRUE);
+    else if (!strncmp (message, "speed_dial-refresh-thumbnail", 28))
+        midori_view_speed_dial_get_thumb (web_view, message, view, FALSE);
     else if (!strncmp (message, "speed_dial-save", 13))
         midori_view_speed_dial_save (web_view, message);
     else
@@ -3003,6 +3079,53 @@ midori_view_web_view_print_requested_cb (GtkWidget*      web_view,
 }
 #endif
 
+static gboolean
+midori_view_is_throttled (MidoriView* view)
+{
+    return view->throttle_background_tabs
+        && (view->hidden_since || view->throttled);
+}
+
+static void
+midori_view_update_throttling (MidoriView* view)
+{
+    gchar* script;
+    GSList* frames;
+
+    if (!view->web_view)
+        return;
+
+    script = g_strdup_printf (
+        "if (window.__midori_timers) window.__midori_timers (%u, %s);",
+        view->timers_key, midori_view_is_throttled (view) ? "true" : "false");
+    for (frames = view->timer_frames; frames; frames = g_slist_next (frames))
+    {
+        JSContextRef js_context = webkit_web_frame_get_global_context (
+            WEBKIT_WEB_FRAME (frames->data));
+        g_free (sokoke_js_script_eval (js_context, script, NULL));
+    }
+    g_free (script);
+}
+
+static void
+midori_view_timer_frame_finalized_cb (MidoriView* view,
+                                      GObject*    web_frame)
+{
+    view->timer_frames = g_slist_remove (view->timer_frames, web_frame);
+}
+
+static void
+midori_view_clear_timer_frames (MidoriView* view)
+{
+    while (view->timer_frames)
+    {
+        g_object_weak_unref (view->timer_frames->data,
+            (GWeakNotify)midori_view_timer_frame_finalized_cb, view);
+        view->timer_frames = g_slist_delete_link (view->timer_frames,
+                                                  view->timer_frames);
+    }
+}
+
 static void
 webkit_web_view_window_object_cleared_cb (GtkWidget*      web_view,
                                           WebKitWebFrame* web_frame,
@@ -3010,6 +3133,46 @@ webkit_web_view_window_object_cleared_cb (GtkWidget*      web_view,
                                           JSObjectRef     js_window,
                                           MidoriView*     view)
 {
+    if (view->throttle_background_tabs)
+    {
+        /* Timers of a hidden page run at most once per second and the
+           time spent in timers is counted. The state is only reachable
+           through a read-only function which checks the key of the view,
+           so that the page can neither read nor change it. */
+        gchar* script = g_strdup_printf (
+        "(function (w, key) { "
+        "var t = { hidden: %s, cost: 0 }; "
+        "var wrap = function (f, args, repeat) { var last = 0; return function () { "
+        "var now = new Date ().getTime (); "
+        "if (repeat && t.hidden && now - last < 1000) return; last = now; "
+        "try { if (typeof f == 'function') f.apply (w, args); else w.eval (f); } "
+        "finally { t.cost += new Date ().getTime () - now; } }; }; "
+        "var st = w.setTimeout; var si = w.setInterval; "
+        "w.setTimeout = function (f, d) { "
+        "var args = Array.prototype.slice.call (arguments, 2); "
+        "return st.call (w, wrap (f, args, false), "
+        "t.hidden ? Math.max (d || 0, 1000) : d); }; "
+        "w.setInterval = function (f, d) { "
+        "var args = Array.prototype.slice.call (arguments, 2); "
+        "return si.call (w, wrap (f, args, true), d); }; "
+        "Object.defineProperty (w, '__midori_timers', { value: function (k, h) { "
+        "if (k !== key) return -1; if (h !== undefined) t.hidden = h; "
+        "return t.cost; } }); "
+        "}) (window, %u);",
+        midori_view_is_throttled (view) ? "true" : "false", view->timers_key);
+        g_free (sokoke_js_script_eval (js_context, script, NULL));
+        g_free (script);
+
+        /* Each frame is updated, subframes from another origin can't
+           see the main frame */
+        if (!g_slist_find (view->timer_frames, web_frame))
+        {
+            view->timer_frames = g_slist_prepend (view->timer_frames, web_frame);
+            g_object_weak_ref (G_OBJECT (web_frame),
+                (GWeakNotify)midori_view_timer_frame_finalized_cb, view);
+        }
+    }
+
     g_signal_emit (view, signals[CONTEXT_READY], 0, js_context);
 }
 
@@ -3053,23 +3216,6 @@ midori_view_notify_vadjustment_cb (MidoriView* view,
         G_CALLBACK (midori_view_vadjustment_notify_value_cb), view);
 }
 
-static void
-katze_net_object_maybe_unref (gpointer object)
-{
-    if (object)
-        g_object_unref (object);
-}
-
-static GHashTable* midori_view_get_memory (void)
-{
-    static GHashTable* memory = NULL;
-    if (!memory)
-        memory = g_hash_table_new_full (g_str_hash, g_str_equal,
-            g_free, katze_net_object_maybe_unref);
-    return g_hash_table_ref (memory);
-
-}
-
 static void
 midori_view_init (MidoriView* view)
 {
@@ -3079,7 +3225,6 @@ midori_view_init (MidoriView* view)
     view->mime_type = g_strdup ("");
     view->icon = NULL;
     view->icon_uri = NULL;
-    view->memory = midori_view_get_memory ();
     view->progress = 0.0;
     view->load_status = MIDORI_LOAD_FINISHED;
     view->minimized = FALSE;
@@ -3100,6 +3245,13 @@ midori_view_init (MidoriView* view)
     view->download_manager = NULL;
     view->news_aggregator = NULL;
     view->web_view = NULL;
+    view->deferred_uri = NULL;
+    view->hidden_since = time (NULL);
+    view->snapshot = NULL;
+    view->zoom_level = 1.0f;
+    view->custom_encoding = NULL;
+    view->timers_key = g_random_int ();
+    view->timer_frames = NULL;
     /* Adjustments are not created initially, but overwritten later */
     view->scrolled_window = katze_scrolled_new (NULL, NULL);
     gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (view->scrolled_window),
@@ -3113,7 +3265,8 @@ midori_view_init (MidoriView* view)
     g_signal_connect (view->scrolled_window, "notify::vadjustment",
         G_CALLBACK (midori_view_notify_vadjustment_cb), view);
 
-    midori_view_construct_web_view (view);
+    /* The web view is created once it is needed, see
+       midori_view_ensure_web_view() */
 }
 
 static void
@@ -3129,23 +3282,15 @@ midori_view_finalize (GObject* object)
     g_signal_handlers_disconnect_by_func (view->item,
         midori_view_item_meta_data_changed, view);
 
-    if (view->thumb_view)
-    {
-        gtk_widget_destroy (view->thumb_view);
-        view->thumb_view = NULL;
-    }
-
     katze_assign (view->uri, NULL);
+    katze_assign (view->deferred_uri, NULL);
+    katze_object_assign (view->snapshot, NULL);
+    katze_assign (view->custom_encoding, NULL);
+    midori_view_clear_timer_frames (view);
     katze_assign (view->title, NULL);
     katze_object_assign (view->icon, NULL);
     katze_assign (view->icon_uri, NULL);
 
-    if (view->memory)
-    {
-        g_hash_table_unref (view->memory);
-        view->memory = NULL;
-    }
-
     katze_assign (view->statusbar_text, NULL);
     katze_assign (view->link_uri, NULL);
     katze_assign (view->selected_text, NULL);
@@ -3260,10 +3405,48 @@ midori_view_focus_in_event (GtkWidget*     widget,
     MidoriView* view = MIDORI_VIEW (widget);
 
     /* Always propagate focus to the child web view */
-    gtk_widget_grab_focus (view->web_view);
+    gtk_widget_grab_focus (midori_view_get_web_view (view));
     return TRUE;
 }
 
+static gboolean
+midori_view_load_deferred_idle_cb (MidoriView* view)
+{
+    /* Tabs merely passed by while restoring a session aren't loaded */
+    if (gtk_widget_get_mapped (GTK_WIDGET (view)))
+        midori_view_load_deferred (view);
+    g_object_unref (view);
+    return FALSE;
+}
+
+static void
+midori_view_map (GtkWidget* widget)
+{
+    MidoriView* view = MIDORI_VIEW (widget);
+
+    GTK_WIDGET_CLASS (midori_view_parent_class)->map (widget);
+    view->hidden_since = 0;
+    midori_view_update_throttling (view);
+
+    /* A tab restored in the background loads when it's first shown */
+    if (view->deferred_uri)
+        g_idle_add ((GSourceFunc)midori_view_load_deferred_idle_cb,
+                    g_object_ref (view));
+    else
+        midori_view_ensure_web_view (view);
+}
+
+static void
+midori_view_unmap (GtkWidget* widget)
+{
+    MidoriView* view = MIDORI_VIEW (widget);
+
+    view->hidden_since = time (NULL);
+    midori_view_update_throttling (view);
+
+    GTK_WIDGET_CLASS (midori_view_parent_class)->unmap (widget);
+}
+
 /**
  * midori_view_new:
  * @net: %NULL
@@ -3298,7 +3481,8 @@ _midori_view_set_settings (MidoriView*        view,
     g_signal_connect (settings, "notify",
                       G_CALLBACK (midori_view_settings_notify_cb), view);
 
-    g_object_set (view->web_view, "settings", settings, NULL);
+    if (view->web_view)
+        g_object_set (view->web_view, "settings", settings, NULL);
 
     g_free (view->download_manager);
     g_free (view->news_aggregator);
@@ -3314,6 +3498,7 @@ _midori_view_set_settings (MidoriView*        view,
         "middle-click-opens-selection", &view->middle_click_opens_selection,
         "open-tabs-in-the-background", &view->open_tabs_in_the_background,
         "find-while-typing", &view->find_while_typing,
+        "throttle-background-tabs", &view->throttle_background_tabs,
         NULL);
 
     if (view->web_view)
@@ -3393,6 +3578,11 @@ midori_view_settings_notify_cb (MidoriWebSettings* settings,
         view->open_tabs_in_the_background = g_value_get_boolean (&value);
     else if (name == g_intern_string ("find-while-typing"))
         view->find_while_typing = g_value_get_boolean (&value);
+    else if (name == g_intern_string ("throttle-background-tabs"))
+    {
+        view->throttle_background_tabs = g_value_get_boolean (&value);
+        midori_view_update_throttling (view);
+    }
 
     g_value_unset (&value);
 }
@@ -3560,6 +3750,13 @@ midori_view_web_inspector_detach_window_cb (gpointer    inspector,
     return TRUE;
 }
 
+static void
+midori_view_ensure_web_view (MidoriView* view)
+{
+    if (!view->web_view)
+        midori_view_construct_web_view (view);
+}
+
 static void
 midori_view_construct_web_view (MidoriView* view)
 {
@@ -3568,6 +3765,8 @@ midori_view_construct_web_view (MidoriView* view)
 
     g_return_if_fail (!view->web_view);
 
+    /* The thumbnail only stands in for a hibernated page */
+    katze_object_assign (view->snapshot, NULL);
     view->web_view = webkit_web_view_new ();
 
     /* Load something to avoid a bug where WebKit might not set a main frame */
@@ -3678,6 +3877,81 @@ midori_view_construct_web_view (MidoriView* view)
                       "signal::detach-window",
                       midori_view_web_inspector_detach_window_cb, view,
                       NULL);
+
+    /* Restore the zoom level of a hibernated view */
+    if (view->zoom_level != 1.0f)
+        webkit_web_view_set_zoom_level (WEBKIT_WEB_VIEW (view->web_view),
+                                        view->zoom_level);
+
+    g_signal_emit (view, signals[WEB_VIEW_CREATED], 0, view->web_view);
+}
+
+/* The speed dial page only changes along with the shortcuts, so it is
+   built once instead of from the templates for every new tab. */
+static const gchar*
+midori_view_get_speed_dial_page (const gchar** res_root)
+{
+    static gchar* res = NULL;
+    static gchar* head = NULL;
+    static gchar* page = NULL;
+    static guint serial = 0;
+    MidoriSpeedDial* dial = midori_speed_dial_get_default ();
+
+    if (G_UNLIKELY (!head))
+    {
+        #if !WEBKIT_CHECK_VERSION (1, 1, 14)
+        SoupServer* res_server;
+        guint port;
+        #endif
+        gchar* stock_root;
+        gchar* filepath;
+        gchar* speed_dial_head;
+
+        filepath = sokoke_find_data_filename ("midori/res/speeddial-head.html");
+        g_file_get_contents (filepath, &speed_dial_head, NULL, NULL);
+        g_free (filepath);
+        if (G_UNLIKELY (!speed_dial_head))
+            speed_dial_head = g_strdup ("");
+
+        #if WEBKIT_CHECK_VERSION (1, 1, 14)
+        res = g_strdup ("res:/");
+        stock_root = g_strdup ("stock:/");
+        #else
+        res_server = sokoke_get_res_server ();
+        port = soup_server_get_port (res_server);
+        res = g_strdup_printf ("http://localhost:%d/res", port);
+        stock_root = g_strdup_printf ("http://localhost:%d/stock", port);
+        #endif
+
+        head = sokoke_replace_variables (speed_dial_head,
+            "{res}", res,
+            "{stock}", stock_root,
+            "{title}", _("Speed dial"),
+            "{click_to_add}", _("Click to add a shortcut"),
+            "{enter_shortcut_address}", _("Enter shortcut address"),
+            "{enter_shortcut_name}", _("Enter shortcut title"),
+            "{are_you_sure}", _("Are you sure you want to delete this shortcut?"),
+            "{set_dial_size}", _("Set number of columns and rows"),
+            "{enter_dial_size}", _("Enter number of columns and rows:"),
+            "{invalid_dial_size}", _("Invalid input for the size of the speed dial"),
+            "{set_thumb_size}", _("Thumb size:"),
+            "{set_thumb_small}", _("Small"),
+            "{set_thumb_normal}", _("Medium"),
+            "{set_thumb_big}", _("Big"),  NULL);
+
+        g_free (stock_root);
+        g_free (speed_dial_head);
+    }
+
+    if (!page || serial != midori_speed_dial_get_serial (dial))
+    {
+        katze_assign (page, sokoke_replace_variables (head,
+            "{json_data}", midori_speed_dial_get_json (dial), NULL));
+        serial = midori_speed_dial_get_serial (dial);
+    }
+
+    *res_root = res;
+    return page;
 }
 
 /**
@@ -3705,81 +3979,23 @@ midori_view_set_uri (MidoriView*  view,
     /* Treat "about:blank" and "" equally, see midori_view_is_blank(). */
     if (!uri || !strcmp (uri, "about:blank")) uri = "";
 
+    katze_assign (view->deferred_uri, NULL);
+    katze_object_assign (view->snapshot, NULL);
+    midori_view_ensure_web_view (view);
+
     if (g_getenv ("MIDORI_UNARMED") == NULL)
     {
         if (view->speed_dial_in_new_tabs && !strcmp (uri, ""))
         {
-            #if !WEBKIT_CHECK_VERSION (1, 1, 14)
-            SoupServer* res_server;
-            guint port;
-            #endif
-            gchar* res_root;
-            gchar* speed_dial_head;
-            gchar* speed_dial_body;
-            gchar* body_fname;
-            gchar* stock_root;
-            gchar* filepath;
+            const gchar* res_root;
+            const gchar* speed_dial_page;
 
             katze_assign (view->uri, g_strdup (""));
             katze_item_set_uri (view->item, "");
 
-            filepath = sokoke_find_data_filename ("midori/res/speeddial-head.html");
-            g_file_get_contents (filepath, &speed_dial_head, NULL, NULL);
-            g_free (filepath);
-            if (G_UNLIKELY (!speed_dial_head))
-                speed_dial_head = g_strdup ("");
-
-            #if WEBKIT_CHECK_VERSION (1, 1, 14)
-            res_root = g_strdup ("res:/");
-            stock_root = g_strdup ("stock:/");
-            #else
-            res_server = sokoke_get_res_server ();
-            port = soup_server_get_port (res_server);
-            res_root = g_strdup_printf ("http://localhost:%d/res", port);
-            stock_root = g_strdup_printf ("http://localhost:%d/stock", port);
-            #endif
-            body_fname = g_build_filename (sokoke_set_config_dir (NULL),
-                                           "speeddial.json", NULL);
-
-            if (g_access (body_fname, F_OK) != 0)
-            {
-                filepath = sokoke_find_data_filename ("midori/res/speeddial.json");
-                if (g_file_get_contents (filepath,
-                                         &speed_dial_body, NULL, NULL))
-                    g_file_set_contents (body_fname, speed_dial_body, -1, NULL);
-                else
-                    speed_dial_body = g_strdup ("");
-                g_free (filepath);
-            }
-            else
-                g_file_get_contents (body_fname, &speed_dial_body, NULL, NULL);
-
-            data = sokoke_replace_variables (speed_dial_head,
-                "{res}", res_root,
-                "{stock}", stock_root,
-                "{json_data}", speed_dial_body,
-                "{title}", _("Speed dial"),
-                "{click_to_add}", _("Click to add a shortcut"),
-                "{enter_shortcut_address}", _("Enter shortcut address"),
-                "{enter_shortcut_name}", _("Enter shortcut title"),
-                "{are_you_sure}", _("Are you sure you want to delete this shortcut?"),
-                "{set_dial_size}", _("Set number of columns and rows"),
-                "{enter_dial_size}", _("Enter number of columns and rows:"),
-                "{invalid_dial_size}", _("Invalid input for the size of the speed dial"),
-                "{set_thumb_size}", _("Thumb size:"),
-                "{set_thumb_small}", _("Small"),
-                "{set_thumb_normal}", _("Medium"),
-                "{set_thumb_big}", _("Big"),  NULL);
-
+            speed_dial_page = midori_view_get_speed_dial_page (&res_root);
             midori_view_load_alternate_string (view,
-                data, res_root, "about:blank", NULL);
-
-            g_free (res_root);
-            g_free (stock_root);
-            g_free (data);
-            g_free (speed_dial_head);
-            g_free (speed_dial_body);
-            g_free (body_fname);
+                speed_dial_page, res_root, "about:blank", NULL);
         }
         /* This is not prefectly elegant, but creating
            special pages inline is the simplest solution. */
@@ -3840,6 +4056,7 @@ midori_view_set_uri (MidoriView*  view,
                 gchar** argument_vector = sokoke_get_argv (NULL);
                 gchar* command_line = g_strjoinv (" ", argument_vector);
                 gchar* ident = katze_object_get_string (view->settings, "user-agent");
+                guint prefetch_hits, prefetch_misses;
                 #if defined (G_OS_WIN32)
                 gchar* sys_name = g_strdup ("Windows");
                 #else
@@ -3851,6 +4068,7 @@ midori_view_set_uri (MidoriView*  view,
                     sys_name = g_strdup ("Unix");
                 #endif
 
+                sokoke_prefetch_get_stats (&prefetch_hits, &prefetch_misses);
                 katze_assign (view->uri, g_strdup (uri));
                 #ifndef WEBKIT_USER_AGENT_MAJOR_VERSION
                     #define WEBKIT_USER_AGENT_MAJOR_VERSION 532
@@ -3887,6 +4105,7 @@ midori_view_set_uri (MidoriView*  view,
                     "<tr><td>libhildon</td><td>%s</td></tr>"
                     "<tr><td>Platform</td><td>%s</td></tr>"
                     "<tr><td>Identification</td><td>%s</td></tr>"
+                    "<tr><td>DNS prefetching</td><td>%u hits, %u lookups</td></tr>"
                     "</table>"
                     "</body></html>",
                     _("Version numbers in brackets show the version used at runtime."),
@@ -3907,7 +4126,7 @@ midori_view_set_uri (MidoriView*  view,
                     HAVE_LIBIDN ? "Yes" : "No",
                     HAVE_UNIQUE ? "Yes" : "No",
                     HAVE_HILDON ? "Yes" : "No",
-                    sys_name, ident);
+                    sys_name, ident, prefetch_hits, prefetch_misses);
                 g_free (command_line);
                 g_free (ident);
                 g_free (sys_name);
@@ -3975,6 +4194,256 @@ midori_view_set_uri (MidoriView*  view,
     }
 }
 
+/**
+ * midori_view_defer_uri:
+ * @view: a #MidoriView
+ * @uri: an URI string
+ *
+ * Makes @uri the page of the view without loading it. No
+ * web view is created until the view is shown, the web
+ * view is needed otherwise or midori_view_load_deferred()
+ * is called. Until then the view represents @uri with the
+ * title it was created with and a cached icon.
+ *
+ * Since: 0.3.0
+ **/
+void
+midori_view_defer_uri (MidoriView*  view,
+                       const gchar* uri)
+{
+    const gchar* display_uri;
+
+    g_return_if_fail (MIDORI_IS_VIEW (view));
+    g_return_if_fail (uri != NULL);
+
+    /* A view that is already visible has no reason to wait */
+    if (view->web_view || gtk_widget_get_mapped (GTK_WIDGET (view)))
+    {
+        midori_view_set_uri (view, uri);
+        return;
+    }
+
+    display_uri = g_str_has_prefix (uri, "pause:") ? &uri[6] : uri;
+    katze_assign (view->deferred_uri, g_strdup (uri));
+    katze_assign (view->uri, sokoke_format_uri_for_display (display_uri));
+    katze_item_set_uri (view->item, display_uri);
+    g_object_notify (G_OBJECT (view), "uri");
+    _midori_web_view_load_icon (view);
+}
+
+/**
+ * midori_view_load_deferred:
+ * @view: a #MidoriView
+ *
+ * Loads the page remembered by midori_view_defer_uri()
+ * if it wasn't loaded yet.
+ *
+ * Return value: %TRUE if loading was started
+ *
+ * Since: 0.3.0
+ **/
+gboolean
+midori_view_load_deferred (MidoriView* view)
+{
+    gchar* uri;
+
+    g_return_val_if_fail (MIDORI_IS_VIEW (view), FALSE);
+
+    if (!view->deferred_uri)
+        return FALSE;
+
+    uri = view->deferred_uri;
+    view->deferred_uri = NULL;
+    midori_view_set_uri (view, uri);
+    g_free (uri);
+    return TRUE;
+}
+
+/**
+ * midori_view_is_deferred:
+ * @view: a #MidoriView
+ *
+ * Determines whether the page of the view wasn't loaded yet,
+ * see midori_view_defer_uri() and midori_view_hibernate().
+ *
+ * Return value: %TRUE if the page is deferred
+ *
+ * Since: 0.3.0
+ **/
+gboolean
+midori_view_is_deferred (MidoriView* view)
+{
+    g_return_val_if_fail (MIDORI_IS_VIEW (view), FALSE);
+
+    return view->deferred_uri != NULL;
+}
+
+/**
+ * midori_view_get_hidden_time:
+ * @view: a #MidoriView
+ *
+ * Determines for how long the view wasn't shown.
+ *
+ * Return value: the time in seconds, or 0 if the view is shown
+ *
+ * Since: 0.3.0
+ **/
+glong
+midori_view_get_hidden_time (MidoriView* view)
+{
+    g_return_val_if_fail (MIDORI_IS_VIEW (view), 0);
+
+    if (!view->hidden_since)
+        return 0;
+    return MAX (time (NULL) - view->hidden_since, 1);
+}
+
+/**
+ * midori_view_hibernate:
+ * @view: a #MidoriView
+ *
+ * Discards the web view of a view which isn't shown, keeping
+ * the address, title, icon, scroll position, zoom level, encoding
+ * and a thumbnail of the page.
+ * The page is loaded again like one deferred with
+ * midori_view_defer_uri(). The history of the view is lost.
+ *
+ * Pages that are loading or blank are left alone.
+ *
+ * Return value: %TRUE if the web view was discarded
+ *
+ * Since: 0.3.0
+ **/
+gboolean
+midori_view_hibernate (MidoriView* view)
+{
+    GtkScrolledWindow* scrolled;
+    const gchar* uri;
+    gint scrollh, scrollv;
+
+    g_return_val_if_fail (MIDORI_IS_VIEW (view), FALSE);
+
+    if (!view->web_view || view->deferred_uri
+     || gtk_widget_get_mapped (GTK_WIDGET (view))
+     || view->load_status != MIDORI_LOAD_FINISHED
+     || midori_view_is_blank (view))
+        return FALSE;
+
+    uri = katze_item_get_uri (view->item);
+    if (!uri || !*uri)
+        return FALSE;
+
+    scrolled = GTK_SCROLLED_WINDOW (view->scrolled_window);
+    scrollh = (gint)gtk_adjustment_get_value (
+        gtk_scrolled_window_get_hadjustment (scrolled));
+    scrollv = (gint)gtk_adjustment_get_value (
+        gtk_scrolled_window_get_vadjustment (scrolled));
+
+    view->zoom_level = webkit_web_view_get_zoom_level (
+        WEBKIT_WEB_VIEW (view->web_view));
+    #if WEBKIT_CHECK_VERSION (1, 1, 2)
+    /* Applied by webkit_web_view_load_finished_cb() once loaded again */
+    katze_assign (view->custom_encoding,
+        katze_object_get_string (view->web_view, "custom-encoding"));
+    #endif
+
+    /* Only rendered now, rather than whenever the view is hidden. The web
+       view is still realized, and the thumbnail has the size used by
+       speed dial shortcuts. */
+    if (gtk_widget_get_realized (view->web_view))
+        katze_object_assign (view->snapshot,
+            midori_view_get_snapshot (view, 240, 160));
+
+    view->deferred_uri = g_strdup (uri);
+    midori_view_clear_timer_frames (view);
+    gtk_widget_destroy (view->web_view);
+    view->web_view = NULL;
+
+    /* Applied by midori_view_apply_scroll_position() once loaded again,
+       the item is updated because the destroyed view reset the values */
+    view->scrollh = scrollh;
+    view->scrollv = scrollv;
+    katze_item_set_meta_integer (view->item, "scrollh", scrollh);
+    katze_item_set_meta_integer (view->item, "scrollv", scrollv);
+
+    katze_assign (view->statusbar_text, NULL);
+    katze_assign (view->link_uri, NULL);
+    #if WEBKIT_CHECK_VERSION (1, 1, 15)
+    katze_object_assign (view->hit_test, NULL);
+    #endif
+    view->progress = 0.0;
+    g_object_notify (G_OBJECT (view), "progress");
+    return TRUE;
+}
+
+/**
+ * midori_view_set_throttled:
+ * @view: a #MidoriView
+ * @throttled: whether the view should be throttled
+ *
+ * Throttles script timers of a view that is shown but can't
+ * be seen, for example because its window is minimized.
+ * Views which aren't shown are throttled regardless.
+ *
+ * See MidoriWebSettings:throttle-background-tabs.
+ *
+ * Since: 0.3.0
+ **/
+void
+midori_view_set_throttled (MidoriView* view,
+                           gboolean    throttled)
+{
+    g_return_if_fail (MIDORI_IS_VIEW (view));
+
+    if (view->throttled == throttled)
+        return;
+    view->throttled = throttled;
+    midori_view_update_throttling (view);
+}
+
+/**
+ * midori_view_get_script_time:
+ * @view: a #MidoriView
+ *
+ * Determines how much time script timers of the current page
+ * took so far, if background tabs are throttled.
+ *
+ * Return value: the time in milliseconds, or -1 if unknown
+ *
+ * Since: 0.3.0
+ **/
+gint64
+midori_view_get_script_time (MidoriView* view)
+{
+    gchar* script;
+    GSList* frames;
+    gint64 milliseconds;
+
+    g_return_val_if_fail (MIDORI_IS_VIEW (view), -1);
+
+    if (!view->web_view || !view->throttle_background_tabs)
+        return -1;
+
+    /* The time of all frames of the page is added up */
+    script = g_strdup_printf (
+        "window.__midori_timers ? String (window.__midori_timers (%u)) : '-1'",
+        view->timers_key);
+    milliseconds = -1;
+    for (frames = view->timer_frames; frames; frames = g_slist_next (frames))
+    {
+        JSContextRef js_context = webkit_web_frame_get_global_context (
+            WEBKIT_WEB_FRAME (frames->data));
+        gchar* value = sokoke_js_script_eval (js_context, script, NULL);
+        gint64 cost = value ? g_ascii_strtoll (value, NULL, 10) : -1;
+
+        g_free (value);
+        if (cost >= 0)
+            milliseconds = MAX (milliseconds, 0) + cost;
+    }
+    g_free (script);
+    return milliseconds;
+}
+
 /**
  * midori_view_is_blank:
  * @view: a #MidoriView
@@ -4120,6 +4589,9 @@ midori_view_has_selection (MidoriView* view)
 {
     g_return_val_if_fail (MIDORI_IS_VIEW (view), FALSE);
 
+    if (!view->web_view)
+        return FALSE;
+
     katze_assign (view->selected_text, webkit_web_view_get_selected_text (
         WEBKIT_WEB_VIEW (view->web_view)));
     if (view->selected_text && *view->selected_text)
@@ -4671,7 +5143,7 @@ midori_view_get_zoom_level (MidoriView* view)
 
     if (view->web_view != NULL)
         return webkit_web_view_get_zoom_level (WEBKIT_WEB_VIEW (view->web_view));
-    return 1.0f;
+    return view->zoom_level;
 }
 
 /**
@@ -4687,8 +5159,11 @@ midori_view_set_zoom_level (MidoriView* view,
 {
     g_return_if_fail (MIDORI_IS_VIEW (view));
 
-    webkit_web_view_set_zoom_level (
-        WEBKIT_WEB_VIEW (view->web_view), zoom_level);
+    /* Applied by midori_view_construct_web_view() if there's no web view */
+    view->zoom_level = zoom_level;
+    if (view->web_view != NULL)
+        webkit_web_view_set_zoom_level (
+            WEBKIT_WEB_VIEW (view->web_view), zoom_level);
     g_object_notify (G_OBJECT (view), "zoom-level");
 }
 
@@ -4760,6 +5235,9 @@ midori_view_reload (MidoriView* view,
 
     g_return_if_fail (MIDORI_IS_VIEW (view));
 
+    if (midori_view_load_deferred (view))
+        return;
+
     #if WEBKIT_CHECK_VERSION (1, 1, 14)
     title = NULL;
     #elif WEBKIT_CHECK_VERSION (1, 1, 6)
@@ -4772,7 +5250,7 @@ midori_view_reload (MidoriView* view,
     title = g_strdup_printf (_("Error - %s"), view->uri);
     #endif
     if (view->title && title && strstr (title, view->title))
-        webkit_web_view_open (WEBKIT_WEB_VIEW (view->web_view), view->uri);
+        webkit_web_view_open (WEBKIT_WEB_VIEW (midori_view_get_web_view (view)), view->uri);
     else if (!(view->uri && *view->uri && strncmp (view->uri, "about:", 6)))
     {
         gchar* uri = g_strdup (view->uri);
@@ -4780,9 +5258,9 @@ midori_view_reload (MidoriView* view,
         g_free (uri);
     }
     else if (from_cache)
-        webkit_web_view_reload (WEBKIT_WEB_VIEW (view->web_view));
+        webkit_web_view_reload (WEBKIT_WEB_VIEW (midori_view_get_web_view (view)));
     else
-        webkit_web_view_reload_bypass_cache (WEBKIT_WEB_VIEW (view->web_view));
+        webkit_web_view_reload_bypass_cache (WEBKIT_WEB_VIEW (midori_view_get_web_view (view)));
     katze_item_set_meta_integer (view->item, "delay", -1);
 
     g_free (title);
@@ -4799,7 +5277,7 @@ midori_view_stop_loading (MidoriView* view)
 {
     g_return_if_fail (MIDORI_IS_VIEW (view));
 
-    webkit_web_view_stop_loading (WEBKIT_WEB_VIEW (view->web_view));
+    webkit_web_view_stop_loading (WEBKIT_WEB_VIEW (midori_view_get_web_view (view)));
 }
 
 /**
@@ -4830,7 +5308,7 @@ midori_view_go_back (MidoriView* view)
 {
     g_return_if_fail (MIDORI_IS_VIEW (view));
 
-    webkit_web_view_go_back (WEBKIT_WEB_VIEW (view->web_view));
+    webkit_web_view_go_back (WEBKIT_WEB_VIEW (midori_view_get_web_view (view)));
 }
 
 /**
@@ -4861,7 +5339,7 @@ midori_view_go_forward (MidoriView* view)
 {
     g_return_if_fail (MIDORI_IS_VIEW (view));
 
-    webkit_web_view_go_forward (WEBKIT_WEB_VIEW (view->web_view));
+    webkit_web_view_go_forward (WEBKIT_WEB_VIEW (midori_view_get_web_view (view)));
 }
 
 /**
@@ -4977,7 +5455,7 @@ midori_view_print (MidoriView* view)
 
     g_return_if_fail (MIDORI_IS_VIEW (view));
 
-    frame = webkit_web_view_get_main_frame (WEBKIT_WEB_VIEW (view->web_view));
+    frame = webkit_web_view_get_main_frame (WEBKIT_WEB_VIEW (midori_view_get_web_view (view)));
     #if WEBKIT_CHECK_VERSION (1, 1, 5)
     operation = gtk_print_operation_new ();
     gtk_print_operation_set_custom_tab_label (operation, _("Features"));
@@ -5020,7 +5498,7 @@ midori_view_unmark_text_matches (MidoriView* view)
 {
     g_return_if_fail (MIDORI_IS_VIEW (view));
 
-    webkit_web_view_unmark_text_matches (WEBKIT_WEB_VIEW (view->web_view));
+    webkit_web_view_unmark_text_matches (WEBKIT_WEB_VIEW (midori_view_get_web_view (view)));
 }
 
 /**
@@ -5041,7 +5519,7 @@ midori_view_search_text (MidoriView*  view,
     g_return_if_fail (MIDORI_IS_VIEW (view));
 
     g_signal_emit (view, signals[SEARCH_TEXT], 0,
-        webkit_web_view_search_text (WEBKIT_WEB_VIEW (view->web_view),
+        webkit_web_view_search_text (WEBKIT_WEB_VIEW (midori_view_get_web_view (view)),
             text, case_sensitive, forward, TRUE), NULL);
 }
 
@@ -5060,7 +5538,7 @@ midori_view_mark_text_matches (MidoriView*  view,
 {
     g_return_if_fail (MIDORI_IS_VIEW (view));
 
-    webkit_web_view_mark_text_matches (WEBKIT_WEB_VIEW (view->web_view),
+    webkit_web_view_mark_text_matches (WEBKIT_WEB_VIEW (midori_view_get_web_view (view)),
         text, case_sensitive, 0);
 }
 
@@ -5078,7 +5556,7 @@ midori_view_set_highlight_text_matches (MidoriView* view,
     g_return_if_fail (MIDORI_IS_VIEW (view));
 
     webkit_web_view_set_highlight_text_matches (
-        WEBKIT_WEB_VIEW (view->web_view), highlight);
+        WEBKIT_WEB_VIEW (midori_view_get_web_view (view)), highlight);
 }
 
 /**
@@ -5105,7 +5583,7 @@ midori_view_execute_script (MidoriView*  view,
     g_return_val_if_fail (MIDORI_IS_VIEW (view), FALSE);
     g_return_val_if_fail (script != NULL, FALSE);
 
-    web_frame = webkit_web_view_get_main_frame (WEBKIT_WEB_VIEW (view->web_view));
+    web_frame = webkit_web_view_get_main_frame (WEBKIT_WEB_VIEW (midori_view_get_web_view (view)));
     js_context = webkit_web_frame_get_global_context (web_frame);
     if ((script_decoded = soup_uri_decode (script)))
     {
@@ -5126,7 +5604,7 @@ midori_view_execute_script (MidoriView*  view,
  * @height: the desired height
  *
  * Take a snapshot of the view at the given dimensions. The
- * view has to be mapped on the screen.
+ * view has to be realized, it needn't be shown.
  *
  * If width and height are negative, the resulting
  * image is going to be optimized for speed.
@@ -5153,7 +5631,25 @@ midori_view_get_snapshot (MidoriView* view,
     GdkPixbuf* pixbuf;
 
     g_return_val_if_fail (MIDORI_IS_VIEW (view), NULL);
+
+    /* A hibernated view is represented by its last snapshot */
+    if (!view->web_view && view->snapshot)
+    {
+        if (width < 0 && height < 0)
+        {
+            width *= -1;
+            height *= -1;
+        }
+        if (!width && !height)
+            return g_object_ref (view->snapshot);
+        return gdk_pixbuf_scale_simple (view->snapshot,
+            width ? width : gdk_pixbuf_get_width (view->snapshot),
+            height ? height : gdk_pixbuf_get_height (view->snapshot),
+            GDK_INTERP_BILINEAR);
+    }
+
     web_view = view->web_view;
+    g_return_val_if_fail (web_view != NULL, NULL);
     window = gtk_widget_get_window (web_view);
     g_return_val_if_fail (window != NULL, NULL);
 
@@ -5220,6 +5716,10 @@ midori_view_get_snapshot (MidoriView* view,
  * midori_view_get_web_view
  * @view: a #MidoriView
  *
+ * Retrieves the web view, which is created if needed. Note
+ * that this doesn't load a page deferred with
+ * midori_view_defer_uri().
+ *
  * Returns: The #WebKitWebView for this view
  *
  * Since: 0.2.5
@@ -5229,6 +5729,27 @@ midori_view_get_web_view        (MidoriView*        view)
 {
     g_return_val_if_fail (MIDORI_IS_VIEW (view), NULL);
 
+    midori_view_ensure_web_view (view);
+    return view->web_view;
+}
+
+/**
+ * midori_view_peek_web_view
+ * @view: a #MidoriView
+ *
+ * Retrieves the web view if it was created already. Views restored
+ * in the background or hibernated have no web view until they are
+ * loaded, see MidoriView::web-view-created.
+ *
+ * Returns: The #WebKitWebView for this view, or %NULL
+ *
+ * Since: 0.3.0
+ **/
+GtkWidget*
+midori_view_peek_web_view       (MidoriView*        view)
+{
+    g_return_val_if_fail (MIDORI_IS_VIEW (view), NULL);
+
     return view->web_view;
 }
 
@@ -5248,104 +5769,292 @@ midori_view_get_security (MidoriView* view)
     return view->security;
 }
 
+/* Thumbnails are rendered by a small pool of off-screen views, fed
+   from one queue shared by all speed dial pages. Shortcuts added by
+   the user are rendered before refreshes of outdated thumbnails. */
+#define MIDORI_THUMB_VIEWS 2
+#define MIDORI_THUMB_QUEUE_MAX 32
+#define MIDORI_THUMB_MAX_AGE (60 * 60 * 24 * 7)
+#define MIDORI_THUMB_TIMEOUT 30
+
+typedef struct
+{
+    gchar* dom_id;
+    MidoriView* view;
+} MidoriThumbTarget;
+
+typedef struct
+{
+    gchar* uri;
+    gboolean urgent;
+    GSList* targets;
+} MidoriThumbJob;
+
+typedef struct
+{
+    GtkWidget* window;
+    GtkWidget* view;
+    MidoriThumbJob* job;
+    guint timeout_id;
+} MidoriThumbSlot;
+
+static GList* thumb_queue = NULL;
+static MidoriThumbSlot thumb_slots[MIDORI_THUMB_VIEWS];
+
+static void
+midori_thumb_queue_run (void);
+
+static void
+midori_thumb_job_add_target (MidoriThumbJob* job,
+                             MidoriView*     view,
+                             const gchar*    dom_id)
+{
+    MidoriThumbTarget* target = g_slice_new (MidoriThumbTarget);
+    target->dom_id = g_strdup (dom_id);
+    target->view = view;
+    g_object_add_weak_pointer (G_OBJECT (view), (gpointer*)&target->view);
+    job->targets = g_slist_prepend (job->targets, target);
+}
+
+static void
+midori_thumb_job_free (MidoriThumbJob* job)
+{
+    GSList* targets;
+
+    for (targets = job->targets; targets; targets = g_slist_next (targets))
+    {
+        MidoriThumbTarget* target = targets->data;
+        if (target->view)
+            g_object_remove_weak_pointer (G_OBJECT (target->view),
+                                          (gpointer*)&target->view);
+        g_free (target->dom_id);
+        g_slice_free (MidoriThumbTarget, target);
+    }
+    g_slist_free (job->targets);
+    g_free (job->uri);
+    g_slice_free (MidoriThumbJob, job);
+}
+
+static void
+midori_thumb_job_inject (MidoriThumbJob* job,
+                         const gchar*    filename)
+{
+    gchar* file_uri;
+    GSList* targets;
+
+    file_uri = g_filename_to_uri (filename, NULL, NULL);
+    for (targets = job->targets; targets; targets = g_slist_next (targets))
+    {
+        MidoriThumbTarget* target = targets->data;
+        gchar* js;
+
+        /* The view may have been closed or left the speed dial */
+        if (!target->view || !midori_view_is_blank (target->view))
+            continue;
+
+        /* The time forces the page to reload a refreshed file */
+        js = g_strdup_printf ("setThumbnail('%s','%s','%s',%ld);",
+                              target->dom_id, file_uri, job->uri,
+                              (glong)time (NULL));
+        webkit_web_view_execute_script (
+            WEBKIT_WEB_VIEW (target->view->web_view), js);
+        g_free (js);
+    }
+    g_free (file_uri);
+}
+
+static void
+midori_thumb_slot_finish (MidoriThumbSlot* slot)
+{
+    if (slot->timeout_id)
+    {
+        g_source_remove (slot->timeout_id);
+        slot->timeout_id = 0;
+    }
+    midori_thumb_job_free (slot->job);
+    slot->job = NULL;
+    /* Release the page, the view itself is used again */
+    midori_view_set_uri (MIDORI_VIEW (slot->view), "about:blank");
+    midori_thumb_queue_run ();
+}
+
 static void
-thumb_view_load_status_cb (MidoriView* thumb_view,
-                           GParamSpec* pspec,
-                           MidoriView* view)
+thumb_view_load_status_cb (MidoriView*      thumb_view,
+                           GParamSpec*      pspec,
+                           MidoriThumbSlot* slot)
 {
     GdkPixbuf* img;
-    gchar* file_content;
-    gchar* encoded;
-    gchar* dom_id;
-    gchar* js;
-    gsize sz;
+    gchar* filename;
 
-    if (midori_view_get_load_status (thumb_view) != MIDORI_LOAD_FINISHED)
+    if (!slot->job
+     || midori_view_get_load_status (thumb_view) != MIDORI_LOAD_FINISHED)
         return;
 
-    gtk_widget_realize (midori_view_get_web_view (MIDORI_VIEW (thumb_view)));
-    img = midori_view_get_snapshot (MIDORI_VIEW (thumb_view), 240, 160);
-    gdk_pixbuf_save_to_buffer (img, &file_content, &sz, "png", NULL, "compression", "7", NULL);
-    encoded = g_base64_encode ((guchar *)file_content, sz );
-
-    /* Call Javascript function to replace shortcut's content */
-    dom_id = g_object_get_data (G_OBJECT (thumb_view), "dom-id");
-    js = g_strdup_printf ("setThumbnail('%s','%s','%s');",
-                          dom_id, encoded, thumb_view->uri);
-    webkit_web_view_execute_script (WEBKIT_WEB_VIEW (view->web_view), js);
-    g_free (js);
-    g_object_unref (img);
-
-    g_free (dom_id);
-    g_free (encoded);
-    g_free (file_content);
-
-    g_signal_handlers_disconnect_by_func (
-       thumb_view, thumb_view_load_status_cb, view);
-
-    /* Destroying the view here may trigger a WebKitGTK+ 1.1.14 bug */
-    #if !WEBKIT_CHECK_VERSION (1, 1, 14) || WEBKIT_CHECK_VERSION (1, 1, 15)
-    gtk_widget_destroy (GTK_WIDGET (thumb_view));
-    view->thumb_view = NULL;
+    gtk_widget_realize (midori_view_get_web_view (thumb_view));
+    img = midori_view_get_snapshot (thumb_view, 240, 160);
+    filename = sokoke_speed_dial_thumb_filename (slot->job->uri);
+    if (img && gdk_pixbuf_save (img, filename, "png", NULL,
+                                "compression", "7", NULL))
+        midori_thumb_job_inject (slot->job, filename);
+    if (img)
+        g_object_unref (img);
+    g_free (filename);
+
+    midori_thumb_slot_finish (slot);
+}
+
+static gboolean
+midori_thumb_slot_timeout_cb (MidoriThumbSlot* slot)
+{
+    /* The page didn't finish loading, give up on it */
+    slot->timeout_id = 0;
+    midori_thumb_slot_finish (slot);
+    return FALSE;
+}
+
+static void
+midori_thumb_slot_init (MidoriThumbSlot* slot)
+{
+    MidoriWebSettings* settings;
+
+    settings = g_object_new (MIDORI_TYPE_WEB_SETTINGS, "enable-scripts", FALSE,
+        "enable-plugins", FALSE, "auto-load-images", TRUE,
+        "speed-dial-in-new-tabs", FALSE, NULL);
+    slot->view = midori_view_new_with_title (NULL, settings, FALSE);
+    g_object_unref (settings);
+    gtk_widget_set_size_request (slot->view, 720, 480);
+
+    /* Snapshots need a realized view, which must not be seen however */
+    #if GTK_CHECK_VERSION (2, 20, 0)
+    slot->window = gtk_offscreen_window_new ();
+    #else
+    slot->window = gtk_window_new (GTK_WINDOW_POPUP);
+    gtk_window_move (GTK_WINDOW (slot->window), -10000, -10000);
     #endif
+    gtk_container_add (GTK_CONTAINER (slot->window), slot->view);
+    gtk_widget_show_all (slot->window);
+
+    g_signal_connect (slot->view, "notify::load-status",
+        G_CALLBACK (thumb_view_load_status_cb), slot);
+}
+
+static void
+midori_thumb_queue_run (void)
+{
+    guint i;
+
+    for (i = 0; i < MIDORI_THUMB_VIEWS && thumb_queue; i++)
+    {
+        MidoriThumbSlot* slot = &thumb_slots[i];
+
+        if (slot->job)
+            continue;
+        if (!slot->view)
+            midori_thumb_slot_init (slot);
+
+        slot->job = thumb_queue->data;
+        thumb_queue = g_list_delete_link (thumb_queue, thumb_queue);
+        slot->timeout_id = g_timeout_add_seconds (MIDORI_THUMB_TIMEOUT,
+            (GSourceFunc)midori_thumb_slot_timeout_cb, slot);
+        midori_view_set_uri (MIDORI_VIEW (slot->view), slot->job->uri);
+    }
+}
+
+static MidoriThumbJob*
+midori_thumb_queue_find (const gchar* uri)
+{
+    GList* jobs;
+    guint i;
+
+    for (i = 0; i < MIDORI_THUMB_VIEWS; i++)
+        if (thumb_slots[i].job && !strcmp (thumb_slots[i].job->uri, uri))
+            return thumb_slots[i].job;
+    for (jobs = thumb_queue; jobs; jobs = g_list_next (jobs))
+        if (!strcmp (((MidoriThumbJob*)jobs->data)->uri, uri))
+            return jobs->data;
+    return NULL;
+}
+
+static void
+midori_thumb_queue_insert (MidoriThumbJob* job)
+{
+    GList* jobs;
+
+    if (!job->urgent)
+    {
+        /* Refreshes are cheap to drop, they are requested again */
+        if (g_list_length (thumb_queue) >= MIDORI_THUMB_QUEUE_MAX)
+        {
+            midori_thumb_job_free (job);
+            return;
+        }
+        thumb_queue = g_list_append (thumb_queue, job);
+        return;
+    }
+
+    /* Behind other urgent jobs but before all refreshes */
+    for (jobs = thumb_queue; jobs; jobs = g_list_next (jobs))
+        if (!((MidoriThumbJob*)jobs->data)->urgent)
+            break;
+    thumb_queue = g_list_insert_before (thumb_queue, jobs, job);
 }
 
 /**
  * midori_view_speed_dial_inject_thumb
  * @view: a #MidoriView
- * @filename: filename of the thumbnail
  * @dom_id: Id of the shortcut on speed_dial page in wich to inject content
  * @url: url of the shortcut
+ * @urgent: whether the shortcut was just added
+ *
+ * Queues rendering a thumbnail of @url. Refreshes are skipped
+ * if the existing thumbnail file isn't outdated yet.
  */
 static void
-midori_view_speed_dial_inject_thumb (MidoriView* view,
-                                     gchar*      filename,
-                                     gchar*      dom_id,
-                                     gchar*      url)
+midori_view_speed_dial_inject_thumb (MidoriView*  view,
+                                     const gchar* dom_id,
+                                     const gchar* url,
+                                     gboolean     urgent)
 {
-    GtkWidget* thumb_view;
-    MidoriWebSettings* settings;
-    GtkWidget* browser;
-    GtkWidget* notebook;
-    GtkWidget* label;
+    MidoriThumbJob* job;
 
-    browser = gtk_widget_get_toplevel (GTK_WIDGET (view));
-    if (!GTK_IS_WINDOW (browser))
-        return;
-
-    /* What we are doing here is a bit of a hack. In order to render a
-       thumbnail we need a new view and load the url in it. But it has
-       to be visible and packed in a container. So we secretly pack it
-       into the notebook of the parent browser. */
-    notebook = katze_object_get_object (browser, "notebook");
-    if (!notebook)
-        return;
+    if (!urgent)
+    {
+        gchar* filename = sokoke_speed_dial_thumb_filename (url);
+        struct stat st;
+        gboolean fresh = !g_stat (filename, &st)
+            && time (NULL) - st.st_mtime < MIDORI_THUMB_MAX_AGE;
+        g_free (filename);
+        if (fresh)
+            return;
+    }
 
-    if (!view->thumb_view)
+    if ((job = midori_thumb_queue_find (url)))
     {
-        view->thumb_view = midori_view_new_with_title (NULL, NULL, FALSE);
-        gtk_container_add (GTK_CONTAINER (notebook), view->thumb_view);
-        /* We use an empty label. It's not invisible but at least hard to spot. */
-        label = gtk_event_box_new ();
-        gtk_notebook_set_tab_label (GTK_NOTEBOOK (notebook), view->thumb_view, label);
-        gtk_widget_show (view->thumb_view);
+        midori_thumb_job_add_target (job, view, dom_id);
+        /* A job already being rendered is no longer queued */
+        if (urgent && !job->urgent && g_list_find (thumb_queue, job))
+        {
+            thumb_queue = g_list_remove (thumb_queue, job);
+            job->urgent = TRUE;
+            midori_thumb_queue_insert (job);
+        }
+        return;
     }
-    g_object_unref (notebook);
-    thumb_view = view->thumb_view;
-    settings = g_object_new (MIDORI_TYPE_WEB_SETTINGS, "enable-scripts", FALSE,
-        "enable-plugins", FALSE, "auto-load-images", TRUE, NULL);
-    _midori_view_set_settings (MIDORI_VIEW (thumb_view), settings);
 
-    g_object_set_data (G_OBJECT (thumb_view), "dom-id", dom_id);
-    g_signal_connect (thumb_view, "notify::load-status",
-        G_CALLBACK (thumb_view_load_status_cb), view);
-    midori_view_set_uri (MIDORI_VIEW (thumb_view), url);
+    job = g_slice_new (MidoriThumbJob);
+    job->uri = g_strdup (url);
+    job->urgent = urgent;
+    job->targets = NULL;
+    midori_thumb_job_add_target (job, view, dom_id);
+    midori_thumb_queue_insert (job);
+    midori_thumb_queue_run ();
 }
 
 /**
  * midori_view_speed_dial_get_thumb
  * @web_view: a #WebkitView
  * @message: Console log data
+ * @urgent: whether the shortcut was just added
  *
  * Load a thumbnail, and set the DOM
  *
@@ -5357,15 +6066,13 @@ midori_view_speed_dial_inject_thumb (MidoriView* view,
 static void
 midori_view_speed_dial_get_thumb (GtkWidget*   web_view,
                                   const gchar* message,
-                                  MidoriView*  view)
+                                  MidoriView*  view,
+                                  gboolean     urgent)
 {
     gchar** t_data = g_strsplit (message," ", 4);
 
-    if (t_data[1] == NULL || t_data[2] == NULL )
-        return;
-
-    midori_view_speed_dial_inject_thumb (view, NULL,
-        g_strdup (t_data[1]), g_strdup (t_data[2]));
+    if (t_data[1] != NULL && t_data[2] != NULL)
+        midori_view_speed_dial_inject_thumb (view, t_data[1], t_data[2], urgent);
     g_strfreev (t_data);
 }
 
@@ -5373,7 +6080,9 @@ midori_view_speed_dial_get_thumb (GtkWidget*   web_view,
  * midori_view_speed_dial_save
  * @web_view: a #WebkitView
  *
- * Save speed_dial DOM structure to body template
+ * Update the speed dial with the DOM structure sent by the page
+ *
+ * message == speed_dial-save '<JSON data>'
  *
  **/
 static void
@@ -5381,15 +6090,12 @@ midori_view_speed_dial_save (GtkWidget*   web_view,
                              const gchar* message)
 {
     gchar* json = g_strdup (message + 15);
-    gchar* fname = g_build_filename (sokoke_set_config_dir (NULL),
-                                     "speeddial.json", NULL);
 
-    GRegex* reg_double = g_regex_new ("\\\\\"", 0, 0, NULL);
-    gchar* safe = g_regex_replace_literal (reg_double, json, -1, 0, "\\\\\"", 0, NULL);
-    g_file_set_contents (fname, safe, -1, NULL);
-
-    g_free (fname);
+    g_strstrip (json);
+    if (json[0] == '\'' && json[1] && g_str_has_suffix (json, "'"))
+    {
+        json[strlen (json) - 1] = '\0';
+        midori_speed_dial_set_json (midori_speed_dial_get_default (), &json[1]);
+    }
     g_free (json);
-    g_free (safe);
-    g_regex_unref (reg_double);
 }
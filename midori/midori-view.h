@@ -99,6 +99,29 @@ void
 midori_view_set_uri                    (MidoriView*        view,
                                         const gchar*       uri);
 
+void
+midori_view_defer_uri                  (MidoriView*        view,
+                                        const gchar*       uri);
+
+gboolean
+midori_view_load_deferred              (MidoriView*        view);
+
+gboolean
+midori_view_is_deferred                (MidoriView*        view);
+
+glong
+midori_view_get_hidden_time            (MidoriView*        view);
+
+gboolean
+midori_view_hibernate                  (MidoriView*        view);
+
+void
+midori_view_set_throttled              (MidoriView*        view,
+                                        gboolean           throttled);
+
+gint64
+midori_view_get_script_time            (MidoriView*        view);
+
 gboolean
 midori_view_is_blank                   (MidoriView*        view);
 
@@ -231,6 +254,9 @@ midori_view_get_snapshot               (MidoriView*        view,
 GtkWidget*
 midori_view_get_web_view               (MidoriView*        view);
 
+GtkWidget*
+midori_view_peek_web_view              (MidoriView*        view);
+
 MidoriSecurity
 midori_view_get_security               (MidoriView*        view);
 
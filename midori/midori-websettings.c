@@ -58,6 +58,7 @@ struct _MidoriWebSettings
     gboolean zoom_text_and_images : 1;
     gboolean find_while_typing : 1;
     gboolean kinetic_scrolling : 1;
+    gboolean throttle_background_tabs : 1;
     MidoriAcceptCookies accept_cookies : 2;
     gboolean original_cookies_only : 1;
     gboolean remember_last_visited_pages : 1;
@@ -72,6 +73,11 @@ struct _MidoriWebSettings
     gint last_web_search;
     gint maximum_cookie_age;
     gint maximum_history_age;
+    gint background_requests;
+    gint background_requests_per_host;
+    gint restore_background_tabs;
+    gint hibernate_tabs_after;
+    gint maximum_loaded_tabs;
 
     gchar* toolbar_items;
     gchar* homepage;
@@ -166,6 +172,12 @@ enum
     PROP_IDENTIFY_AS,
     PROP_USER_AGENT,
     PROP_PREFERRED_LANGUAGES,
+    PROP_BACKGROUND_REQUESTS,
+    PROP_BACKGROUND_REQUESTS_PER_HOST,
+    PROP_RESTORE_BACKGROUND_TABS,
+    PROP_HIBERNATE_TABS_AFTER,
+    PROP_MAXIMUM_LOADED_TABS,
+    PROP_THROTTLE_BACKGROUND_TABS,
 
     PROP_CLEAR_PRIVATE_DATA,
     PROP_CLEAR_DATA
@@ -1060,6 +1072,112 @@ midori_web_settings_class_init (MidoriWebSettingsClass* class)
                                      NULL,
                                      flags));
 
+    /**
+     * MidoriWebSettings:background-requests:
+     *
+     * The maximum number of requests of background tabs
+     * loading at the same time, 0 for no limit. Requests
+     * of the current tab are never held back.
+     *
+     * Since: 0.3.0
+     */
+    g_object_class_install_property (gobject_class,
+                                     PROP_BACKGROUND_REQUESTS,
+                                     g_param_spec_int (
+                                     "background-requests",
+                                     _("Background requests"),
+                                     _("The maximum number of requests of background tabs at the same time"),
+                                     0, G_MAXINT, 4,
+                                     flags));
+
+    /**
+     * MidoriWebSettings:background-requests-per-host:
+     *
+     * The maximum number of requests of background tabs
+     * to the same host at the same time, 0 for no limit.
+     *
+     * Since: 0.3.0
+     */
+    g_object_class_install_property (gobject_class,
+                                     PROP_BACKGROUND_REQUESTS_PER_HOST,
+                                     g_param_spec_int (
+                                     "background-requests-per-host",
+                                     _("Background requests per host"),
+                                     _("The maximum number of requests of background tabs to one host"),
+                                     0, G_MAXINT, 2,
+                                     flags));
+
+    /**
+     * MidoriWebSettings:restore-background-tabs:
+     *
+     * The number of background tabs of a restored session
+     * that are loaded at the same time. With 0 background
+     * tabs are only loaded once they are selected.
+     *
+     * Since: 0.3.0
+     */
+    g_object_class_install_property (gobject_class,
+                                     PROP_RESTORE_BACKGROUND_TABS,
+                                     g_param_spec_int (
+                                     "restore-background-tabs",
+                                     _("Restore background tabs"),
+                                     _("The number of background tabs of a session loading at the same time"),
+                                     0, G_MAXINT, 0,
+                                     flags));
+
+    /**
+     * MidoriWebSettings:hibernate-tabs-after:
+     *
+     * The number of minutes after which a tab that wasn't
+     * looked at is unloaded, 0 to keep tabs loaded. The
+     * page is loaded again when the tab is selected.
+     *
+     * Since: 0.3.0
+     */
+    g_object_class_install_property (gobject_class,
+                                     PROP_HIBERNATE_TABS_AFTER,
+                                     g_param_spec_int (
+                                     "hibernate-tabs-after",
+                                     _("Hibernate tabs after"),
+                                     _("The number of minutes after which tabs that weren't looked at are unloaded"),
+                                     0, G_MAXINT, 0,
+                                     flags));
+
+    /**
+     * MidoriWebSettings:maximum-loaded-tabs:
+     *
+     * The maximum number of loaded tabs per window, 0 for
+     * no limit. Tabs that weren't looked at the longest
+     * are unloaded first.
+     *
+     * Since: 0.3.0
+     */
+    g_object_class_install_property (gobject_class,
+                                     PROP_MAXIMUM_LOADED_TABS,
+                                     g_param_spec_int (
+                                     "maximum-loaded-tabs",
+                                     _("Maximum loaded tabs"),
+                                     _("The maximum number of loaded tabs per window"),
+                                     0, G_MAXINT, 0,
+                                     flags));
+
+    /**
+     * MidoriWebSettings:throttle-background-tabs:
+     *
+     * Whether script timers of tabs which aren't shown, or
+     * whose window is minimized, run at most once per second.
+     *
+     * Since: 0.3.0
+     */
+    g_object_class_install_property (gobject_class,
+                                     PROP_THROTTLE_BACKGROUND_TABS,
+                                     g_param_spec_boolean (
+                                     "throttle-background-tabs",
+                                     _("Throttle background tabs"),
+                                     _("Whether script timers of tabs which aren't shown run at most once per second"),
+                                     TRUE,
+                                     flags));
+
     /**
      * MidoriWebSettings:clear-private-data:
      *
@@ -1133,6 +1251,7 @@ midori_web_settings_init (MidoriWebSettings* web_settings)
     web_settings->open_popups_in_tabs = TRUE;
     web_settings->remember_last_downloaded_files = TRUE;
     web_settings->kinetic_scrolling = TRUE;
+    web_settings->throttle_background_tabs = TRUE;
 
     g_signal_connect (web_settings, "notify::default-encoding",
                       G_CALLBACK (notify_default_encoding_cb), NULL);
@@ -1503,6 +1622,24 @@ midori_web_settings_set_property (GObject*      object,
                       web_settings->http_accept_language, NULL);
         #endif
         break;
+    case PROP_BACKGROUND_REQUESTS:
+        web_settings->background_requests = g_value_get_int (value);
+        break;
+    case PROP_BACKGROUND_REQUESTS_PER_HOST:
+        web_settings->background_requests_per_host = g_value_get_int (value);
+        break;
+    case PROP_RESTORE_BACKGROUND_TABS:
+        web_settings->restore_background_tabs = g_value_get_int (value);
+        break;
+    case PROP_HIBERNATE_TABS_AFTER:
+        web_settings->hibernate_tabs_after = g_value_get_int (value);
+        break;
+    case PROP_MAXIMUM_LOADED_TABS:
+        web_settings->maximum_loaded_tabs = g_value_get_int (value);
+        break;
+    case PROP_THROTTLE_BACKGROUND_TABS:
+        web_settings->throttle_background_tabs = g_value_get_boolean (value);
+        break;
     case PROP_CLEAR_PRIVATE_DATA:
         web_settings->clear_private_data = g_value_get_int (value);
         break;
@@ -1734,6 +1871,24 @@ midori_web_settings_get_property (GObject*    object,
     case PROP_PREFERRED_LANGUAGES:
         g_value_set_string (value, web_settings->http_accept_language);
         break;
+    case PROP_BACKGROUND_REQUESTS:
+        g_value_set_int (value, web_settings->background_requests);
+        break;
+    case PROP_BACKGROUND_REQUESTS_PER_HOST:
+        g_value_set_int (value, web_settings->background_requests_per_host);
+        break;
+    case PROP_RESTORE_BACKGROUND_TABS:
+        g_value_set_int (value, web_settings->restore_background_tabs);
+        break;
+    case PROP_HIBERNATE_TABS_AFTER:
+        g_value_set_int (value, web_settings->hibernate_tabs_after);
+        break;
+    case PROP_MAXIMUM_LOADED_TABS:
+        g_value_set_int (value, web_settings->maximum_loaded_tabs);
+        break;
+    case PROP_THROTTLE_BACKGROUND_TABS:
+        g_value_set_boolean (value, web_settings->throttle_background_tabs);
+        break;
     case PROP_CLEAR_PRIVATE_DATA:
         g_value_set_int (value, web_settings->clear_private_data);
         break;
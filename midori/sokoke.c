@@ -24,6 +24,7 @@
 #endif
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #ifdef GDK_WINDOWING_X11
     #include <gdk/gdkx.h>
@@ -714,45 +715,6 @@ gchar* sokoke_search_uri (const gchar* uri,
     return search;
 }
 
-static void
-sokoke_resolve_hostname_cb (SoupAddress *address,
-                            guint        status,
-                            gpointer     data)
-{
-    if (status == SOUP_STATUS_OK)
-        *(gint *)data = 1;
-    else
-        *(gint *)data = 2;
-}
-
-/**
- * sokoke_resolve_hostname
- * @hostname: a string typed by a user
- *
- * Takes a string that was typed by a user,
- * resolves the hostname, and returns the status.
- *
- * Return value: %TRUE if is a valid host, else %FALSE
- **/
-gboolean
-sokoke_resolve_hostname (const gchar* hostname)
-{
-    gchar* uri;
-    gint host_resolved = 0;
-
-    uri = g_strconcat ("http://", hostname, NULL);
-    if (sokoke_prefetch_uri (uri, sokoke_resolve_hostname_cb,
-                             &host_resolved))
-    {
-        GTimer* timer = g_timer_new ();
-        while (!host_resolved && g_timer_elapsed (timer, NULL) < 10)
-            g_main_context_iteration (NULL, FALSE);
-        g_timer_destroy (timer);
-    }
-    g_free (uri);
-    return host_resolved == 1 ? TRUE : FALSE;
-}
-
 gboolean
 sokoke_external_uri (const gchar* uri)
 {
@@ -775,6 +737,37 @@ sokoke_external_uri (const gchar* uri)
     return info != NULL;
 }
 
+/**
+ * sokoke_magic_uri_needs_lookup:
+ * @uri: a string typed by a user
+ *
+ * Determines whether sokoke_magic_uri() can only guess
+ * that @uri starts with a host name, such as "localhost"
+ * or "intranet/wiki". The host name is not resolved
+ * because that may take a long time, so the caller
+ * should confirm it with sokoke_prefetch_uri().
+ *
+ * Return value: %TRUE if @uri may turn out to be a search
+ **/
+gboolean
+sokoke_magic_uri_needs_lookup (const gchar* uri)
+{
+    const gchar* slash;
+    const gchar* p;
+
+    g_return_val_if_fail (uri, FALSE);
+
+    if (!strcmp (uri, "localhost"))
+        return TRUE;
+    if (!(slash = strchr (uri, '/')) || slash == uri)
+        return FALSE;
+    /* Dotted names are hosts either way, spaces make it a search */
+    for (p = uri; p < slash; p++)
+        if (*p == ' ' || *p == '.' || *p == ':' || *p == '@')
+            return FALSE;
+    return TRUE;
+}
+
 /**
  * sokoke_magic_uri:
  * @uri: a string typed by a user
@@ -784,6 +777,9 @@ sokoke_external_uri (const gchar* uri)
  *
  * If it was a search, %NULL will be returned.
  *
+ * Host names without a dot are assumed to exist,
+ * see sokoke_magic_uri_needs_lookup().
+ *
  * Return value: a newly allocated URI, or %NULL
  **/
 gchar*
@@ -816,8 +812,7 @@ sokoke_magic_uri (const gchar* uri)
         ((search = strchr (uri, ':')) || (search = strchr (uri, '@'))) &&
         search[0] && !g_ascii_isalpha (search[1]))
         return sokoke_idn_to_punycode (g_strconcat ("http://", uri, NULL));
-    if ((!strcmp (uri, "localhost") || strchr (uri, '/'))
-      && sokoke_resolve_hostname (uri))
+    if (sokoke_magic_uri_needs_lookup (uri))
         return g_strconcat ("http://", uri, NULL);
     if (!search)
     {
@@ -1909,25 +1904,183 @@ sokoke_file_chooser_dialog_new (const gchar*         title,
     return dialog;
 }
 
+/* Resolved hosts are remembered for a while, failures for a shorter
+   time so that a typo fixed on the server side doesn't stick. */
+#define SOKOKE_PREFETCH_TTL (60 * 5)
+#define SOKOKE_PREFETCH_FAILURE_TTL 60
+#define SOKOKE_PREFETCH_MAX_HOSTS 512
+#define SOKOKE_PREFETCH_MAX_RESOLVING 4
+#define SOKOKE_PREFETCH_MAX_QUEUED 16
+
+typedef struct
+{
+    SoupAddressCallback callback;
+    gpointer user_data;
+} SokokePrefetchWaiter;
+
+typedef struct
+{
+    gchar* host;
+    time_t expires; /* 0 while the host is being resolved */
+    guint status;
+    GSList* waiters;
+} SokokePrefetchHost;
+
+static GHashTable* prefetch_hosts = NULL;
+static GQueue prefetch_queue = G_QUEUE_INIT;
+static guint prefetch_resolving = 0;
+static guint prefetch_hits = 0;
+static guint prefetch_misses = 0;
+
+static void
+sokoke_prefetch_host_free (SokokePrefetchHost* entry)
+{
+    g_free (entry->host);
+    g_slice_free (SokokePrefetchHost, entry);
+}
+
+static gboolean
+sokoke_prefetch_host_expired_cb (gpointer key,
+                                 gpointer value,
+                                 gpointer now)
+{
+    SokokePrefetchHost* entry = value;
+    return entry->expires && entry->expires <= *(time_t*)now;
+}
+
+static gint
+sokoke_prefetch_host_compare_expiry (gconstpointer a,
+                                     gconstpointer b)
+{
+    time_t expires_a = ((const SokokePrefetchHost*)a)->expires;
+    time_t expires_b = ((const SokokePrefetchHost*)b)->expires;
+    return expires_a < expires_b ? -1 : expires_a > expires_b ? 1 : 0;
+}
+
+/* Drops a quarter of the resolved hosts, those expiring first */
+static void
+sokoke_prefetch_hosts_evict (void)
+{
+    GHashTableIter iter;
+    SokokePrefetchHost* entry;
+    GList* resolved = NULL;
+    GList* l;
+    guint count = SOKOKE_PREFETCH_MAX_HOSTS / 4;
+
+    g_hash_table_iter_init (&iter, prefetch_hosts);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer*)&entry))
+        if (entry->expires)
+            resolved = g_list_prepend (resolved, entry);
+    resolved = g_list_sort (resolved, sokoke_prefetch_host_compare_expiry);
+    for (l = resolved; l && count; l = g_list_next (l), count--)
+        g_hash_table_remove (prefetch_hosts,
+                             ((SokokePrefetchHost*)l->data)->host);
+    g_list_free (resolved);
+}
+
+static void
+sokoke_prefetch_queue_run (void);
+
+static void
+sokoke_prefetch_resolved_cb (SoupAddress* address,
+                             guint        status,
+                             gpointer     data)
+{
+    SokokePrefetchHost* entry = data;
+    GSList* waiters = entry->waiters;
+    GSList* l;
+
+    prefetch_resolving--;
+    entry->status = status;
+    entry->expires = time (NULL) + (status == SOUP_STATUS_OK
+        ? SOKOKE_PREFETCH_TTL : SOKOKE_PREFETCH_FAILURE_TTL);
+    entry->waiters = NULL;
+
+    for (l = waiters; l != NULL; l = g_slist_next (l))
+    {
+        SokokePrefetchWaiter* waiter = l->data;
+        waiter->callback (address, status, waiter->user_data);
+        g_slice_free (SokokePrefetchWaiter, waiter);
+    }
+    g_slist_free (waiters);
+
+    sokoke_prefetch_queue_run ();
+}
+
+static void
+sokoke_prefetch_queue_run (void)
+{
+    while (prefetch_resolving < SOKOKE_PREFETCH_MAX_RESOLVING
+        && !g_queue_is_empty (&prefetch_queue))
+    {
+        SokokePrefetchHost* entry = g_queue_pop_head (&prefetch_queue);
+        SoupAddress* address;
+
+        prefetch_resolving++;
+        address = soup_address_new (entry->host, SOUP_ADDRESS_ANY_PORT);
+        soup_address_resolve_async (address, NULL, NULL,
+            sokoke_prefetch_resolved_cb, entry);
+        g_object_unref (address);
+    }
+}
+
+static void
+sokoke_prefetch_queue_push (SokokePrefetchHost* entry)
+{
+    GList* queued;
+
+    /* Somebody waits for the result, so it goes first */
+    if (entry->waiters)
+    {
+        g_queue_push_head (&prefetch_queue, entry);
+        return;
+    }
+
+    /* Speculative lookups are dropped oldest first, the user
+       has likely moved on from the links that requested them */
+    if (g_queue_get_length (&prefetch_queue) >= SOKOKE_PREFETCH_MAX_QUEUED)
+    {
+        for (queued = prefetch_queue.head; queued; queued = g_list_next (queued))
+        {
+            SokokePrefetchHost* old_entry = queued->data;
+            if (!old_entry->waiters)
+            {
+                g_queue_delete_link (&prefetch_queue, queued);
+                g_hash_table_remove (prefetch_hosts, old_entry->host);
+                break;
+            }
+        }
+    }
+    g_queue_push_tail (&prefetch_queue, entry);
+}
+
 /**
  * sokoke_prefetch_uri:
  * @uri: an URI string
+ * @callback: a #SoupAddressCallback, or %NULL
+ * @user_data: data to pass to @callback
  *
  * Attempts to prefetch the specified URI, that is
  * it tries to resolve the hostname in advance.
  *
- * Return value: %TRUE on success
+ * Hosts are remembered for a few minutes, and only a
+ * few are resolved at the same time. If the host is
+ * already known, @callback is called immediately with
+ * a %NULL address.
+ *
+ * Return value: %TRUE if the host is resolved or known, in
+ *     which case @callback, if given, is going to be called
  **/
 gboolean
 sokoke_prefetch_uri (const char*         uri,
                      SoupAddressCallback callback,
                      gpointer            user_data)
 {
-    #define MAXHOSTS 50
-    static gchar* hosts = NULL;
-    static gint host_count = G_MAXINT;
-
     SoupURI* s_uri;
+    gchar* host;
+    SokokePrefetchHost* entry;
+    GList* queued;
+    time_t now;
 
     if (!uri)
         return FALSE;
@@ -1950,32 +2103,89 @@ sokoke_prefetch_uri (const char*         uri,
         return FALSE;
     }
 
-    if (!hosts ||
-        !g_regex_match_simple (s_uri->host, hosts,
-                               G_REGEX_CASELESS, G_REGEX_MATCH_NOTEMPTY))
+    host = g_ascii_strdown (s_uri->host, -1);
+    soup_uri_free (s_uri);
+
+    if (!prefetch_hosts)
+        prefetch_hosts = g_hash_table_new_full (g_str_hash, g_str_equal,
+            NULL, (GDestroyNotify)sokoke_prefetch_host_free);
+
+    now = time (NULL);
+    entry = g_hash_table_lookup (prefetch_hosts, host);
+    if (entry && (!entry->expires || entry->expires > now))
     {
-        SoupAddress* address;
-        gchar* new_hosts;
+        prefetch_hits++;
+        if (entry->expires && callback)
+            callback (NULL, entry->status, user_data);
+        else if (callback)
+        {
+            /* Still being resolved, the result is shared */
+            SokokePrefetchWaiter* waiter = g_slice_new (SokokePrefetchWaiter);
+            waiter->callback = callback;
+            waiter->user_data = user_data;
+            entry->waiters = g_slist_append (entry->waiters, waiter);
+            if ((queued = g_queue_find (&prefetch_queue, entry)))
+            {
+                g_queue_delete_link (&prefetch_queue, queued);
+                g_queue_push_head (&prefetch_queue, entry);
+            }
+        }
+        g_free (host);
+        return TRUE;
+    }
 
-        address = soup_address_new (s_uri->host, SOUP_ADDRESS_ANY_PORT);
-        soup_address_resolve_async (address, 0, 0, callback, user_data);
-        g_object_unref (address);
+    prefetch_misses++;
+    if (g_getenv ("MIDORI_DNS_DEBUG") != NULL)
+        g_print ("Prefetching %s (%u hits, %u misses, %u resolving)\n",
+                 host, prefetch_hits, prefetch_misses, prefetch_resolving);
 
-        if (host_count > MAXHOSTS)
+    if (!entry)
+    {
+        if (g_hash_table_size (prefetch_hosts) >= SOKOKE_PREFETCH_MAX_HOSTS)
         {
-            katze_assign (hosts, g_strdup (""));
-            host_count = 0;
+            g_hash_table_foreach_remove (prefetch_hosts,
+                sokoke_prefetch_host_expired_cb, &now);
+            if (g_hash_table_size (prefetch_hosts) >= SOKOKE_PREFETCH_MAX_HOSTS)
+                sokoke_prefetch_hosts_evict ();
         }
-        host_count++;
-        new_hosts = g_strdup_printf ("%s|%s", hosts, s_uri->host);
-        katze_assign (hosts, new_hosts);
+        entry = g_slice_new0 (SokokePrefetchHost);
+        entry->host = host;
+        g_hash_table_insert (prefetch_hosts, entry->host, entry);
     }
-    else if (callback)
-        callback (NULL, SOUP_STATUS_OK, user_data);
-    soup_uri_free (s_uri);
+    else
+        g_free (host);
+
+    entry->expires = 0;
+    if (callback)
+    {
+        SokokePrefetchWaiter* waiter = g_slice_new (SokokePrefetchWaiter);
+        waiter->callback = callback;
+        waiter->user_data = user_data;
+        entry->waiters = g_slist_append (entry->waiters, waiter);
+    }
+    sokoke_prefetch_queue_push (entry);
+    sokoke_prefetch_queue_run ();
     return TRUE;
 }
 
+/**
+ * sokoke_prefetch_get_stats:
+ * @hits: location to store the number of cache hits, or %NULL
+ * @misses: location to store the number of lookups, or %NULL
+ *
+ * Retrieves how many prefetched hosts were found in
+ * the cache, and how many had to be resolved.
+ **/
+void
+sokoke_prefetch_get_stats (guint* hits,
+                           guint* misses)
+{
+    if (hits)
+        *hits = prefetch_hits;
+    if (misses)
+        *misses = prefetch_misses;
+}
+
 /**
  * sokoke_recursive_fork_protection
  * @uri: the URI to check
@@ -2092,6 +2302,204 @@ sokoke_accept_languages (const gchar* const * lang_names)
     return langs_str;
 }
 
+/**
+ * sokoke_fts_prefix_query:
+ * @key: text typed by the user
+ *
+ * Builds a full text query matching all words of @key as
+ * prefixes of tokens, splitting the key like the simple
+ * tokenizer of SQLite. Operators are lowercased so that
+ * they are treated as plain words.
+ *
+ * Return value: a newly allocated query, or %NULL
+ **/
+gchar*
+sokoke_fts_prefix_query (const gchar* key)
+{
+    GString* query;
+    gboolean in_token;
+
+    g_return_val_if_fail (key != NULL, NULL);
+
+    query = g_string_sized_new (strlen (key) + 2);
+    in_token = FALSE;
+    for (; *key; key++)
+    {
+        if (g_ascii_isalnum (*key) || (guchar)*key >= 0x80)
+        {
+            if (!in_token && query->len)
+                g_string_append_c (query, ' ');
+            g_string_append_c (query, g_ascii_tolower (*key));
+            in_token = TRUE;
+        }
+        else if (in_token)
+        {
+            g_string_append_c (query, '*');
+            in_token = FALSE;
+        }
+    }
+    if (in_token)
+        g_string_append_c (query, '*');
+
+    if (!query->len)
+    {
+        g_string_free (query, TRUE);
+        return NULL;
+    }
+    return g_string_free (query, FALSE);
+}
+
+/**
+ * sokoke_open_database:
+ * @filename: the filename of the database
+ * @errmsg: location for an error message, or %NULL
+ *
+ * Opens a profile database with write-ahead logging, so that
+ * readers don't block on writers, relaxed synchronisation and
+ * incremental vacuuming. A database created without incremental
+ * vacuuming is converted by sokoke_maintain_database().
+ *
+ * Return value: an opened database, or %NULL
+ **/
+sqlite3*
+sokoke_open_database (const gchar* filename,
+                      char**       errmsg)
+{
+    sqlite3* db;
+
+    if (sqlite3_open (filename, &db) != SQLITE_OK)
+    {
+        if (errmsg)
+            *errmsg = g_strdup_printf (_("Failed to open database: %s\n"),
+                                       sqlite3_errmsg (db));
+        sqlite3_close (db);
+        return NULL;
+    }
+
+    /* Only takes effect for a new database, without any tables */
+    sqlite3_exec (db, "PRAGMA auto_vacuum = INCREMENTAL;", NULL, NULL, NULL);
+
+    /* Older versions of SQLite silently ignore unknown pragmas */
+    sqlite3_exec (db,
+                  "PRAGMA journal_mode = WAL;"
+                  "PRAGMA synchronous = NORMAL;"
+                  "PRAGMA cache_size = -4096;"
+                  "PRAGMA mmap_size = 33554432;",
+                  NULL, NULL, NULL);
+    return db;
+}
+
+/**
+ * sokoke_maintain_database:
+ * @db: a database opened with sokoke_open_database()
+ *
+ * Returns a bounded number of free pages to the file system
+ * and updates query planner statistics if needed. This is
+ * cheap enough to be done periodically while idle.
+ *
+ * A database created without incremental vacuuming is
+ * converted once, with a full vacuum, which may take a while.
+ * It must not be called while a transaction is open.
+ **/
+void
+sokoke_maintain_database (sqlite3* db)
+{
+    sqlite3_stmt* stmt;
+    gint auto_vacuum = 0;
+    const gchar* sqlcmd;
+    char* errmsg = NULL;
+
+    g_return_if_fail (db != NULL);
+
+    if (sqlite3_prepare_v2 (db, "PRAGMA auto_vacuum", -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step (stmt) == SQLITE_ROW)
+            auto_vacuum = sqlite3_column_int (stmt, 0);
+        sqlite3_finalize (stmt);
+    }
+
+    if (auto_vacuum != 2 /* incremental */)
+        sqlcmd = "PRAGMA auto_vacuum = INCREMENTAL; VACUUM; PRAGMA optimize;";
+    else
+        sqlcmd = "PRAGMA incremental_vacuum (256); PRAGMA optimize;";
+    if (sqlite3_exec (db, sqlcmd, NULL, NULL, &errmsg) != SQLITE_OK)
+    {
+        g_warning ("Failed to vacuum database: %s", errmsg);
+        sqlite3_free (errmsg);
+    }
+}
+
+static gpointer
+sokoke_maintain_database_thread (gchar* filename)
+{
+    sqlite3* db;
+
+    if ((db = sokoke_open_database (filename, NULL)))
+    {
+        /* Writes of the user interface take precedence */
+        sqlite3_busy_timeout (db, 5000);
+        sokoke_maintain_database (db);
+        sqlite3_close (db);
+    }
+    g_free (filename);
+    return NULL;
+}
+
+/**
+ * sokoke_maintain_database_file:
+ * @filename: the filename of the database
+ *
+ * Runs sokoke_maintain_database() on a separate connection
+ * in a new thread, so that converting a database with a full
+ * vacuum doesn't block the user interface.
+ *
+ * Other connections to the database should set a busy timeout
+ * since writes wait until the vacuum is done.
+ **/
+void
+sokoke_maintain_database_file (const gchar* filename)
+{
+    gchar* copy;
+
+    g_return_if_fail (filename != NULL);
+
+    copy = g_strdup (filename);
+    if (!g_thread_create ((GThreadFunc)sokoke_maintain_database_thread,
+                          copy, FALSE, NULL))
+        g_free (copy);
+}
+
+/**
+ * sokoke_speed_dial_thumb_filename:
+ * @uri: the URI of a speed dial shortcut
+ *
+ * Determines the file a thumbnail of @uri is stored in,
+ * creating the thumbnail folder if needed.
+ *
+ * Return value: a newly allocated filename
+ **/
+gchar*
+sokoke_speed_dial_thumb_filename (const gchar* uri)
+{
+    gchar* checksum;
+    gchar* filename;
+    gchar* folder;
+    gchar* path;
+
+    g_return_val_if_fail (uri != NULL, NULL);
+
+    folder = g_build_filename (g_get_user_cache_dir (), PACKAGE_NAME,
+                               "thumbnails", NULL);
+    katze_mkdir_with_parents (folder, 0700);
+    checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+    filename = g_strdup_printf ("%s.png", checksum);
+    path = g_build_filename (folder, filename, NULL);
+    g_free (checksum);
+    g_free (filename);
+    g_free (folder);
+    return path;
+}
+
 /**
  * sokoke_register_privacy_item:
  * @name: the name of the privacy item
@@ -23,6 +23,7 @@
 
 #include <webkit/webkit.h>
 #include <JavaScriptCore/JavaScript.h>
+#include <sqlite3.h>
 
 #if !GLIB_CHECK_VERSION (2, 14, 0)
     #define G_PARAM_STATIC_STRINGS \
@@ -59,6 +60,7 @@
 
 #if !GTK_CHECK_VERSION (2, 20, 0)
     #define gtk_widget_get_realized(widget) GTK_WIDGET_REALIZED (widget)
+    #define gtk_widget_get_mapped(widget) GTK_WIDGET_MAPPED (widget)
 #endif
 
 #if !GTK_CHECK_VERSION(2, 12, 0)
@@ -122,6 +124,9 @@ sokoke_uri_to_ascii                     (const gchar*    uri);
 gboolean
 sokoke_external_uri                     (const gchar*    uri);
 
+gboolean
+sokoke_magic_uri_needs_lookup           (const gchar*    uri);
+
 gchar*
 sokoke_magic_uri                        (const gchar*    uri);
 
@@ -258,8 +263,9 @@ sokoke_prefetch_uri                     (const char*         uri,
                                          SoupAddressCallback callback,
                                          gpointer            user_data);
 
-gboolean
-sokoke_resolve_hostname                 (const gchar*        hostname);
+void
+sokoke_prefetch_get_stats               (guint*              hits,
+                                         guint*              misses);
 
 gchar *
 sokoke_accept_languages                 (const gchar* const * lang_names);
@@ -268,6 +274,22 @@ gboolean
 sokoke_recursive_fork_protection        (const gchar*         uri,
                                          gboolean             set_uri);
 
+gchar*
+sokoke_fts_prefix_query                 (const gchar*         key);
+
+sqlite3*
+sokoke_open_database                    (const gchar*         filename,
+                                         char**               errmsg);
+
+void
+sokoke_maintain_database                (sqlite3*             db);
+
+void
+sokoke_maintain_database_file           (const gchar*         filename);
+
+gchar*
+sokoke_speed_dial_thumb_filename        (const gchar*         uri);
+
 typedef struct
 {
     gchar* name;
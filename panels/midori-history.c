@@ -14,6 +14,8 @@
 #include "midori-app.h"
 #include "midori-array.h"
 #include "midori-browser.h"
+#include "midori-completionindex.h"
+#include "midori-historywriter.h"
 #include "midori-stock.h"
 #include "midori-view.h"
 #include "midori-viewable.h"
@@ -159,28 +161,29 @@ midori_history_remove_item_from_db (MidoriHistory* history,
                                     KatzeItem*     item)
 {
     gchar* sqlcmd;
-    sqlite3* db;
-    char* errmsg = NULL;
+    MidoriHistoryWriter* writer;
+    MidoriCompletionIndex* completion;
 
-    db = g_object_get_data (G_OBJECT (history->array), "db");
+    writer = g_object_get_data (G_OBJECT (history->array), "writer");
+    completion = g_object_get_data (G_OBJECT (history->array), "completion");
 
+    /* Pages are listed once per day, so all visits of that day go */
     if (KATZE_ITEM_IS_BOOKMARK (item))
+    {
         sqlcmd = sqlite3_mprintf (
-            "DELETE FROM history WHERE uri = '%q' AND"
-            " title = '%q' AND date = %llu",
-            katze_item_get_uri (item),
-            katze_item_get_name (item),
-            katze_item_get_added (item));
+            "DELETE FROM visits WHERE day = %d AND"
+            " url = (SELECT id FROM urls WHERE uri = '%q')",
+            katze_item_get_meta_integer (item, "day"),
+            katze_item_get_uri (item));
+        /* Don't suggest the page anymore, even if visited on other days */
+        if (completion)
+            midori_completion_index_remove (completion, katze_item_get_uri (item));
+    }
     else
-       sqlcmd = sqlite3_mprintf ("DELETE FROM history WHERE day = %d",
+       sqlcmd = sqlite3_mprintf ("DELETE FROM visits WHERE day = %d",
                 katze_item_get_meta_integer (item, "day"));
 
-    if (sqlite3_exec (db, sqlcmd, NULL, NULL, &errmsg) != SQLITE_OK)
-    {
-        g_printerr (_("Failed to remove history item: %s\n"), errmsg);
-        sqlite3_free (errmsg);
-    }
-
+    midori_history_writer_exec (writer, sqlcmd);
     sqlite3_free (sqlcmd);
 }
 
@@ -212,28 +215,48 @@ midori_history_read_from_db (MidoriHistory* history,
         gchar* filterstr;
 
         sqlcmd = "SELECT * FROM ("
-                 "    SELECT uri, title, day, date FROM history"
-                 "    WHERE uri LIKE ?1 OR title LIKE ?1 GROUP BY uri "
+                 "    SELECT uri, title, day, max (date) AS date FROM urls"
+                 "    JOIN visits ON visits.url = urls.id"
+                 "    WHERE urls.id IN (SELECT docid FROM urls_fts"
+                 "                      WHERE urls_fts MATCH ?1) GROUP BY urls.id "
                  "UNION ALL "
                  "    SELECT replace (uri, '%s', keywords) AS uri, "
                  "    keywords AS title, day, 0 AS date FROM search "
-                 "    WHERE uri LIKE ?1 OR keywords LIKE ?1 GROUP BY uri "
+                 "    WHERE rowid IN (SELECT docid FROM search_fts"
+                 "                    WHERE search_fts MATCH ?1) GROUP BY uri "
                  ") ORDER BY day ASC";
         result = sqlite3_prepare_v2 (db, sqlcmd, -1, &statement, NULL);
-        filterstr = g_strdup_printf ("%%%s%%", filter);
-        sqlite3_bind_text (statement, 1, filterstr, -1, g_free);
+        if (result == SQLITE_OK)
+            filterstr = sokoke_fts_prefix_query (filter);
+        else
+        {
+            /* No full text index, SQLite may be built without FTS3 */
+            sqlcmd = "SELECT * FROM ("
+                     "    SELECT uri, title, day, max (date) AS date FROM urls"
+                     "    JOIN visits ON visits.url = urls.id"
+                     "    WHERE uri LIKE ?1 OR title LIKE ?1 GROUP BY urls.id "
+                     "UNION ALL "
+                     "    SELECT replace (uri, '%s', keywords) AS uri, "
+                     "    keywords AS title, day, 0 AS date FROM search "
+                     "    WHERE uri LIKE ?1 OR keywords LIKE ?1 GROUP BY uri "
+                     ") ORDER BY day ASC";
+            result = sqlite3_prepare_v2 (db, sqlcmd, -1, &statement, NULL);
+            filterstr = g_strdup_printf ("%%%s%%", filter);
+        }
+        sqlite3_bind_text (statement, 1, filterstr ? filterstr : g_strdup (""),
+                           -1, g_free);
         req_day = -1;
     }
     else if (req_day == 0)
     {
-        sqlcmd = "SELECT day, date FROM history GROUP BY day ORDER BY day ASC";
+        sqlcmd = "SELECT day, date FROM visits GROUP BY day ORDER BY day ASC";
         result = sqlite3_prepare_v2 (db, sqlcmd, -1, &statement, NULL);
     }
     else
     {
-        sqlcmd = "SELECT uri, title, date, day "
-                 "FROM history WHERE day = ? "
-                 "GROUP BY uri ORDER BY date ASC";
+        sqlcmd = "SELECT uri, title, max (date) AS date, day "
+                 "FROM visits JOIN urls ON urls.id = visits.url WHERE day = ? "
+                 "GROUP BY url ORDER BY date ASC";
         result = sqlite3_prepare_v2 (db, sqlcmd, -1, &statement, NULL);
         sqlite3_bind_int64 (statement, 1, req_day);
     }
@@ -663,9 +686,9 @@ midori_history_open_in_tab_activate_cb (GtkWidget*     menuitem,
         KatzeArray* array;
 
         db = g_object_get_data (G_OBJECT (history->array), "db");
-        sqlcmd = g_strdup_printf ("SELECT uri, title, date, day "
-                 "FROM history WHERE day = %d "
-                 "GROUP BY uri ORDER BY date ASC",
+        sqlcmd = g_strdup_printf ("SELECT uri, title, max (date) AS date, day "
+                 "FROM visits JOIN urls ON urls.id = visits.url WHERE day = %d "
+                 "GROUP BY url ORDER BY date ASC",
                  (int)katze_item_get_added (item));
         array = katze_array_from_sqlite (db, sqlcmd);
         g_free (sqlcmd);
@@ -95,12 +95,15 @@ magic_uri_uri (void)
     test_input ("example.com", "http://example.com");
     test_input ("www.google..com", "http://www.google..com");
     test_input ("/home/user/midori.html", "file:///home/user/midori.html");
-    if (sokoke_resolve_hostname ("localhost"))
-    {
-        test_input ("localhost", "http://localhost");
-        test_input ("localhost:8000", "http://localhost:8000");
-        test_input ("localhost/rss", "http://localhost/rss");
-    }
+    test_input ("localhost", "http://localhost");
+    test_input ("localhost:8000", "http://localhost:8000");
+    test_input ("localhost/rss", "http://localhost/rss");
+    test_input ("intranet/wiki", "http://intranet/wiki");
+    g_assert (sokoke_magic_uri_needs_lookup ("localhost"));
+    g_assert (sokoke_magic_uri_needs_lookup ("intranet/wiki"));
+    g_assert (!sokoke_magic_uri_needs_lookup ("example.com/foo"));
+    g_assert (!sokoke_magic_uri_needs_lookup ("localhost:8000"));
+    g_assert (!sokoke_magic_uri_needs_lookup ("sm cats/dogs"));
     test_input ("10.0.0.1", "http://10.0.0.1");
     test_input ("192.168.1.1", "http://192.168.1.1");
     test_input ("192.168.1.1:8000", "http://192.168.1.1:8000");
@@ -272,6 +275,28 @@ magic_uri_prefetch (void)
     g_assert (!sokoke_prefetch_uri ("javascript: alert()", NULL, NULL));
 }
 
+static void
+magic_uri_fts (void)
+{
+    gchar* query;
+
+    g_assert (!sokoke_fts_prefix_query (""));
+    g_assert (!sokoke_fts_prefix_query ("://"));
+    query = sokoke_fts_prefix_query ("Midori");
+    sokoke_assert_str_equal ("Midori", query, "midori*");
+    g_free (query);
+    query = sokoke_fts_prefix_query ("twotoasts.de/midori");
+    sokoke_assert_str_equal ("twotoasts.de/midori", query,
+                             "twotoasts* de* midori*");
+    g_free (query);
+    query = sokoke_fts_prefix_query (" cats OR \"dogs\" -birds");
+    sokoke_assert_str_equal ("cats OR dogs", query, "cats* or* dogs* birds*");
+    g_free (query);
+    query = sokoke_fts_prefix_query ("köln");
+    sokoke_assert_str_equal ("köln", query, "köln*");
+    g_free (query);
+}
+
 int
 main (int    argc,
       char** argv)
@@ -289,6 +314,7 @@ main (int    argc,
     g_test_add_func ("/magic-uri/performance", magic_uri_performance);
     g_test_add_func ("/magic-uri/format", magic_uri_format);
     g_test_add_func ("/magic-uri/prefetch", magic_uri_prefetch);
+    g_test_add_func ("/magic-uri/fts", magic_uri_fts);
 
     return g_test_run ();
 }
@@ -0,0 +1,118 @@
+/*
+ Copyright (C) 2010 Christian Dywan <christian@twotoasts.de>
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ See the file COPYING for the full license text.
+*/
+
+#if HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include "midori-speeddial.h"
+#include "sokoke.h"
+
+#include <string.h>
+
+/* Reverses the Javascript quoting of midori_speed_dial_get_json() */
+static gchar*
+speed_dial_unquote (const gchar* quoted)
+{
+    GString* json = g_string_new (NULL);
+    const gchar* p;
+
+    g_assert (quoted[0] == '\'');
+    for (p = quoted + 1; *p && *p != '\''; p++)
+    {
+        if (*p == '\\' && p[1])
+            p++;
+        g_string_append_c (json, *p);
+    }
+    g_assert (p[0] == '\'' && p[1] == '\0');
+    return g_string_free (json, FALSE);
+}
+
+static void
+speed_dial_assert_json (MidoriSpeedDial* dial,
+                        const gchar*     expected)
+{
+    gchar* json = speed_dial_unquote (midori_speed_dial_get_json (dial));
+    if (strcmp (json, expected))
+        g_error ("Expected: %s\nResult: %s", expected, json);
+    g_assert (g_utf8_validate (json, -1, NULL));
+    g_free (json);
+}
+
+static void
+speed_dial_round_trip (void)
+{
+    MidoriSpeedDial* dial = midori_speed_dial_get_default ();
+    const gchar* expected =
+        "{\"shortcuts\":[{\"id\":\"s1\",\"href\":\"http://example.com/?a=1&b='2'\","
+        "\"title\":\"Café 😀 \\\"quoted\\\" \\u003cb>\\n\",\"img\":\"\"}],"
+        "\"width\":3,\"thumb\":160}";
+    gchar* json;
+
+    g_assert (midori_speed_dial_set_json (dial,
+        "{\"shortcuts\":[{\"id\":\"s1\",\"href\":\"http://example.com/?a=1&b=\\'2\\'\","
+        "\"title\":\"Caf\\u00e9 \\uD83D\\uDE00 \\\"quoted\\\" <b>\\n\",\"img\":\"\"}],"
+        "\"width\":\"3\",\"thumb\":160}"));
+    speed_dial_assert_json (dial, expected);
+
+    /* The serialized form reads back into the same shortcuts */
+    json = speed_dial_unquote (midori_speed_dial_get_json (dial));
+    g_assert (midori_speed_dial_set_json (dial, json));
+    g_free (json);
+    speed_dial_assert_json (dial, expected);
+}
+
+static void
+speed_dial_surrogates (void)
+{
+    MidoriSpeedDial* dial = midori_speed_dial_get_default ();
+
+    g_assert (midori_speed_dial_set_json (dial,
+        "{\"shortcuts\":[{\"id\":\"s1\",\"title\":\"\\ud83d\\ude00\\uD83D x \\uDE00\"}]}"));
+    speed_dial_assert_json (dial,
+        "{\"shortcuts\":[{\"id\":\"s1\",\"href\":\"#\","
+        "\"title\":\"😀\xEF\xBF\xBD x \xEF\xBF\xBD\",\"img\":\"\"}]}");
+}
+
+static void
+speed_dial_invalid (void)
+{
+    MidoriSpeedDial* dial = midori_speed_dial_get_default ();
+    const gchar* expected = "{\"shortcuts\":[{\"id\":\"s1\",\"href\":\"#\","
+        "\"title\":\"\",\"img\":\"\"}]}";
+
+    g_assert (midori_speed_dial_set_json (dial,
+        "{\"shortcuts\":[{\"id\":\"s1\"}]}"));
+    speed_dial_assert_json (dial, expected);
+
+    /* Invalid data leaves the shortcuts alone */
+    g_assert (!midori_speed_dial_set_json (dial,
+        "{\"shortcuts\":[{\"id\":\"s2\",\"title\":\"Cats"));
+    g_assert (!midori_speed_dial_set_json (dial,
+        "{\"shortcuts\":[{\"id\":\"s2\",\"title\":\"\\u00\"}]}"));
+    g_assert (!midori_speed_dial_set_json (dial, "[]"));
+    speed_dial_assert_json (dial, expected);
+}
+
+int
+main (int    argc,
+      char** argv)
+{
+    g_test_init (&argc, &argv, NULL);
+    /* "/" means no configuration is saved */
+    sokoke_set_config_dir ("/");
+
+    g_test_add_func ("/speed-dial/round-trip", speed_dial_round_trip);
+    g_test_add_func ("/speed-dial/surrogates", speed_dial_surrogates);
+    g_test_add_func ("/speed-dial/invalid", speed_dial_invalid);
+
+    return g_test_run ();
+}
@@ -0,0 +1,132 @@
+/*
+ Copyright (C) 2010 Christian Dywan <christian@twotoasts.de>
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ See the file COPYING for the full license text.
+*/
+
+#if HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include "midori-uriblocker.h"
+
+static void
+test_match (MidoriUriBlocker* blocker,
+            const gchar*      uri,
+            gboolean          expected)
+{
+    SoupURI* soup_uri = soup_uri_new (uri);
+    gboolean blocked;
+
+    g_assert (soup_uri != NULL);
+    blocked = midori_uri_blocker_match (blocker, soup_uri);
+    soup_uri_free (soup_uri);
+    if (blocked != expected)
+        g_error ("Input: %s\nExpected: %s\nResult: %s", uri,
+                 expected ? "blocked" : "allowed",
+                 blocked ? "blocked" : "allowed");
+}
+
+static void
+uri_blocker_host (void)
+{
+    MidoriUriBlocker* blocker = midori_uri_blocker_new_from_rules (
+        "example.com\n.ads.net\n*.Tracker.org\n");
+
+    g_assert (blocker != NULL);
+    test_match (blocker, "http://example.com/", TRUE);
+    test_match (blocker, "https://www.example.com/index.html", TRUE);
+    test_match (blocker, "http://a.b.EXAMPLE.com/", TRUE);
+    test_match (blocker, "http://notexample.com/", FALSE);
+    test_match (blocker, "http://example.com.au/", FALSE);
+    test_match (blocker, "http://ads.net/", TRUE);
+    test_match (blocker, "http://cdn.tracker.org/pixel.gif", TRUE);
+    test_match (blocker, "http://tracker.org.example.net/", FALSE);
+    midori_uri_blocker_free (blocker);
+}
+
+static void
+uri_blocker_prefix (void)
+{
+    MidoriUriBlocker* blocker = midori_uri_blocker_new_from_rules (
+        "example.com/ads/\nhttps://secure.example.net/track\n");
+
+    g_assert (blocker != NULL);
+    test_match (blocker, "http://example.com/ads/banner.png", TRUE);
+    test_match (blocker, "https://example.com/ads/", TRUE);
+    test_match (blocker, "http://example.com/ads", FALSE);
+    test_match (blocker, "http://example.com/news/ads/", FALSE);
+    test_match (blocker, "http://www.example.com/ads/", FALSE);
+    test_match (blocker, "https://secure.example.net/tracking.js", TRUE);
+    test_match (blocker, "http://secure.example.net/tracking.js", FALSE);
+    test_match (blocker, "https://secure.example.net/", FALSE);
+    midori_uri_blocker_free (blocker);
+}
+
+static void
+uri_blocker_regex (void)
+{
+    MidoriUriBlocker* blocker = midori_uri_blocker_new_from_rules (
+        "/banner[0-9]+\\.gif/\n/^ftp:/\n");
+
+    g_assert (blocker != NULL);
+    test_match (blocker, "http://example.com/banner12.gif", TRUE);
+    test_match (blocker, "http://example.com/banner.gif", FALSE);
+    test_match (blocker, "ftp://example.com/file", TRUE);
+    test_match (blocker, "http://example.com/ftp:", FALSE);
+    midori_uri_blocker_free (blocker);
+
+    /* A single pattern, as given on the command line */
+    blocker = midori_uri_blocker_new ("doubleclick|adserver");
+    g_assert (blocker != NULL);
+    test_match (blocker, "http://ad.doubleclick.net/", TRUE);
+    test_match (blocker, "http://adserver.example.com/ads/", TRUE);
+    test_match (blocker, "http://example.com/", FALSE);
+    midori_uri_blocker_free (blocker);
+}
+
+static void
+uri_blocker_comments (void)
+{
+    MidoriUriBlocker* blocker = midori_uri_blocker_new_from_rules (
+        "# example.com\n\n   \n  ads.net  \n#/.*/\n");
+
+    g_assert (blocker != NULL);
+    test_match (blocker, "http://example.com/", FALSE);
+    test_match (blocker, "http://ads.net/", TRUE);
+    test_match (blocker, "http://midori.org/", FALSE);
+    midori_uri_blocker_free (blocker);
+
+    blocker = midori_uri_blocker_new_from_rules ("");
+    g_assert (blocker != NULL);
+    test_match (blocker, "http://example.com/", FALSE);
+    midori_uri_blocker_free (blocker);
+}
+
+static void
+uri_blocker_invalid (void)
+{
+    g_assert (!midori_uri_blocker_new_from_rules ("example.com\n/ads(/\n"));
+    g_assert (!midori_uri_blocker_new ("[banner"));
+}
+
+int
+main (int    argc,
+      char** argv)
+{
+    g_test_init (&argc, &argv, NULL);
+    g_type_init ();
+
+    g_test_add_func ("/uri-blocker/host", uri_blocker_host);
+    g_test_add_func ("/uri-blocker/prefix", uri_blocker_prefix);
+    g_test_add_func ("/uri-blocker/regex", uri_blocker_regex);
+    g_test_add_func ("/uri-blocker/comments", uri_blocker_comments);
+    g_test_add_func ("/uri-blocker/invalid", uri_blocker_invalid);
+
+    return g_test_run ();
+}